@@ -0,0 +1,155 @@
+/* Copyright 2015 Jonas Platte
+ *
+ * This file is part of Cyvasse Online.
+ *
+ * Cyvasse Online is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Affero General Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later version.
+ *
+ * Cyvasse Online is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE. See the GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License along with this program.
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "async.hpp"
+
+#include "logger.hpp"
+#include "shared_server_data.hpp"
+
+using namespace std;
+
+BlockingPool::BlockingPool(unsigned nThreads)
+{
+	for (unsigned i = 0; i < nThreads; i++)
+		m_threads.emplace_back(&BlockingPool::run, this);
+}
+
+BlockingPool::~BlockingPool()
+{
+	{
+		lock_guard<mutex> lock(m_mtx);
+		m_running = false;
+	}
+
+	m_cond.notify_all();
+
+	for (auto&& t : m_threads)
+		t.join();
+}
+
+void BlockingPool::run()
+{
+	while (true)
+	{
+		unique_lock<mutex> lock(m_mtx);
+
+		while (m_running && m_tasks.empty())
+			m_cond.wait(lock);
+
+		if (!m_running)
+			break;
+
+		auto task = move(m_tasks.front());
+		m_tasks.pop();
+
+		lock.unlock();
+
+		try
+		{
+			task();
+		}
+		catch (std::exception& e)
+		{
+			LOG_ERROR("blocking task threw an exception", e.what());
+		}
+		catch (...)
+		{
+			LOG_ERROR("blocking task threw an unrecognized error");
+		}
+	}
+}
+
+void BlockingPool::post(function<void()> task)
+{
+	{
+		lock_guard<mutex> lock(m_mtx);
+		m_tasks.push(move(task));
+	}
+
+	m_cond.notify_one();
+}
+
+size_t BlockingPool::queued()
+{
+	lock_guard<mutex> lock(m_mtx);
+	return m_tasks.size();
+}
+
+uint64_t MatchStrand::reserve()
+{
+	lock_guard<mutex> lock(m_mtx);
+
+	m_slots.emplace_back();
+	return m_firstTicket + m_slots.size() - 1;
+}
+
+void MatchStrand::resume(SharedServerData& data, uint64_t ticket, ContinuationFn fn)
+{
+	unique_lock<mutex> lock(m_mtx);
+
+	// filled already if the first resume() threw after storing it
+	if (ticket < m_firstTicket || m_slots[ticket - m_firstTicket])
+		return;
+
+	m_slots[ticket - m_firstTicket] = move(fn);
+
+	if (!m_running)
+		runNext(data, lock);
+}
+
+void MatchStrand::runNext(SharedServerData& data, unique_lock<mutex>& lock)
+{
+	if (m_slots.empty() || !m_slots.front())
+	{
+		m_running = false;
+		return;
+	}
+
+	auto fn = move(m_slots.front());
+	m_slots.pop_front();
+	m_firstTicket++;
+	m_running = true;
+
+	lock.unlock();
+
+	auto self = shared_from_this();
+
+	// no connection, the strand does the ordering
+	data.queueContinuation(Job(connection_hdl(), [self, &data, fn](Worker& worker) {
+		try
+		{
+			fn(worker);
+		}
+		catch (...)
+		{
+			self->done(data);
+			throw;
+		}
+
+		self->done(data);
+	}, 0, 0));
+}
+
+void MatchStrand::done(SharedServerData& data)
+{
+	unique_lock<mutex> lock(m_mtx);
+	runNext(data, lock);
+}
+
+size_t MatchStrand::pending()
+{
+	lock_guard<mutex> lock(m_mtx);
+	return m_slots.size();
+}
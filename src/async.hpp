@@ -0,0 +1,111 @@
+/* Copyright 2015 Jonas Platte
+ *
+ * This file is part of Cyvasse Online.
+ *
+ * Cyvasse Online is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Affero General Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later version.
+ *
+ * Cyvasse Online is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE. See the GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License along with this program.
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef _ASYNC_HPP_
+#define _ASYNC_HPP_
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+#include <cstdint>
+
+// Threads for blocking calls (archive writes, waiting for the new process of
+// a handoff, database access later on) that would otherwise stall a worker
+// or the I/O thread
+class BlockingPool
+{
+	private:
+		std::queue<std::function<void()>> m_tasks;
+
+		std::mutex m_mtx;
+		std::condition_variable m_cond;
+		bool m_running = true;
+
+		std::vector<std::thread> m_threads;
+
+		void run();
+
+	public:
+		explicit BlockingPool(unsigned nThreads);
+		// tasks that didn't start yet are dropped
+		~BlockingPool();
+
+		void post(std::function<void()>);
+
+		size_t queued();
+};
+
+struct SharedServerData;
+class Worker;
+
+// Orders the continuations of a match's asynchronous operations. Each match
+// has one (see MatchData::getStrand), and so does anything else that needs
+// its continuations to run one at a time.
+class MatchStrand : public std::enable_shared_from_this<MatchStrand>
+{
+	public:
+		typedef std::function<void(Worker&)> ContinuationFn;
+
+	private:
+		std::mutex m_mtx;
+
+		// one slot per offload() that didn't continue yet, in the order they
+		// were started, empty until its operation finished
+		std::deque<ContinuationFn> m_slots;
+		uint64_t m_firstTicket = 0;
+		bool m_running = false;
+
+		uint64_t reserve();
+		void resume(SharedServerData&, uint64_t ticket, ContinuationFn);
+		// queues the first slot if it is filled already, call with m_mtx locked
+		void runNext(SharedServerData&, std::unique_lock<std::mutex>&);
+		void done(SharedServerData&);
+
+	public:
+		// Runs op() on the pool (it has to return something), then
+		// then(worker, result) as a job on one of the workers. The continuations
+		// of one strand run one at a time and in the order offload() was called,
+		// no matter which operation finishes first. A strand can outlive its
+		// match, the pending operations keep it alive.
+		template <typename Op, typename Then>
+		void offload(BlockingPool& pool, SharedServerData& data, Op op, Then then)
+		{
+			auto self = shared_from_this();
+			auto ticket = reserve();
+
+			pool.post([self, &data, ticket, op, then]() mutable {
+				try
+				{
+					auto result = op();
+					self->resume(data, ticket, [then, result](Worker& worker) mutable { then(worker, std::move(result)); });
+				}
+				catch (...)
+				{
+					// the later continuations would wait for this one forever
+					self->resume(data, ticket, [](Worker&) { });
+					throw;
+				}
+			});
+		}
+
+		size_t pending();
+};
+
+#endif // _ASYNC_HPP_
@@ -23,6 +23,10 @@
 #include <b64/decode.h>
 #undef BUFFERSIZE
 
+#include <string>
+#include <cctype>
+#include <cstdint>
+
 // this function starts with _ because it's not universally usable
 // (it ignores the last 1/4 of bytes of the parameter value)
 template <typename IntType>
@@ -51,4 +55,30 @@ std::string _intToB64ID(IntType intVal)
 #define int48ToB64ID(x) \
 	_intToB64ID<uint64_t>(x)
 
+// reverse of int24ToB64ID, returns false if str isn't a valid id
+inline bool b64IDToInt24(std::string str, uint32_t& intVal)
+{
+	if (str.size() != 4)
+		return false;
+
+	// libb64 silently skips invalid characters, so check them here
+	for (auto& c : str)
+	{
+		if (c == '_')
+			c = '/';
+		else if (!isalnum(static_cast<unsigned char>(c)) && c != '+')
+			return false;
+	}
+
+	base64::decoder dec;
+	base64_init_decodestate(&dec._state);
+
+	uint32_t res = 0;
+	if (dec.decode(str.c_str(), str.size(), reinterpret_cast<char*>(&res)) != 3)
+		return false;
+
+	intVal = res;
+	return true;
+}
+
 #endif // _B64_HPP_
@@ -0,0 +1,79 @@
+/* Copyright 2015 Jonas Platte
+ *
+ * This file is part of Cyvasse Online.
+ *
+ * Cyvasse Online is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Affero General Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later version.
+ *
+ * Cyvasse Online is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE. See the GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License along with this program.
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "board_snapshot.hpp"
+
+#include <algorithm>
+#include <json/value.h>
+#include "b64.hpp"
+
+using namespace std;
+
+constexpr size_t BoardSnapshot::tileCount;
+
+shared_ptr<const string> BoardSnapshot::getEncoded() const
+{
+	if (!m_encoded)
+		m_encoded = make_shared<const string>(encode(m_tiles.data()));
+
+	return m_encoded;
+}
+
+string BoardSnapshot::encode(const uint8_t* tiles)
+{
+	base64::encoder enc;
+	base64_init_encodestate(&enc._state);
+
+	// base64 needs 4 characters per 3 bytes
+	char buf[(tileCount + 2) / 3 * 4 + 8];
+
+	auto len = enc.encode(reinterpret_cast<const char*>(tiles), tileCount, buf);
+	len += enc.encode_end(buf + len);
+
+	string str(buf, len);
+	// libb64 breaks lines after 72 characters
+	str.erase(std::remove(str.begin(), str.end(), '\n'), str.end());
+
+	return str;
+}
+
+namespace CoordJson
+{
+	Json::Value coordinate(BoardSnapshot::Coordinate coord)
+	{
+		Json::Value ret(Json::arrayValue);
+		ret.append(coord.x());
+		ret.append(coord.y());
+
+		return ret;
+	}
+
+	bool parseCoordinate(const Json::Value& value, BoardSnapshot::Coordinate& coord)
+	{
+		if (!value.isArray() || value.size() != 2 || !value[0].isInt() || !value[1].isInt())
+			return false;
+
+		int x = value[0].asInt(), y = value[1].asInt();
+		int last = BoardSnapshot::gridSize - 1;
+
+		// inside the grid and the hexagon
+		if (x < 0 || x > last || y < 0 || y > last || x + y < last / 2 || x + y > last + last / 2)
+			return false;
+
+		coord = BoardSnapshot::Coordinate(x, y);
+		return true;
+	}
+}
@@ -0,0 +1,122 @@
+/* Copyright 2015 Jonas Platte
+ *
+ * This file is part of Cyvasse Online.
+ *
+ * Cyvasse Online is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Affero General Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later version.
+ *
+ * Cyvasse Online is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE. See the GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License along with this program.
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _BOARD_SNAPSHOT_HPP_
+#define _BOARD_SNAPSHOT_HPP_
+
+#include <array>
+#include <memory>
+#include <string>
+#include <cstdint>
+#include <cyvasse/hexcoordinate.hpp>
+#include <cyvasse/piece.hpp>
+
+namespace Json { class Value; }
+
+// Packed copy of the pieces on the board, updated by the handlers that change
+// the match so join replies don't have to walk Match::getActivePieces().
+// One byte per cell of the 11x11 grid HexCoordinate<6> lives in (row-major by
+// y, the 30 cells outside of the hexagon are always 0): 0 for an empty tile,
+// otherwise the piece type + 1, with the high bit set for black pieces.
+// Not thread-safe, guard with MatchData::getMatchMtx().
+class BoardSnapshot
+{
+	public:
+		typedef cyvasse::HexCoordinate<6> Coordinate;
+
+		static constexpr int gridSize = 11;
+		static constexpr size_t tileCount = gridSize * gridSize;
+
+		static constexpr uint8_t emptyTile = 0;
+		static constexpr uint8_t blackBit  = 0x80;
+
+	private:
+		std::array<uint8_t, tileCount> m_tiles {};
+		size_t m_pieceCount = 0;
+
+		mutable std::shared_ptr<const std::string> m_encoded;
+
+		void changed()
+		{ m_encoded.reset(); }
+
+	public:
+		static size_t index(Coordinate coord)
+		{ return size_t(coord.y()) * gridSize + size_t(coord.x()); }
+
+		size_t getPieceCount() const
+		{ return m_pieceCount; }
+
+		bool empty() const
+		{ return m_pieceCount == 0; }
+
+		uint8_t getTile(Coordinate coord) const
+		{ return m_tiles[index(coord)]; }
+
+		const std::array<uint8_t, tileCount>& getTiles() const
+		{ return m_tiles; }
+
+		void set(Coordinate coord, cyvasse::PlayersColor color, cyvasse::PieceType type)
+		{
+			auto& tile = m_tiles[index(coord)];
+			if (tile == emptyTile)
+				m_pieceCount++;
+
+			tile = uint8_t(int(type) + 1) | (color == cyvasse::PlayersColor::BLACK ? blackBit : 0);
+			changed();
+		}
+
+		void remove(Coordinate coord)
+		{
+			auto& tile = m_tiles[index(coord)];
+			if (tile == emptyTile)
+				return;
+
+			tile = emptyTile;
+			m_pieceCount--;
+			changed();
+		}
+
+		// a piece on to is replaced (captured)
+		void move(Coordinate from, Coordinate to)
+		{
+			auto piece = m_tiles[index(from)];
+			if (piece == emptyTile)
+				return;
+
+			remove(to);
+			m_tiles[index(to)] = piece;
+			m_tiles[index(from)] = emptyTile;
+			changed();
+		}
+
+		// base64 of the tiles, encoded once per change and shared by all
+		// replies until the next one. Can still be used after the lock is released.
+		std::shared_ptr<const std::string> getEncoded() const;
+
+		// the same encoding for tiles that were copied out of a snapshot
+		static std::string encode(const uint8_t* tiles);
+};
+
+// TODO: move to cyvws, see protocol_ext.hpp
+namespace CoordJson
+{
+	// [x, y]
+	Json::Value coordinate(BoardSnapshot::Coordinate);
+	// returns false if value isn't a coordinate on the board
+	bool parseCoordinate(const Json::Value& value, BoardSnapshot::Coordinate&);
+}
+
+#endif // _BOARD_SNAPSHOT_HPP_
@@ -0,0 +1,132 @@
+/* Copyright 2015 Jonas Platte
+ *
+ * This file is part of Cyvasse Online.
+ *
+ * Cyvasse Online is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Affero General Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later version.
+ *
+ * Cyvasse Online is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE. See the GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License along with this program.
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "capture.hpp"
+
+#include <stdexcept>
+#include <cstring>
+
+using namespace std;
+using namespace std::chrono;
+
+static constexpr char magic[8] = {'C', 'Y', 'V', 'C', 'A', 'P', '\0', '\1'};
+
+constexpr uint64_t CaptureReader::maxPayload;
+
+CaptureWriter::CaptureWriter(const string& fileName)
+	: m_file(fileName, ios::binary | ios::trunc)
+	, m_start(Clock::now())
+{
+	if (!m_file)
+		throw runtime_error("couldn't open capture file " + fileName);
+
+	m_file.write(magic, sizeof(magic));
+}
+
+void CaptureWriter::writeVarint(uint64_t val)
+{
+	char buf[10];
+	size_t len = 0;
+
+	do
+	{
+		buf[len] = val & 0x7F;
+		val >>= 7;
+		if (val)
+			buf[len] |= 0x80;
+		len++;
+	}
+	while (val);
+
+	m_file.write(buf, len);
+}
+
+void CaptureWriter::write(CaptureRecordType type, uint64_t connID, const string& payload)
+{
+	lock_guard<mutex> lock(m_mtx);
+
+	// taken under the lock so the deltas can't be negative
+	uint64_t time = duration_cast<microseconds>(Clock::now() - m_start).count();
+
+	m_file.put(static_cast<char>(type));
+	writeVarint(connID);
+	writeVarint(time - m_lastTime);
+	writeVarint(payload.size());
+	m_file.write(payload.data(), payload.size());
+
+	m_lastTime = time;
+}
+
+void CaptureWriter::flush()
+{
+	lock_guard<mutex> lock(m_mtx);
+	m_file.flush();
+}
+
+CaptureReader::CaptureReader(const string& fileName)
+	: m_file(fileName, ios::binary)
+{
+	if (!m_file)
+		throw runtime_error("couldn't open capture file " + fileName);
+
+	char buf[sizeof(magic)];
+	if (!m_file.read(buf, sizeof(buf)) || memcmp(buf, magic, sizeof(magic)) != 0)
+		throw runtime_error(fileName + " is not a capture file");
+}
+
+bool CaptureReader::readVarint(uint64_t& val)
+{
+	val = 0;
+
+	for (unsigned shift = 0; shift < 64; shift += 7)
+	{
+		int c = m_file.get();
+		if (c == EOF)
+			return false;
+
+		val |= uint64_t(c & 0x7F) << shift;
+		if (!(c & 0x80))
+			return true;
+	}
+
+	return false;
+}
+
+bool CaptureReader::next(CaptureRecord& record)
+{
+	int type = m_file.get();
+	if (type == EOF)
+		return false;
+
+	uint64_t timeDelta, size;
+	if (type > static_cast<int>(CaptureRecordType::SENT) ||
+	    !readVarint(record.connID) || !readVarint(timeDelta) || !readVarint(size))
+		throw runtime_error("truncated or corrupt capture record");
+
+	// a corrupt size would allocate up to 2^64 bytes before the read fails
+	if (size > maxPayload)
+		throw runtime_error("corrupt capture record");
+
+	record.payload.resize(size);
+	if (!m_file.read(&record.payload[0], size))
+		throw runtime_error("truncated or corrupt capture record");
+
+	m_time += timeDelta;
+
+	record.type = static_cast<CaptureRecordType>(type);
+	record.time = m_time;
+
+	return true;
+}
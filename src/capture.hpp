@@ -0,0 +1,89 @@
+/* Copyright 2015 Jonas Platte
+ *
+ * This file is part of Cyvasse Online.
+ *
+ * Cyvasse Online is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Affero General Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later version.
+ *
+ * Cyvasse Online is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE. See the GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License along with this program.
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef _CAPTURE_HPP_
+#define _CAPTURE_HPP_
+
+#include <chrono>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <cstdint>
+
+// Traffic capture file format, written by the server if captureFile is set
+// and read by cyvasse-replay. After an 8 byte magic the file is a sequence of
+//   type (1 byte), connection id, time delta (µs), payload size (varints), payload
+// The time deltas are relative to the previous record, so they are nearly
+// always a single byte. Records are in the order the server saw them.
+enum class CaptureRecordType : uint8_t
+{
+	OPEN,     // connection opened
+	CLOSE,    // connection closed
+	RECEIVED, // message from the client
+	SENT      // message to the client
+};
+
+struct CaptureRecord
+{
+	CaptureRecordType type;
+	uint64_t connID;
+	uint64_t time; // µs since the capture was started
+	std::string payload;
+};
+
+class CaptureWriter
+{
+	private:
+		typedef std::chrono::steady_clock Clock;
+
+		std::ofstream m_file;
+		std::mutex m_mtx;
+
+		Clock::time_point m_start;
+		uint64_t m_lastTime = 0;
+
+		void writeVarint(uint64_t);
+
+	public:
+		// throws std::runtime_error if the file can't be opened
+		explicit CaptureWriter(const std::string& fileName);
+
+		// thread-safe
+		void write(CaptureRecordType, uint64_t connID, const std::string& payload = std::string());
+		void flush();
+};
+
+class CaptureReader
+{
+	private:
+		std::ifstream m_file;
+		uint64_t m_time = 0;
+
+		bool readVarint(uint64_t&);
+
+	public:
+		// throws std::runtime_error if the file can't be opened or isn't a capture
+		explicit CaptureReader(const std::string& fileName);
+
+		// websocketpp's default max_message_size, the server
+		// neither receives nor sends larger messages
+		static constexpr uint64_t maxPayload = 32000000;
+
+		// returns false at the end of the file, throws std::runtime_error
+		// on a truncated record or one with a payload over maxPayload
+		bool next(CaptureRecord&);
+};
+
+#endif // _CAPTURE_HPP_
@@ -18,6 +18,7 @@
 #define _CLIENT_DATA_HPP_
 
 #include <memory>
+#include <mutex>
 #include <string>
 #include <websocketpp/common/connection_hdl.hpp>
 
@@ -37,10 +38,12 @@ class ClientData
 
 		MatchData& m_matchData;
 
-	public:
-		// doesn't really have restrictions, so why make it private?
-		std::string username;
+		// changed by the worker handling setUsername while
+		// others read it, so it needs its own lock
+		mutable std::mutex m_usernameMtx;
+		std::string m_username;
 
+	public:
 		ClientData(cyvasse::Match& match, cyvasse::PlayersColor color, const std::string& playerID, connection_hdl hdl, MatchData& matchData)
 			: m_player([&]() -> cyvasse::Player& {
 				match.setPlayer(color, std::make_unique<cyvasse::Player>(
@@ -51,9 +54,23 @@ class ClientData
 			}())
 			, m_connHdl(hdl)
 			, m_matchData(matchData)
-			, username(cyvasse::PlayersColorToPrettyStr(color))
+			, m_username(cyvasse::PlayersColorToPrettyStr(color))
 		{ }
 
+		std::string getUsername() const
+		{
+			std::lock_guard<std::mutex> lock(m_usernameMtx);
+			return m_username;
+		}
+
+		// returns the old username
+		std::string setUsername(std::string username)
+		{
+			std::lock_guard<std::mutex> lock(m_usernameMtx);
+			m_username.swap(username);
+			return username;
+		}
+
 		cyvasse::Player& getPlayer()
 		{ return m_player; }
 
@@ -63,6 +80,9 @@ class ClientData
 		MatchData& getMatchData()
 		{ return m_matchData; }
 
+		const MatchData& getMatchData() const
+		{ return m_matchData; }
+
 		bool operator==(const ClientData& other) const
 		{ return m_player.getID() == other.m_player.getID(); }
 
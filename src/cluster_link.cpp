@@ -0,0 +1,415 @@
+/* Copyright 2015 Jonas Platte
+ *
+ * This file is part of Cyvasse Online.
+ *
+ * Cyvasse Online is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Affero General Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later version.
+ *
+ * Cyvasse Online is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE. See the GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License along with this program.
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "cluster_link.hpp"
+
+#include <iostream>
+#include <stdexcept>
+#include <cstdio>
+#include <sys/stat.h>
+
+#include <json/reader.h>
+#include <json/writer.h>
+#include <cyvws/notification.hpp>
+
+#include "b64.hpp"
+#include "cyvasse_server.hpp"
+#include "logger.hpp"
+#include "timer_wheel.hpp"
+
+using namespace std;
+using namespace cyvasse;
+using namespace cyvws;
+using namespace websocketpp;
+
+namespace
+{
+	// message types of the node-to-node protocol
+	constexpr const char* HELLO        = "hello";
+	constexpr const char* LOBBY_SYNC   = "lobbySync";
+	constexpr const char* LOBBY_ADD    = "lobbyAdd";
+	constexpr const char* LOBBY_REMOVE = "lobbyRemove";
+
+	constexpr auto reconnectDelay = chrono::seconds(5);
+}
+
+struct ClusterLink::Inbound
+{
+	Protocol::socket socket;
+	lib::asio::streambuf buf;
+
+	// the remote entries are stored under it
+	uint64_t id;
+
+	// set by the hello message
+	int node = -1;
+
+	Inbound(lib::asio::io_service& io, uint64_t id_)
+		: socket(io)
+		, id(id_)
+	{ }
+};
+
+ClusterLink::ClusterLink(CyvasseServer& server, SharedServerData& data, TimerWheel& timers,
+	lib::asio::io_service& io, const ClusterConfig& config)
+	: m_server(server)
+	, m_data(data)
+	, m_timers(timers)
+	, m_config(config)
+	, m_io(io)
+	, m_acceptor(io)
+{
+	for (const auto& node : m_config.nodes)
+		m_peers.push_back(make_unique<Peer>(node, io));
+}
+
+void ClusterLink::start()
+{
+	listen();
+
+	for (auto&& peer : m_peers)
+		connect(*peer);
+}
+
+void ClusterLink::listen()
+{
+	Protocol::endpoint endpoint(m_config.socketPath);
+
+	// A socket file left behind by a previous run would make bind fail, but
+	// after a handoff the old process still accepts on it until it exits.
+	// Only a refused connection means nobody listens, see Listener::listenUnix.
+	struct stat st;
+	if (lstat(m_config.socketPath.c_str(), &st) == 0 && S_ISSOCK(st.st_mode))
+	{
+		lib::asio::error_code ec;
+		Protocol::socket probe(m_io);
+		probe.connect(endpoint, ec);
+
+		if (!ec)
+		{
+			LOG_INFO("cluster: socket still in use, retrying", m_config.socketPath);
+
+			m_timers.add(reconnectDelay, [this] {
+				try
+				{
+					listen();
+				}
+				catch (std::exception& e)
+				{
+					LOG_ERROR("cluster: couldn't listen", e.what());
+				}
+			});
+
+			return;
+		}
+
+		if (ec != lib::asio::error::connection_refused)
+			throw runtime_error("cluster: connect " + m_config.socketPath + ": " + ec.message());
+
+		remove(m_config.socketPath.c_str());
+	}
+
+	m_acceptor.open(endpoint.protocol());
+	m_acceptor.bind(endpoint);
+	m_acceptor.listen();
+
+	startAccept();
+}
+
+void ClusterLink::startAccept()
+{
+	auto inbound = make_shared<Inbound>(m_io, m_nextInboundID++);
+
+	m_acceptor.async_accept(inbound->socket, [this, inbound](const lib::asio::error_code& ec) {
+		if (ec == lib::asio::error::operation_aborted)
+			return;
+
+		if (!ec)
+			readFrom(inbound);
+
+		startAccept();
+	});
+}
+
+void ClusterLink::readFrom(shared_ptr<Inbound> inbound)
+{
+	lib::asio::async_read_until(inbound->socket, inbound->buf, '\n',
+		[this, inbound](const lib::asio::error_code& ec, size_t) {
+			if (ec)
+			{
+				// the node (or this process of it) is gone, so are its matches
+				removeRemoteEntries(inbound->id, true);
+				return;
+			}
+
+			string line;
+			istream is(&inbound->buf);
+			getline(is, line);
+
+			Json::Value msg;
+			if (Json::Reader().parse(line, msg, false) && msg.isObject())
+				processMessage(*inbound, msg);
+			else
+				LOG_WARNING("cluster: received invalid message", line);
+
+			readFrom(inbound);
+		}
+	);
+}
+
+void ClusterLink::processMessage(Inbound& inbound, const Json::Value& msg)
+{
+	const auto& type = msg["type"].asString();
+
+	if (type == HELLO)
+	{
+		inbound.node = msg["node"].asInt();
+		return;
+	}
+
+	if (inbound.node == -1)
+		return;
+
+	if (type == LOBBY_SYNC)
+	{
+		removeRemoteEntries(inbound.id, false);
+
+		for (const auto& entry : msg["entries"])
+			addRemoteEntry(inbound, entry);
+	}
+	else if (type == LOBBY_ADD)
+		addRemoteEntry(inbound, msg["entry"]);
+	else if (type == LOBBY_REMOVE)
+		removeRemoteEntry(inbound.id, msg["matchID"].asString());
+	else
+		return;
+
+	m_server.listUpdated(RANDOM_GAMES);
+}
+
+bool ClusterLink::isEntryOf(unsigned node, const string& matchID) const
+{
+	uint32_t numMatchID;
+	return b64IDToInt24(matchID, numMatchID) && m_config.nodeOf(numMatchID) == node;
+}
+
+bool ClusterLink::isHeldElsewhere(uint64_t inboundID, const string& matchID) const
+{
+	for (const auto& it : m_remoteEntries)
+		if (it.first != inboundID && it.second.count(matchID))
+			return true;
+
+	return false;
+}
+
+void ClusterLink::addRemoteEntry(const Inbound& inbound, const Json::Value& entry)
+{
+	const auto& matchID = entry["matchID"].asString();
+	unsigned node = inbound.node;
+
+	// never let another node shadow one of our matches
+	if (node == m_config.nodeID || !isEntryOf(node, matchID))
+		return;
+
+	m_remoteEntries[inbound.id].insert(matchID);
+
+	lock_guard<mutex> lock(m_data.gameListsMtx[RANDOM_GAMES]);
+
+	// might be a title update, insert replaces the entry then
+	m_data.gameLists[RANDOM_GAMES].insert(matchID,
+		GamesListMappedType { entry["title"].asString(), StrToPlayersColor(entry["color"].asString()) },
+		entry["ruleSet"].asString()
+	);
+}
+
+void ClusterLink::removeRemoteEntry(uint64_t inboundID, const string& matchID)
+{
+	auto it = m_remoteEntries.find(inboundID);
+	if (it == m_remoteEntries.end() || !it->second.erase(matchID) || isHeldElsewhere(inboundID, matchID))
+		return;
+
+	lock_guard<mutex> lock(m_data.gameListsMtx[RANDOM_GAMES]);
+	m_data.gameLists[RANDOM_GAMES].erase(matchID);
+}
+
+void ClusterLink::removeRemoteEntries(uint64_t inboundID, bool notify)
+{
+	auto it = m_remoteEntries.find(inboundID);
+	if (it == m_remoteEntries.end())
+		return;
+
+	auto matchIDs = move(it->second);
+	m_remoteEntries.erase(it);
+
+	if (matchIDs.empty())
+		return;
+
+	{
+		// the other process of the node during a handoff might have sent it too
+		lock_guard<mutex> lock(m_data.gameListsMtx[RANDOM_GAMES]);
+		for (const auto& matchID : matchIDs)
+			if (!isHeldElsewhere(inboundID, matchID))
+				m_data.gameLists[RANDOM_GAMES].erase(matchID);
+	}
+
+	if (notify)
+		m_server.listUpdated(RANDOM_GAMES);
+}
+
+void ClusterLink::connect(Peer& peer)
+{
+	peer.socket.async_connect(Protocol::endpoint(peer.node.socketPath), [this, &peer](const lib::asio::error_code& ec) {
+		if (ec)
+		{
+			lib::asio::error_code ignored;
+			peer.socket.close(ignored);
+
+			m_timers.add(reconnectDelay, [this, &peer] { connect(peer); });
+			return;
+		}
+
+		peer.connected = true;
+		peer.writeQueue.clear();
+		watch(peer);
+
+		Json::Value hello;
+		hello["type"] = HELLO;
+		hello["node"] = m_config.nodeID;
+		send(peer, Json::FastWriter().write(hello));
+
+		Json::Value sync;
+		sync["type"] = LOBBY_SYNC;
+		sync["entries"] = Json::arrayValue;
+		for (const auto& it : m_localEntries)
+			sync["entries"].append(it.second);
+
+		send(peer, Json::FastWriter().write(sync));
+	});
+}
+
+void ClusterLink::watch(Peer& peer)
+{
+	auto generation = peer.generation;
+
+	peer.socket.async_read_some(lib::asio::buffer(peer.readBuf), [this, &peer, generation](const lib::asio::error_code& ec, size_t) {
+		if (generation != peer.generation)
+			return;
+
+		// EOF when the peer exits or restarts, it needs a full sync then
+		if (ec)
+			disconnect(peer);
+		else
+			watch(peer);
+	});
+}
+
+void ClusterLink::disconnect(Peer& peer)
+{
+	if (!peer.connected)
+		return;
+
+	// the peer drops our entries when it notices, and gets a
+	// full sync once we are connected again
+	lib::asio::error_code ignored;
+	peer.socket.close(ignored);
+
+	peer.connected = false;
+	peer.writing = false;
+	peer.writeQueue.clear();
+	peer.generation++;
+
+	m_timers.add(reconnectDelay, [this, &peer] { connect(peer); });
+}
+
+void ClusterLink::send(Peer& peer, string msg)
+{
+	if (!peer.connected)
+		return;
+
+	peer.writeQueue.push_back(move(msg));
+
+	if (!peer.writing)
+		writeNext(peer);
+}
+
+void ClusterLink::broadcast(const Json::Value& msg)
+{
+	auto str = Json::FastWriter().write(msg);
+
+	for (auto&& peer : m_peers)
+		send(*peer, str);
+}
+
+void ClusterLink::writeNext(Peer& peer)
+{
+	if (peer.writeQueue.empty())
+	{
+		peer.writing = false;
+		return;
+	}
+
+	peer.writing = true;
+	auto generation = peer.generation;
+
+	lib::asio::async_write(peer.socket, lib::asio::buffer(peer.writeQueue.front()),
+		[this, &peer, generation](const lib::asio::error_code& ec, size_t) {
+			if (generation != peer.generation)
+				return;
+
+			if (ec)
+			{
+				disconnect(peer);
+				return;
+			}
+
+			peer.writeQueue.pop_front();
+			writeNext(peer);
+		}
+	);
+}
+
+void ClusterLink::publishLobbyEntry(const string& matchID, const string& title, PlayersColor color, const string& ruleSet)
+{
+	Json::Value entry;
+	entry["matchID"] = matchID;
+	entry["title"]   = title;
+	entry["color"]   = PlayersColorToStr(color);
+	entry["ruleSet"] = ruleSet;
+
+	m_io.post([this, entry] {
+		m_localEntries[entry["matchID"].asString()] = entry;
+
+		Json::Value msg;
+		msg["type"]  = LOBBY_ADD;
+		msg["entry"] = entry;
+
+		broadcast(msg);
+	});
+}
+
+void ClusterLink::publishLobbyRemoval(const string& matchID)
+{
+	m_io.post([this, matchID] {
+		if (!m_localEntries.erase(matchID))
+			return;
+
+		Json::Value msg;
+		msg["type"]    = LOBBY_REMOVE;
+		msg["matchID"] = matchID;
+
+		broadcast(msg);
+	});
+}
@@ -0,0 +1,123 @@
+/* Copyright 2015 Jonas Platte
+ *
+ * This file is part of Cyvasse Online.
+ *
+ * Cyvasse Online is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Affero General Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later version.
+ *
+ * Cyvasse Online is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE. See the GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License along with this program.
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _CLUSTER_LINK_HPP_
+#define _CLUSTER_LINK_HPP_
+
+#include <deque>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+#include <json/value.h>
+#include <cyvasse/player.hpp>
+#include "server_config.hpp"
+#include "shared_server_data.hpp"
+
+class CyvasseServer;
+class TimerWheel;
+
+// Connection to the other nodes of a cluster, over unix sockets. Every node
+// connects to the socket of every other node and sends the changes to its own
+// entries of the random games list as newline-delimited JSON. The entries
+// received from other nodes are merged into the local list, joining one of
+// them makes the client get redirected to the node that owns the match.
+//
+// During a handoff two processes have the same node id for a while, so the
+// received entries belong to the connection they came in on, not to the node.
+// A connection to a peer is reopened (with a full sync) when the peer closes
+// it, e.g. because it exited after handing off to a new process.
+//
+// Everything except the publish* functions runs on the I/O thread.
+class ClusterLink
+{
+	private:
+		typedef websocketpp::lib::asio::local::stream_protocol Protocol;
+
+		struct Peer
+		{
+			const ClusterNode& node;
+			Protocol::socket socket;
+
+			bool connected = false;
+			bool writing = false;
+			std::deque<std::string> writeQueue;
+
+			// incremented on every disconnect, so handlers of the
+			// previous connection don't touch the next one
+			unsigned generation = 0;
+			// the peer never sends anything, it's only read to notice EOF
+			char readBuf[64];
+
+			Peer(const ClusterNode& node_, websocketpp::lib::asio::io_service& io)
+				: node(node_)
+				, socket(io)
+			{ }
+		};
+
+		struct Inbound;
+
+		CyvasseServer& m_server;
+		SharedServerData& m_data;
+		TimerWheel& m_timers;
+
+		const ClusterConfig& m_config;
+
+		websocketpp::lib::asio::io_service& m_io;
+		Protocol::acceptor m_acceptor;
+
+		std::vector<std::unique_ptr<Peer>> m_peers;
+
+		// our own entries of the random games list, sent to peers that (re)connect
+		std::map<std::string, Json::Value> m_localEntries;
+		// the entries we got from other nodes, by the id of the inbound connection
+		std::map<uint64_t, std::set<std::string>> m_remoteEntries;
+		uint64_t m_nextInboundID = 1;
+
+		// binds the socket, or retries later while the previous process
+		// of this node still listens on it
+		void listen();
+		void startAccept();
+		void readFrom(std::shared_ptr<Inbound>);
+		void processMessage(Inbound&, const Json::Value&);
+
+		void connect(Peer&);
+		void watch(Peer&);
+		void disconnect(Peer&);
+		void send(Peer&, std::string);
+		void broadcast(const Json::Value&);
+		void writeNext(Peer&);
+
+		bool isEntryOf(unsigned node, const std::string& matchID) const;
+		// whether a connection other than the given one still has the entry
+		bool isHeldElsewhere(uint64_t inboundID, const std::string& matchID) const;
+		void addRemoteEntry(const Inbound&, const Json::Value& entry);
+		void removeRemoteEntry(uint64_t inboundID, const std::string& matchID);
+		void removeRemoteEntries(uint64_t inboundID, bool notify);
+
+	public:
+		ClusterLink(CyvasseServer&, SharedServerData&, TimerWheel&,
+			websocketpp::lib::asio::io_service&, const ClusterConfig&);
+
+		void start();
+
+		// thread-safe
+		void publishLobbyEntry(const std::string& matchID, const std::string& title, cyvasse::PlayersColor, const std::string& ruleSet);
+		void publishLobbyRemoval(const std::string& matchID);
+};
+
+#endif // _CLUSTER_LINK_HPP_
@@ -16,15 +16,32 @@
 
 #include "cyvasse_server.hpp"
 
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
 #include <thread>
 #include <cassert>
+#include <csignal>
+#include <unistd.h>
 #include <json/value.h>
 #include <json/writer.h>
 //#include <cyvdb/match_manager.hpp>
 #include <cyvws/json_notification.hpp>
 #include <cyvws/json_server_reply.hpp>
+#include "async.hpp"
+#include "capture.hpp"
 #include "client_data.hpp"
+#include "cluster_link.hpp"
+#include "handoff.hpp"
+#include "listener.hpp"
+#include "logger.hpp"
+#include "match_archive.hpp"
 #include "match_data.hpp"
+#include "memory_pool.hpp"
+#include "search.hpp"
+#include "send_batch.hpp"
+#include "trace.hpp"
 #include "worker.hpp"
 
 using namespace std;
@@ -32,39 +49,147 @@ using namespace websocketpp;
 
 using namespace cyvws;
 
-CyvasseServer::CyvasseServer()
+// websocketpp doesn't tell how much it allocates per connection, this is
+// the connection object (including ConnectionData) plus its read buffer
+static constexpr size_t connectionFootprint =
+	sizeof(WSServer::connection_type) + WSConfig::connection_read_buffer_size;
+
+CyvasseServer::CyvasseServer(const ServerConfig& config)
+	: m_config(config)
+	, m_timers(chrono::milliseconds(100))
+	, m_blockingPool(make_unique<BlockingPool>(config.blockingThreads))
 {
+	if (m_config.bot.enabled())
+		m_bots = make_unique<BotEngine>(m_config.bot);
+
 	using placeholders::_1;
 	using placeholders::_2;
 
 	// Initialize Asio Transport
 	m_wsServer.init_asio();
-	m_wsServer.set_reuse_addr(true);
+
+	m_data.wsServer = &m_wsServer;
+
+#ifdef CYVASSE_TLS
+	if (!m_config.tls.enabled())
+		throw invalid_argument("built with --enable-tls, but tls.certificate isn't set");
+
+	m_tlsContext = tls::makeServerContext(m_config.tls);
+	m_wsServer.set_tls_init_handler([this](connection_hdl) { return m_tlsContext; });
+#else
+	if (m_config.tls.enabled())
+		throw invalid_argument("tls is configured, but the server was built without --enable-tls");
+#endif
+
+	Tracer::setSampleRate(m_config.traceSampleRate);
+
+	m_data.memory.setLimit(m_config.memoryBudget, m_config.memoryBudgetSoftLimit);
+
+	// one file per process, after a handoff both write for a while and
+	// the connection ids and times of one don't match the other's
+	if (!m_config.captureFile.empty())
+		m_capture = make_unique<CaptureWriter>(m_config.captureFile + "." + to_string(getpid()));
+
+	if (!m_config.archiveFile.empty())
+		m_archive = make_unique<MatchArchive>(m_config.archiveFile, m_config.archiveMaxSize);
 
 	// Register handler callback
+	m_wsServer.set_open_handler(bind(&CyvasseServer::onOpen, this, _1));
 	m_wsServer.set_message_handler(bind(&CyvasseServer::onMessage, this, _1, _2));
 	m_wsServer.set_close_handler(bind(&CyvasseServer::onClose, this, _1));
-	//m_wsServer.set_http_handler(bind(&CyvasseServer::onHttpRequest, this, _1));
+	m_wsServer.set_pong_timeout_handler(bind(&CyvasseServer::onPongTimeout, this, _1, _2));
+	m_wsServer.set_http_handler(bind(&CyvasseServer::onHttpRequest, this, _1));
 }
 
 CyvasseServer::~CyvasseServer()
 {
 	if (m_data.running)
 		stop();
+
+	// the callbacks can hold references into m_data, which goes before m_timers
+	m_timers.clear();
 }
 
-void CyvasseServer::run(uint16_t port, unsigned nWorkers)
+void CyvasseServer::run(unsigned nWorkers)
 {
 	// Start worker threads
 	assert(nWorkers != 0);
 	for (unsigned i = 0; i < nWorkers; i++)
 		m_workers.emplace(new Worker(*this, m_data));
 
-	// Listen on the specified port
-	m_wsServer.listen(port);
+	// Start the timer wheel
+	m_tickTimer = make_unique<lib::asio::steady_timer>(m_wsServer.get_io_service());
+	scheduleTick();
+	m_timers.add(chrono::seconds(1), [this] { sampleMemory(); });
+
+	// Remember where we were started from, the binary might be replaced later
+	m_exePath = handoff::executablePath();
+
+	// Take over the listening sockets of the previous server process if we
+	// were started by its handOff(), listen on the configured ones otherwise
+	int handoffSock = handoff::inheritedSocket();
+
+	vector<int> listenFds;
+	if (handoffSock == -1)
+	{
+		for (const auto& endpoint : m_config.listen)
+		{
+			try
+			{
+				listenFds.push_back(endpoint.isUnix()
+					? Listener::listenUnix(endpoint.path, endpoint.mode, endpoint.backlog)
+					: Listener::listenTCP(endpoint.port, endpoint.backlog));
+			}
+			catch (...)
+			{
+				for (int fd : listenFds)
+					::close(fd);
 
-	// Start the server accept loop
-	m_wsServer.start_accept();
+				throw;
+			}
+
+			LOG_INFO("listening", endpoint.isUnix() ? endpoint.path : to_string(endpoint.port));
+		}
+
+		handoff::writePidFile(getpid());
+		m_ownsPidFile = true;
+	}
+	else
+	{
+		listenFds = handoff::receiveFds(handoffSock);
+		if (listenFds.empty())
+			throw runtime_error("handoff: didn't receive any listening socket");
+	}
+
+	// Start the accept loops
+	for (int fd : listenFds)
+	{
+		m_listeners.push_back(make_unique<Listener>(m_wsServer, fd, m_config.ioUringAccept));
+		m_listeners.back()->start();
+	}
+
+	if (handoffSock != -1)
+	{
+		// if the old process gave up waiting, it is still accepting
+		// connections itself, so we must not run in parallel
+		bool ready = handoff::sendReady(handoffSock);
+		::close(handoffSock);
+
+		if (!ready)
+			throw runtime_error("handoff: the previous server process didn't wait for us");
+
+		// written by the previous process
+		m_ownsPidFile = true;
+	}
+
+	if (m_config.cluster.enabled())
+	{
+		m_cluster = make_unique<ClusterLink>(*this, m_data, m_timers, m_wsServer.get_io_service(), m_config.cluster);
+		m_cluster->start();
+	}
+
+	m_signals = make_unique<lib::asio::signal_set>(m_wsServer.get_io_service(), SIGUSR2);
+	waitForSignals();
 
 	// Start the ASIO io_service run loop
 	m_wsServer.run();
@@ -74,6 +199,97 @@ void CyvasseServer::stop()
 {
 	m_data.running = false;
 	m_data.jobCond.notify_all();
+
+	if (m_capture)
+		m_capture->flush();
+}
+
+void CyvasseServer::scheduleTick()
+{
+	m_tickTimer->expires_from_now(m_timers.getResolution());
+	m_tickTimer->async_wait([this](const lib::asio::error_code& ec) {
+		if (ec)
+			return;
+
+		{
+			// timer callbacks (flag falls, bot joins) often send to both players
+			SendBatch sendBatch(m_data);
+			m_timers.advance();
+		}
+
+		scheduleTick();
+	});
+}
+
+void CyvasseServer::sampleMemory()
+{
+	size_t gamesLists = 0;
+
+	for (GamesListID list : { RANDOM_GAMES, PUBLIC_GAMES })
+	{
+		lock_guard<mutex> lock(m_data.gameListsMtx[list]);
+		gamesLists += m_data.gameLists[list].getFootprint();
+	}
+
+	m_data.memory.set(MemoryBudget::GAMES_LISTS, gamesLists);
+
+	// data that is queued for sending, but not written to the socket yet
+	size_t sendBuffers = 0;
+
+	for (auto&& hdl : m_connections)
+	{
+		lib::error_code ec;
+		auto con = m_wsServer.get_con_from_hdl(hdl, ec);
+		if (!ec)
+			sendBuffers += con->get_buffered_amount();
+	}
+
+	m_data.memory.set(MemoryBudget::SEND_BUFFERS, sendBuffers);
+
+	m_timers.add(chrono::seconds(1), [this] { sampleMemory(); });
+}
+
+void CyvasseServer::checkLiveness(connection_hdl hdl)
+{
+	lib::error_code ec;
+	auto con = m_wsServer.get_con_from_hdl(hdl, ec);
+
+	if (ec || con->get_state() != session::state::open)
+		return;
+
+	con->livenessTimer = 0;
+
+	if (auto clientData = atomic_load(&con->clientData))
+	{
+		bool inLobby;
+
+		{
+			lock_guard<mutex> lock(m_data.gameListsMtx[RANDOM_GAMES]);
+			auto& randomGames = m_data.gameLists[RANDOM_GAMES].getEntries();
+			inLobby = randomGames.find(clientData->getMatchData().getMatch().getID()) != randomGames.end();
+		}
+
+		auto timeout = inLobby ? m_config.lobbyIdleTimeout : m_config.matchIdleTimeout;
+
+		if (timeout.count() != 0 && TimerWheel::Clock::now() - con->lastActivity > timeout)
+		{
+			if (inLobby)
+				m_data.counters.idleLobbyEvictions++;
+			else
+				m_data.counters.idleMatchEvictions++;
+
+			// onClose removes the lobby entry / match
+			m_wsServer.close(hdl, close::status::going_away, "idle timeout", ec);
+			return;
+		}
+	}
+
+	// the pong timeout handler takes care of half-open connections
+	m_wsServer.ping(hdl, "", ec);
+	if (ec)
+		return;
+
+	con->livenessTimer = m_timers.add(m_config.pingInterval, [=] { checkLiveness(hdl); });
 }
 
 void CyvasseServer::maintenanceMode()
@@ -81,33 +297,203 @@ void CyvasseServer::maintenanceMode()
 	m_data.maintenance = true;
 }
 
+void CyvasseServer::waitForSignals()
+{
+	m_signals->async_wait([this](const lib::asio::error_code& ec, int signal) {
+		if (ec)
+			return;
+
+		if (signal == SIGUSR2)
+			handOff();
+
+		waitForSignals();
+	});
+}
+
+void CyvasseServer::handOff()
+{
+	if (m_handedOff || m_handoffPending)
+		return;
+
+	vector<int> listenFds;
+	for (auto&& listener : m_listeners)
+		listenFds.push_back(listener->getNativeHandle());
+
+	m_handoffPending = true;
+
+	// the new process can take a while until it listens, wait for it
+	// on the blocking pool so the I/O thread keeps serving connections
+	auto exePath = m_exePath;
+	m_blockingPool->post([this, exePath, listenFds] {
+		pid_t pid;
+		int sock = handoff::spawnSuccessor(exePath, pid);
+		if (sock == -1)
+			LOG_ERROR("handoff: couldn't start the new server process", exePath);
+
+		bool success = sock != -1 && handoff::sendFds(sock, listenFds) && handoff::waitReady(sock, chrono::seconds(30));
+		if (sock != -1)
+			::close(sock);
+
+		if (success)
+		{
+			// before the file is written, so stopping now doesn't remove it
+			m_ownsPidFile = false;
+			handoff::writePidFile(pid);
+		}
+
+		m_wsServer.get_io_service().post([this, success] { handOffDone(success); });
+	});
+}
+
+void CyvasseServer::handOffDone(bool success)
+{
+	m_handoffPending = false;
+
+	if (!success)
+	{
+		LOG_ERROR("handoff: the new server process didn't take over, continuing");
+		return;
+	}
+
+	m_handedOff = true;
+
+	// the new process accepts all connections from now on
+	for (auto&& listener : m_listeners)
+		listener->close();
+
+	maintenanceMode();
+
+	// clients that aren't in a running match are waiting for something that
+	// can only happen in the new process now (their lobby / their opponent
+	// joining), so let them reconnect right away
+	for (auto&& hdl : decltype(m_connections)(m_connections))
+	{
+		auto clientData = m_data.getClientData(hdl);
+
+		bool inMatch = false;
+		if (clientData)
+		{
+			auto& matchData = clientData->getMatchData();
+
+			lock_guard<mutex> lock(matchData.getClientDataSetsMtx());
+			inMatch = matchData.getClientDataSets().size() >= 2;
+		}
+
+		if (!inMatch)
+		{
+			lib::error_code ec;
+			m_wsServer.close(hdl, close::status::going_away, "server restart", ec);
+		}
+	}
+
+	m_drainDeadline = TimerWheel::Clock::now() + m_config.handoffDrainTimeout;
+	m_timers.add(chrono::seconds(1), [this] { checkDrained(); });
+}
+
+void CyvasseServer::checkDrained()
+{
+	auto now = TimerWheel::Clock::now();
+
+	// give the close handshakes after the deadline a few seconds
+	if (m_connections.empty() || now > m_drainDeadline + chrono::seconds(5))
+	{
+		stop();
+		m_wsServer.stop();
+		return;
+	}
+
+	if (now > m_drainDeadline)
+	{
+		for (auto&& hdl : decltype(m_connections)(m_connections))
+		{
+			lib::error_code ec;
+			m_wsServer.close(hdl, close::status::going_away, "server restart", ec);
+		}
+	}
+
+	m_timers.add(chrono::seconds(1), [this] { checkDrained(); });
+}
+
 void CyvasseServer::listUpdated(GamesListID list)
 {
-	if (!m_data.listSubscribers[list].empty())
+	// the snapshot is taken while holding the subscribers lock, so
+	// concurrent updates can't reach a subscriber out of order
+	lock_guard<mutex> subscribersLock(m_data.listSubscribersMtx[list]);
+	vector<GamesListSubscribers::ViewUpdate> viewUpdates;
+
 	{
-		string listName;
+		lock_guard<mutex> gameListLock(m_data.gameListsMtx[list]);
 
-		if (list == RANDOM_GAMES)
-			listName = GamesList::OPEN_RANDOM_GAMES;
-		else if (list == PUBLIC_GAMES)
-			listName = GamesList::RUNNING_PUBLIC_GAMES;
+		// taken even without subscribers, they would pile up otherwise
+		auto changes = m_data.gameLists[list].takeChanges();
+		viewUpdates = m_data.listSubscribers[list].update(m_data.gameLists[list], changes);
+	}
 
-		assert(!listName.empty());
+	for (const auto& viewUpdate : viewUpdates)
+	{
+		for (auto&& hdl : *viewUpdate.subscribers)
+			send(hdl, *viewUpdate.listUpdate);
 
-		auto jsonStr = Json::FastWriter().write(json::listUpdate(listName, m_data.gameLists[list]));
-		for (auto&& hdl : m_data.listSubscribers[list])
-			send(hdl, jsonStr);
+		m_data.counters.listUpdatesSent += viewUpdate.subscribers->size();
 	}
 }
 
-void CyvasseServer::unsubscribe(connection_hdl hdl, GamesListID list)
+void CyvasseServer::lobbyEntryUpdated(const string& matchID, const string& title, cyvasse::PlayersColor color, const string& ruleSet)
+{
+	if (m_cluster)
+		m_cluster->publishLobbyEntry(matchID, title, color, ruleSet);
+}
+
+void CyvasseServer::lobbyEntryRemoved(const string& matchID)
 {
-	auto it = m_data.listSubscribers[list].find(hdl);
-	if (it != m_data.listSubscribers[list].end())
+	if (m_cluster)
+		m_cluster->publishLobbyRemoval(matchID);
+}
+
+void CyvasseServer::onFlagFall(uint32_t matchID, uint64_t turn)
+{
+	shared_ptr<MatchData> matchData;
+
+	{
+		lock_guard<mutex> lock(m_data.matchDataMtx);
+		matchData = m_data.matchData.find(matchID);
+	}
+
+	if (!matchData)
+		return;
+
+	lock_guard<mutex> clientDataSetsLock(matchData->getClientDataSetsMtx());
+	string msg;
+
 	{
-		lock_guard<mutex> lock(m_data.listSubscribersMtx[list]);
-		m_data.listSubscribers[list].erase(it);
+		lock_guard<mutex> matchLock(matchData->getMatchMtx());
+
+		auto clock = matchData->getClock();
+
+		// the player could have moved while we were waiting for the lock
+		if (!clock || matchData->isFinished() || !clock->hasFlagFallen(turn))
+			return;
+
+		auto loser = clock->getToMove();
+
+		clock->stop();
+		matchData->setFinished();
+
+		auto& history = matchData->getHistory();
+		history.result = MatchResult::TIMEOUT;
+		history.winner = MatchHistory::colorIndex(!loser);
+
+		msg = Json::FastWriter().write(ClockJson::flagFall(*clock, loser));
 	}
+
+	for (auto& clientData : matchData->getClientDataSets())
+		send(clientData->getConnHdl(), msg);
+}
+
+void CyvasseServer::unsubscribe(connection_hdl hdl, GamesListID list)
+{
+	lock_guard<mutex> lock(m_data.listSubscribersMtx[list]);
+	m_data.listSubscribers[list].unsubscribe(hdl);
 }
 
 void CyvasseServer::unsubscribeAll(connection_hdl hdl)
@@ -116,93 +502,416 @@ void CyvasseServer::unsubscribeAll(connection_hdl hdl)
 	unsubscribe(hdl, PUBLIC_GAMES);
 }
 
+void CyvasseServer::onOpen(connection_hdl hdl)
+{
+	auto con = m_wsServer.get_con_from_hdl(hdl);
+
+	m_connections.insert(hdl);
+	m_data.memory.add(MemoryBudget::CONNECTIONS, connectionFootprint);
+
+	con->connID = m_data.nextConnID++;
+
+	if (m_capture)
+		m_capture->write(CaptureRecordType::OPEN, con->connID);
+
+	con->lastActivity = TimerWheel::Clock::now();
+	con->set_pong_timeout(m_config.pongTimeout.count());
+	con->livenessTimer = m_timers.add(m_config.pingInterval, [=] { checkLiveness(hdl); });
+}
+
 void CyvasseServer::onMessage(connection_hdl hdl, WSServer::message_ptr msg)
 {
-	// Queue message up for sending by processing thread
-	lock_guard<mutex> lock(m_data.jobMtx);
+	lib::error_code ec;
+	auto con = m_wsServer.get_con_from_hdl(hdl, ec);
+	if (ec)
+		return;
+
+	con->lastActivity = TimerWheel::Clock::now();
+
+	if (m_capture)
+		m_capture->write(CaptureRecordType::RECEIVED, con->connID, msg->get_payload());
 
-	m_data.jobQueue.emplace(hdl, msg);
-	m_data.jobCond.notify_one();
+	auto traceID = Tracer::sample();
+	if (traceID)
+		Tracer::record(traceID, TraceStage::RECEIVED);
+
+	// Queue message up for sending by processing thread
+	m_data.queueJob(*con, Job(hdl, msg, traceID));
 }
 
 void CyvasseServer::onClose(connection_hdl hdl)
 {
+	{
+		lib::error_code ec;
+		auto con = m_wsServer.get_con_from_hdl(hdl, ec);
+		if (!ec && con->livenessTimer)
+			m_timers.cancel(con->livenessTimer);
+
+		if (!ec && m_capture)
+			m_capture->write(CaptureRecordType::CLOSE, con->connID);
+
+		// a worker that pairs this client now fails to claim it
+		if (!ec)
+		{
+			if (auto ticket = con->matchmakingTicket.exchange(0))
+				m_data.matchmaking.remove(ticket);
+		}
+	}
+
+	m_connections.erase(hdl);
+	m_data.memory.sub(MemoryBudget::CONNECTIONS, connectionFootprint);
+
 	unsubscribeAll(hdl);
 
-	shared_ptr<ClientData> clientData = m_data.getClientData(hdl);
+	shared_ptr<ClientData> clientData = m_data.takeClientData(hdl);
 
 	if (!clientData)
 		return;
 
+	auto& matchData = clientData->getMatchData();
+	bool matchEmpty;
+
 	{
-		lock_guard<mutex> lock(m_data.clientDataMtx);
-		m_data.clientData.erase(m_data.clientData.find(hdl));
-	}
+		lock_guard<mutex> lock(matchData.getClientDataSetsMtx());
+		auto& dataSets = matchData.getClientDataSets();
 
-	auto& dataSets = clientData->getMatchData().getClientDataSets();
+		dataSets.erase(clientData);
 
-	{
-		auto it = dataSets.find(clientData);
-		if (it != dataSets.end())
-			dataSets.erase(it);
-	}
+		for (auto&& it : dataSets)
+			send(it->getConnHdl(), json::userLeft(clientData->getUsername()));
+
+		// a bot doesn't keep the match alive on its own
+		if (dataSets.size() == 1 && *dataSets.begin() == matchData.getBot())
+			dataSets.clear();
+
+		matchEmpty = dataSets.empty();
+
+		if (m_archive)
+		{
+			// the client data is gone once the match is removed, remember the names now
+			lock_guard<mutex> matchLock(matchData.getMatchMtx());
+			auto& history = matchData.getHistory();
 
-	for (auto&& it : dataSets)
-		send(it->getConnHdl(), json::userLeft(clientData->username));
+			history.usernames[MatchHistory::colorIndex(clientData->getPlayer().getColor())] = clientData->getUsername();
+
+			if (matchEmpty && matchData.getBot())
+			{
+				const auto& bot = matchData.getBot();
+				history.usernames[MatchHistory::colorIndex(bot->getPlayer().getColor())] = bot->getUsername();
+			}
+		}
+	}
 
 	// if this was the last / only player connected
 	// to this match, remove the match completely
-	if (dataSets.empty())
+	if (matchEmpty)
 	{
 		auto matchID = clientData->getMatchData().getMatch().getID();
 
+		if (m_archive)
+			archiveMatch(matchData);
+
 		{
 			lock_guard<mutex> lock(m_data.matchDataMtx);
-
-			auto it = m_data.matchData.find(matchID);
-			if (it != m_data.matchData.end())
-				m_data.matchData.erase(it);
+			m_data.matchData.erase(clientData->getMatchData().getID());
 
 			updateMatchCount();
 		}
 
 		for (GamesListID list : { RANDOM_GAMES, PUBLIC_GAMES })
 		{
-			auto it = m_data.gameLists[list].find(matchID);
-			if (it != m_data.gameLists[list].end())
+			bool removed;
+
 			{
-				{
-					lock_guard<mutex> lock(m_data.gameListsMtx[list]);
-					m_data.gameLists[list].erase(it);
-				}
+				lock_guard<mutex> lock(m_data.gameListsMtx[list]);
+				removed = m_data.gameLists[list].erase(matchID);
+			}
 
+			if (removed)
+			{
 				listUpdated(list);
+
+				if (list == RANDOM_GAMES)
+					lobbyEntryRemoved(matchID);
 			}
 		}
 
-		/*thread([=] {
-			this_thread::sleep_for(milliseconds(50));
+		/*m_blockingPool->post([=] {
 			cyvdb::MatchManager().removeMatch(matchID);
-		}).detach();*/
+		});*/
 	}
 }
 
-void CyvasseServer::onHttpRequest(connection_hdl)
+void CyvasseServer::archiveMatch(MatchData& matchData)
 {
-	// TODO: send 301 moved permanently -> domain:80
+	MatchHistory history;
+
+	{
+		lock_guard<mutex> lock(matchData.getMatchMtx());
+
+		// nothing worth keeping if the setup wasn't done
+		if (!matchData.getHistory().started)
+			return;
+
+		history = std::move(matchData.getHistory());
+	}
+
+	auto finishTime = chrono::duration_cast<chrono::seconds>(chrono::system_clock::now().time_since_epoch()).count();
+	auto matchID = matchData.getID();
+	auto& archive = *m_archive;
+
+	auto& data = m_data;
+
+	// the write blocks on the file lock and the disk, the result is counted
+	// on a worker once it's done
+	matchData.getStrand()->offload(*m_blockingPool, m_data,
+		[&archive, matchID, finishTime, history] {
+			return archive.append(matchID, finishTime, history);
+		},
+		[&data, matchID](Worker&, bool written) {
+			if (written)
+				data.counters.archivedMatches++;
+			else
+			{
+				data.counters.archiveFailures++;
+				LOG_WARNING("couldn't write a match to the archive", int24ToB64ID(matchID));
+			}
+		}
+	);
+}
+
+bool CyvasseServer::archiveQuery(const string& resource, Json::Value& result)
+{
+	static const string recent = "/archive/recent";
+	static const string player = "/archive/player/";
+	static const string match  = "/archive/match/";
+
+	if (resource == recent)
+	{
+		result = Json::Value(Json::arrayValue);
+		for (const auto& archived : m_archive->getRecent(archiveQueryLimit))
+			result.append(ArchiveJson::summary(archived));
+	}
+	else if (resource.compare(0, player.size(), player) == 0)
+	{
+		result = Json::Value(Json::arrayValue);
+		for (const auto& archived : m_archive->getByPlayer(resource.substr(player.size()), archiveQueryLimit))
+			result.append(ArchiveJson::summary(archived));
+	}
+	else if (resource.compare(0, match.size(), match) == 0)
+	{
+		uint32_t matchID;
+		MatchArchive::ArchivedMatch archived;
+
+		if (!b64IDToInt24(resource.substr(match.size()), matchID) || !m_archive->find(matchID, archived))
+			return false;
+
+		result = ArchiveJson::replay(archived);
+	}
+	else
+		return false;
+
+	return true;
+}
+
+void CyvasseServer::onPongTimeout(connection_hdl hdl, string)
+{
+	m_data.counters.pingTimeouts++;
+
+	lib::error_code ec;
+	m_wsServer.close(hdl, close::status::going_away, "ping timeout", ec);
+}
+
+bool CyvasseServer::isAdminRequest(const WSServer::connection_ptr& con) const
+{
+	const auto& token = m_config.adminToken;
+	if (token.empty())
+		return false;
+
+	const auto& header = con->get_request_header("Authorization");
+	static const string prefix = "Bearer ";
+
+	if (header.size() != prefix.size() + token.size() || header.compare(0, prefix.size(), prefix) != 0)
+		return false;
+
+	// don't tell how much of the token was right by the response time
+	unsigned char diff = 0;
+	for (size_t i = 0; i < token.size(); i++)
+		diff |= header[prefix.size() + i] ^ token[i];
+
+	return diff == 0;
+}
+
+void CyvasseServer::onHttpRequest(connection_hdl hdl)
+{
+	auto con = m_wsServer.get_con_from_hdl(hdl);
+	Json::Value archiveResult;
+
+	if (con->get_resource() == "/stats")
+	{
+		con->set_status(http::status_code::ok);
+		con->append_header("Content-Type", "application/json");
+		con->set_body(Json::StyledWriter().write(getStats()));
+	}
+	else if (con->get_resource() == "/trace" && isAdminRequest(con))
+	{
+		con->set_status(http::status_code::ok);
+		con->append_header("Content-Type", "application/json");
+		con->set_body(Tracer::dumpChromeTrace());
+	}
+	else if (m_archive && isAdminRequest(con) && archiveQuery(con->get_resource(), archiveResult))
+	{
+		con->set_status(http::status_code::ok);
+		con->append_header("Content-Type", "application/json");
+		con->set_body(Json::FastWriter().write(archiveResult));
+	}
+	else
+	{
+		// TODO: send 301 moved permanently -> domain:80
+		con->set_status(http::status_code::not_found);
+	}
+}
+
+Json::Value CyvasseServer::getStats()
+{
+	auto memoryStats = [](const MemoryPoolStats& poolStats) {
+		Json::Value ret;
+		ret["bytesReserved"] = Json::Value::UInt64(poolStats.bytesReserved);
+		ret["bytesInUse"]    = Json::Value::UInt64(poolStats.bytesInUse);
+		ret["allocations"]   = Json::Value::UInt64(poolStats.allocations);
+
+		return ret;
+	};
+
+	Json::Value stats;
+
+	stats["clients"] = Json::Value::UInt64(m_data.clientCount);
+
+	{
+		lock_guard<mutex> lock(m_data.matchDataMtx);
+		stats["matches"] = Json::Value::UInt64(m_data.matchData.size());
+	}
+
+	auto& evictions = stats["evictions"];
+	evictions["idleLobbyEntries"] = Json::Value::UInt64(m_data.counters.idleLobbyEvictions);
+	evictions["idleMatchClients"] = Json::Value::UInt64(m_data.counters.idleMatchEvictions);
+	evictions["pingTimeouts"]     = Json::Value::UInt64(m_data.counters.pingTimeouts);
+
+	stats["timers"] = Json::Value::UInt64(m_timers.size());
+
+	auto& async = stats["async"];
+	async["blockingQueued"] = Json::Value::UInt64(m_blockingPool->queued());
+
+	auto& matchmaking = stats["matchmaking"];
+	matchmaking["queued"] = Json::Value::UInt64(m_data.matchmaking.size());
+	matchmaking["pairs"]  = Json::Value::UInt64(m_data.counters.matchmakingPairs);
+
+	auto& gamesLists = stats["gamesLists"];
+	for (GamesListID list : { RANDOM_GAMES, PUBLIC_GAMES })
+	{
+		auto& listStats = gamesLists[m_data.gameLists[list].getName()];
+
+		{
+			lock_guard<mutex> lock(m_data.listSubscribersMtx[list]);
+			listStats["subscribers"] = Json::Value::UInt64(m_data.listSubscribers[list].size());
+			listStats["views"]       = Json::Value::UInt64(m_data.listSubscribers[list].getViewCount());
+		}
+
+		lock_guard<mutex> lock(m_data.gameListsMtx[list]);
+		listStats["entries"] = Json::Value::UInt64(m_data.gameLists[list].getEntries().size());
+	}
+	gamesLists["updatesSent"] = Json::Value::UInt64(m_data.counters.listUpdatesSent);
+
+	auto& sends = stats["sends"];
+	sends["frames"]          = Json::Value::UInt64(m_data.counters.framesSent);
+	sends["writes"]          = Json::Value::UInt64(m_data.counters.writes);
+	sends["coalescedWrites"] = Json::Value::UInt64(m_data.counters.coalescedWrites);
+
+	auto& memory = stats["memory"];
+	memory["objectPool"]  = memoryStats(SizeClassPool::instance().getStats());
+	memory["matchArenas"] = memoryStats(MatchArena::globalStats());
+
+	{
+		auto& budget = memory["budget"];
+		auto& mem = m_data.memory;
+
+		budget["limit"]       = Json::Value::UInt64(mem.getLimit());
+		budget["used"]        = Json::Value::UInt64(mem.total());
+		budget["matches"]     = Json::Value::UInt64(mem.get(MemoryBudget::MATCHES));
+		budget["connections"] = Json::Value::UInt64(mem.get(MemoryBudget::CONNECTIONS));
+		budget["gamesLists"]  = Json::Value::UInt64(mem.get(MemoryBudget::GAMES_LISTS));
+		budget["sendBuffers"] = Json::Value::UInt64(mem.get(MemoryBudget::SEND_BUFFERS));
+		budget["refusedMatches"] = Json::Value::UInt64(m_data.counters.memoryRefusals);
+
+		budget["bytesPerConnection"] = Json::Value::UInt64(connectionFootprint);
+
+		auto nMatches = stats["matches"].asUInt64();
+		budget["bytesPerMatch"] = Json::Value::UInt64(nMatches ? mem.get(MemoryBudget::MATCHES) / nMatches : 0);
+	}
+
+	if (m_bots)
+	{
+		auto& bots = stats["bots"];
+		const auto& botStats = m_bots->getStats();
+
+		bots["searches"] = Json::Value::UInt64(botStats.searches);
+		bots["nodes"]    = Json::Value::UInt64(botStats.nodes);
+		bots["averageDepth"] = botStats.searches ? double(botStats.depthSum) / botStats.searches : 0.0;
+
+		bots["threads"]     = Json::Value::UInt64(m_bots->getPool().size());
+		bots["queuedTasks"] = Json::Value::UInt64(m_bots->getPool().queued());
+		bots["tasks"]       = Json::Value::UInt64(m_bots->getPool().getExecuted());
+		bots["stolenTasks"] = Json::Value::UInt64(m_bots->getPool().getStolen());
+		bots["hashBytes"]   = Json::Value::UInt64(m_bots->getTranspositionTable().getBytes());
+	}
+
+	if (m_archive)
+	{
+		auto& archive = stats["archive"];
+		archive["matches"]  = Json::Value::UInt64(m_archive->size());
+		archive["bytes"]    = Json::Value::UInt64(m_archive->getBytes());
+		archive["maxBytes"] = Json::Value::UInt64(m_archive->getMaxSize());
+		archive["written"]  = Json::Value::UInt64(m_data.counters.archivedMatches);
+		archive["failed"]   = Json::Value::UInt64(m_data.counters.archiveFailures);
+	}
+
+#ifdef CYVASSE_TLS
+	{
+		auto ctx = m_tlsContext->native_handle();
+		auto& tlsStats = stats["tls"];
+
+		tlsStats["handshakes"]       = Json::Value::Int64(SSL_CTX_sess_accept_good(ctx));
+		tlsStats["failedHandshakes"] = Json::Value::Int64(SSL_CTX_sess_accept(ctx) - SSL_CTX_sess_accept_good(ctx));
+		tlsStats["resumedSessions"]  = Json::Value::Int64(SSL_CTX_sess_hits(ctx));
+		tlsStats["cachedSessions"]   = Json::Value::Int64(SSL_CTX_sess_number(ctx));
+	}
+#endif
+
+	stats["logRecordsDropped"] = Json::Value::UInt64(Logger::dropped());
+
+	return stats;
+}
+
+uint64_t CyvasseServer::connID(connection_hdl hdl)
+{
+	auto con = m_data.getConnection(hdl);
+	return con ? con->connID : 0;
 }
 
 void CyvasseServer::send(connection_hdl hdl, const string& data)
 {
-	// sending can fail, but that's not a good reason to crash!
-	// maybe we should log when this happens, but for now it's
-	// only important that it doesn't kill the whole server.
-	try
+	if (m_capture)
+		m_capture->write(CaptureRecordType::SENT, connID(hdl), data);
+
+	// held back until the end of the job or tick if there is a SendBatch,
+	// which records TraceStage::SENT when it hands the frames to websocketpp
+	if (!SendBatch::add(hdl, data))
 	{
-		m_wsServer.send(hdl, data, frame::opcode::text);
+		SendBatch::send(m_data, hdl, data);
+
+		if (auto traceID = Tracer::current())
+			Tracer::record(traceID, TraceStage::SENT);
 	}
-	catch(std::exception& e)
-	{ }
 }
 
 void CyvasseServer::send(connection_hdl hdl, const Json::Value& data)
@@ -210,8 +919,6 @@ void CyvasseServer::send(connection_hdl hdl, const Json::Value& data)
 	send(hdl, Json::FastWriter().write(data));
 }
 
-#include <fstream>
-
 void CyvasseServer::updateMatchCount()
 {
 	ofstream os("match_count");
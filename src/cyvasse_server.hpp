@@ -17,41 +17,166 @@
 #ifndef _CYVASSE_SERVER_HPP_
 #define _CYVASSE_SERVER_HPP_
 
+#include <atomic>
 #include <memory>
 #include <set>
+#include <string>
+#include <vector>
+#include <cyvasse/player.hpp>
+#include "server_config.hpp"
 #include "shared_server_data.hpp"
+#include "timer_wheel.hpp"
+
+#ifdef CYVASSE_TLS
+#include "tls.hpp"
+#endif
 
 namespace Json { class Value; }
+class BlockingPool;
+class BotEngine;
+class CaptureWriter;
+class ClusterLink;
+class Listener;
+class MatchArchive;
+class MatchData;
 class Worker;
 
 class CyvasseServer
 {
 	private:
+		const ServerConfig m_config;
+
 		WSServer m_wsServer;
 
+		// all timers of the server, m_tickTimer drives it from the I/O thread.
+		// Before m_data, the game clocks of the matches cancel their timers
+		TimerWheel m_timers;
+		std::unique_ptr<websocketpp::lib::asio::steady_timer> m_tickTimer;
+
 		SharedServerData m_data;
 
 		std::set<std::unique_ptr<Worker>> m_workers;
 
+		// only set if archiveFile is set, before m_blockingPool which writes to it
+		std::unique_ptr<MatchArchive> m_archive;
+
+		// after m_data, so it is joined before m_data goes
+		std::unique_ptr<BlockingPool> m_blockingPool;
+
+		// only set if bots are enabled, after m_data for the same reason
+		std::unique_ptr<BotEngine> m_bots;
+
+		std::vector<std::unique_ptr<Listener>> m_listeners;
+
+		// only accessed from the I/O thread
+		std::set<websocketpp::connection_hdl, std::owner_less<websocketpp::connection_hdl>> m_connections;
+
+		std::unique_ptr<websocketpp::lib::asio::signal_set> m_signals;
+
+#ifdef CYVASSE_TLS
+		// shared by all connections, so it holds the session cache
+		tls::ContextPtr m_tlsContext;
+#endif
+
+		std::unique_ptr<ClusterLink> m_cluster;
+
+		// records all traffic for cyvasse-replay if captureFile is set
+		std::unique_ptr<CaptureWriter> m_capture;
+
+		std::string m_exePath;
+
+		// only accessed from the I/O thread
+		bool m_handedOff      = false;
+		bool m_handoffPending = false;
+		TimerWheel::Clock::time_point m_drainDeadline;
+
+		// see handoff::pidFileName
+		std::atomic<bool> m_ownsPidFile = {false};
+
+		void scheduleTick();
+
+		// updates the sampled categories of m_data.memory every second
+		void sampleMemory();
+
+		void checkLiveness(websocketpp::connection_hdl);
+		void waitForSignals();
+		// the rest of handOff(), on the I/O thread once the new process is ready or failed
+		void handOffDone(bool success);
+		void checkDrained();
+
+		uint64_t connID(websocketpp::connection_hdl);
+
+		// the request carries adminToken, always false if it isn't set
+		bool isAdminRequest(const WSServer::connection_ptr&) const;
+
+		// at most this many matches are returned by the archive queries
+		static constexpr size_t archiveQueryLimit = 50;
+
+		// called before the match is removed, appends it on the blocking pool
+		void archiveMatch(MatchData&);
+
+		// /archive/recent, /archive/player/<playerID>, /archive/match/<matchID>.
+		// Returns false if the resource isn't one of them or nothing was found.
+		bool archiveQuery(const std::string& resource, Json::Value& result);
+
 	public:
-		CyvasseServer();
+		CyvasseServer(const ServerConfig&);
 		~CyvasseServer();
 
-		void run(uint16_t port, unsigned nWorkers);
+		// listens on the sockets of getConfig().listen
+		void run(unsigned nWorkers);
 		void stop();
 
 		void maintenanceMode();
 
+		// Start the binary we were started from (a new build, usually) and pass
+		// the listening sockets to it. Afterwards this process only serves the
+		// matches that are still running and exits when they are finished or
+		// handoffDrainTimeout has passed. Triggered by SIGUSR2.
+		void handOff();
+
+		// false after a handoff, the pid file names the new process then
+		bool ownsPidFile() const
+		{ return m_ownsPidFile; }
+
+		const ServerConfig& getConfig() const
+		{ return m_config; }
+
+		BlockingPool& getBlockingPool()
+		{ return *m_blockingPool; }
+
+		// nullptr if bots are disabled
+		BotEngine* getBots()
+		{ return m_bots.get(); }
+
+		// thread-safe, the callbacks run on the I/O thread
+		TimerWheel& getTimers()
+		{ return m_timers; }
+
 		void listUpdated(GamesListID);
 
+		// tell the other cluster nodes about changes to our own random games
+		// list entries, doesn't do anything if cluster mode is disabled
+		void lobbyEntryUpdated(const std::string& matchID, const std::string& title, cyvasse::PlayersColor, const std::string& ruleSet);
+		void lobbyEntryRemoved(const std::string& matchID);
+
+		// GameClock callback, ends the match if the
+		// clock of the player to move in turn ran out
+		void onFlagFall(uint32_t matchID, uint64_t turn);
+
 		void unsubscribe(websocketpp::connection_hdl, GamesListID);
 		void unsubscribeAll(websocketpp::connection_hdl);
 
+		void onOpen(websocketpp::connection_hdl);
 		void onMessage(websocketpp::connection_hdl, WSServer::message_ptr);
 		void onClose(websocketpp::connection_hdl);
+		void onPongTimeout(websocketpp::connection_hdl, std::string);
 
 		void onHttpRequest(websocketpp::connection_hdl);
 
+		// served as /stats by the http handler
+		Json::Value getStats();
+
 		void send(websocketpp::connection_hdl, const std::string&);
 		void send(websocketpp::connection_hdl, const Json::Value&);
 
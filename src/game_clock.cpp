@@ -0,0 +1,169 @@
+/* Copyright 2015 Jonas Platte
+ *
+ * This file is part of Cyvasse Online.
+ *
+ * Cyvasse Online is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Affero General Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later version.
+ *
+ * Cyvasse Online is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE. See the GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License along with this program.
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "game_clock.hpp"
+
+#include <json/value.h>
+#include <cyvws/msg.hpp>
+#include <cyvws/notification.hpp>
+#include "protocol_ext.hpp"
+
+using namespace cyvasse;
+using namespace cyvws;
+
+using namespace std;
+using namespace std::chrono;
+
+// the longest time controls the server accepts
+static constexpr seconds maxBase      = hours(24);
+static constexpr seconds maxIncrement = hours(1);
+
+GameClock::GameClock(TimerWheel& timers, const TimeControl& timeControl, FlagFallCallback onFlagFall)
+	: m_timers(timers)
+	, m_timeControl(timeControl)
+	, m_onFlagFall(move(onFlagFall))
+	, m_remaining{{timeControl.base, timeControl.base}}
+{ }
+
+GameClock::~GameClock()
+{
+	if (m_running)
+		m_timers.cancel(m_flagTimer);
+}
+
+void GameClock::startTurn(PlayersColor color, Clock::time_point now)
+{
+	m_toMove    = color;
+	m_turnStart = now;
+	m_turn++;
+
+	// the wheel rounds up, so this never fires before the time is used up
+	auto turn = m_turn;
+	auto onFlagFall = m_onFlagFall;
+	m_flagTimer = m_timers.add(m_remaining[colorIndex(color)], [turn, onFlagFall] { onFlagFall(turn); });
+}
+
+void GameClock::start(PlayersColor toMove, Clock::time_point now)
+{
+	if (m_running)
+		return;
+
+	m_running = true;
+	startTurn(toMove, now);
+}
+
+void GameClock::stop(Clock::time_point now)
+{
+	if (!m_running)
+		return;
+
+	m_timers.cancel(m_flagTimer);
+	m_remaining[colorIndex(m_toMove)] -= now - m_turnStart;
+	m_running = false;
+}
+
+bool GameClock::moved(PlayersColor color, Clock::time_point now)
+{
+	if (!m_running || color != m_toMove)
+		return false;
+
+	auto& remaining = m_remaining[colorIndex(color)];
+	auto left = remaining - (now - m_turnStart);
+	if (left <= Clock::duration::zero())
+		return false;
+
+	m_timers.cancel(m_flagTimer);
+	remaining = left + m_timeControl.increment;
+
+	startTurn(!color, now);
+	return true;
+}
+
+auto GameClock::getRemaining(PlayersColor color, Clock::time_point now) const -> Clock::duration
+{
+	auto remaining = m_remaining[colorIndex(color)];
+	if (m_running && color == m_toMove)
+		remaining -= now - m_turnStart;
+
+	return remaining;
+}
+
+bool GameClock::hasFlagFallen(uint64_t turn, Clock::time_point now) const
+{
+	return m_running && turn == m_turn && getRemaining(m_toMove, now) <= Clock::duration::zero();
+}
+
+namespace ClockJson
+{
+	bool parseTimeControl(const Json::Value& value, TimeControl& timeControl)
+	{
+		using namespace TimeControlExt;
+
+		if (!value.isObject() || !value[BASE].isUInt() || !(value[INCREMENT].isNull() || value[INCREMENT].isUInt()))
+			return false;
+
+		seconds base(value[BASE].asUInt());
+		seconds increment(value[INCREMENT].asUInt());
+
+		if (base == seconds::zero() || base > maxBase || increment > maxIncrement)
+			return false;
+
+		timeControl.base = base;
+		timeControl.increment = increment;
+		return true;
+	}
+
+	Json::Value timeControl(const TimeControl& timeControl)
+	{
+		Json::Value ret;
+		ret[TimeControlExt::BASE]      = Json::UInt(duration_cast<seconds>(timeControl.base).count());
+		ret[TimeControlExt::INCREMENT] = Json::UInt(duration_cast<seconds>(timeControl.increment).count());
+
+		return ret;
+	}
+
+	Json::Value clockStatus(const GameClock& clock)
+	{
+		auto now = GameClock::Clock::now();
+		auto msLeft = [&](PlayersColor color) {
+			auto ms = duration_cast<milliseconds>(clock.getRemaining(color, now)).count();
+			return Json::Int64(ms > 0 ? ms : 0);
+		};
+
+		Json::Value ret;
+		ret[ClockStatusExt::WHITE] = msLeft(PlayersColor::WHITE);
+		ret[ClockStatusExt::BLACK] = msLeft(PlayersColor::BLACK);
+
+		if (clock.isRunning())
+			ret[ClockStatusExt::TO_MOVE] = PlayersColorToStr(clock.getToMove());
+
+		return ret;
+	}
+
+	Json::Value flagFall(const GameClock& clock, PlayersColor loser)
+	{
+		Json::Value msg;
+		msg[MSG_TYPE] = MsgType::NOTIFICATION;
+
+		auto& data = msg[NOTIFICATION_DATA];
+		data[NotificationExt::TYPE]   = NotificationExt::GAME_ENDED;
+		data[NotificationExt::REASON] = NotificationExt::TIMEOUT;
+		data[NotificationExt::WINNER] = PlayersColorToStr(!loser);
+		data[NotificationExt::CLOCKS] = clockStatus(clock);
+
+		return msg;
+	}
+}
@@ -0,0 +1,118 @@
+/* Copyright 2015 Jonas Platte
+ *
+ * This file is part of Cyvasse Online.
+ *
+ * Cyvasse Online is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Affero General Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later version.
+ *
+ * Cyvasse Online is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE. See the GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License along with this program.
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _GAME_CLOCK_HPP_
+#define _GAME_CLOCK_HPP_
+
+#include <array>
+#include <chrono>
+#include <functional>
+#include <cstdint>
+#include <cyvasse/player.hpp>
+#include "timer_wheel.hpp"
+
+namespace Json { class Value; }
+
+struct TimeControl
+{
+	std::chrono::milliseconds base;
+	std::chrono::milliseconds increment;
+};
+
+// Chess clock of a match. Only the clock of the player to move runs, moving
+// stops it, adds the increment and starts the opponent's. A timer in the
+// server's TimerWheel fires when the running clock reaches zero.
+// Not thread-safe, guard with MatchData::getMatchMtx().
+class GameClock
+{
+	public:
+		typedef TimerWheel::Clock Clock;
+
+		// Invoked from the I/O thread with the turn the time ran out in. The
+		// player can have moved just before the callback got the match mutex,
+		// check hasFlagFallen() with that turn.
+		typedef std::function<void(uint64_t turn)> FlagFallCallback;
+
+	private:
+		TimerWheel& m_timers;
+
+		const TimeControl m_timeControl;
+		const FlagFallCallback m_onFlagFall;
+
+		// indexed by colorIndex(), the time used in the current turn isn't subtracted yet
+		std::array<Clock::duration, 2> m_remaining;
+
+		cyvasse::PlayersColor m_toMove = cyvasse::PlayersColor::WHITE;
+		Clock::time_point m_turnStart;
+		uint64_t m_turn = 0;
+		bool m_running  = false;
+
+		TimerWheel::TimerID m_flagTimer = 0;
+
+		static size_t colorIndex(cyvasse::PlayersColor color)
+		{ return color == cyvasse::PlayersColor::WHITE ? 0 : 1; }
+
+		void startTurn(cyvasse::PlayersColor, Clock::time_point now);
+
+	public:
+		GameClock(TimerWheel&, const TimeControl&, FlagFallCallback);
+		~GameClock();
+
+		GameClock(const GameClock&) = delete;
+		GameClock& operator=(const GameClock&) = delete;
+
+		const TimeControl& getTimeControl() const
+		{ return m_timeControl; }
+
+		bool isRunning() const
+		{ return m_running; }
+
+		cyvasse::PlayersColor getToMove() const
+		{ return m_toMove; }
+
+		uint64_t getTurn() const
+		{ return m_turn; }
+
+		void start(cyvasse::PlayersColor toMove, Clock::time_point now = Clock::now());
+		void stop(Clock::time_point now = Clock::now());
+
+		// Ends the turn of color. Returns false without changing anything if it
+		// isn't color's turn or its time has run out already; in the latter
+		// case the flag fall callback takes care of ending the game.
+		bool moved(cyvasse::PlayersColor color, Clock::time_point now = Clock::now());
+
+		// can be negative after the flag fell
+		Clock::duration getRemaining(cyvasse::PlayersColor, Clock::time_point now = Clock::now()) const;
+
+		bool hasFlagFallen(uint64_t turn, Clock::time_point now = Clock::now()) const;
+};
+
+// TODO: move to cyvws (as part of cyvws::json), see protocol_ext.hpp
+namespace ClockJson
+{
+	// {"base": seconds, "increment": seconds}, returns false if the
+	// values are missing or outside of what the server supports
+	bool parseTimeControl(const Json::Value&, TimeControl&);
+	Json::Value timeControl(const TimeControl&);
+
+	// {"white": ms, "black": ms, "toMove": color}
+	Json::Value clockStatus(const GameClock&);
+
+	// notification sent to both players when loser's flag fell
+	Json::Value flagFall(const GameClock&, cyvasse::PlayersColor loser);
+}
+
+#endif // _GAME_CLOCK_HPP_
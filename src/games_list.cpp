@@ -0,0 +1,333 @@
+/* Copyright 2015 Jonas Platte
+ *
+ * This file is part of Cyvasse Online.
+ *
+ * Cyvasse Online is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Affero General Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later version.
+ *
+ * Cyvasse Online is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE. See the GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License along with this program.
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "games_list.hpp"
+
+#include <algorithm>
+#include <json/writer.h>
+#include <cyvws/json_notification.hpp>
+#include <cyvws/msg.hpp>
+#include "protocol_ext.hpp"
+
+using namespace std;
+using namespace cyvasse;
+using namespace cyvws;
+
+constexpr size_t GamesListView::maxCount;
+
+string CachedGamesList::getRuleSet(const string& matchID) const
+{
+	auto it = m_ruleSets.find(matchID);
+	return it != m_ruleSets.end() ? it->second : string();
+}
+
+void CachedGamesList::addToIndexes(const string& matchID, const GamesListMappedType& entry, const string& ruleSet)
+{
+	m_byRuleSet[ruleSet].insert(matchID);
+	m_byColor[colorIndex(entry.color)].insert(matchID);
+	m_byTitle.emplace(entry.title, matchID);
+}
+
+void CachedGamesList::removeFromIndexes(const string& matchID, const GamesListMappedType& entry, const string& ruleSet)
+{
+	auto it = m_byRuleSet.find(ruleSet);
+	if (it != m_byRuleSet.end())
+	{
+		it->second.erase(matchID);
+		if (it->second.empty())
+			m_byRuleSet.erase(it);
+	}
+
+	m_byColor[colorIndex(entry.color)].erase(matchID);
+	m_byTitle.erase(make_pair(entry.title, matchID));
+}
+
+void CachedGamesList::changing(const string& matchID)
+{
+	m_version++;
+
+	auto it = m_entries.find(matchID);
+	if (it == m_entries.end())
+		m_changes.push_back({matchID, false, GamesListMappedType(), string()});
+	else
+		m_changes.push_back({matchID, true, it->second, m_ruleSets[matchID]});
+}
+
+void CachedGamesList::insert(const string& matchID, GamesListMappedType entry, const string& ruleSet)
+{
+	changing(matchID);
+
+	auto it = m_entries.find(matchID);
+	if (it != m_entries.end())
+	{
+		removeFromIndexes(matchID, it->second, m_ruleSets[matchID]);
+		it->second = move(entry);
+	}
+	else
+		it = m_entries.emplace(matchID, move(entry)).first;
+
+	m_ruleSets[matchID] = ruleSet;
+	addToIndexes(matchID, it->second, ruleSet);
+}
+
+bool CachedGamesList::erase(const string& matchID)
+{
+	auto it = m_entries.find(matchID);
+	if (it == m_entries.end())
+		return false;
+
+	changing(matchID);
+
+	auto ruleSetIt = m_ruleSets.find(matchID);
+	removeFromIndexes(matchID, it->second, ruleSetIt->second);
+
+	m_ruleSets.erase(ruleSetIt);
+	m_entries.erase(it);
+
+	return true;
+}
+
+bool CachedGamesList::setTitle(const string& matchID, const string& title)
+{
+	auto it = m_entries.find(matchID);
+	if (it == m_entries.end())
+		return false;
+
+	changing(matchID);
+
+	m_byTitle.erase(make_pair(it->second.title, matchID));
+	it->second.title = title;
+	m_byTitle.emplace(title, matchID);
+
+	return true;
+}
+
+vector<CachedGamesList::Change> CachedGamesList::takeChanges()
+{
+	vector<Change> ret;
+	ret.swap(m_changes);
+
+	return ret;
+}
+
+vector<CachedGamesList::EntryIt> CachedGamesList::getSlice(const GamesListView& view) const
+{
+	vector<EntryIt> ret;
+
+	// the entry after the view is included
+	size_t end = view.count ? view.offset + view.count + 1 : SIZE_MAX;
+	size_t pos = 0;
+
+	auto add = [&](EntryIt it) {
+		if (pos++ >= view.offset)
+			ret.push_back(it);
+
+		return pos < end;
+	};
+
+	auto matches = [&](EntryIt it) {
+		return view.matches(it->second, m_ruleSets.find(it->first)->second);
+	};
+
+	// start from the most selective index
+	if (!view.titlePrefix.empty())
+	{
+		// title order, has to be sorted by match id first
+		vector<EntryIt> candidates;
+
+		for (auto it = m_byTitle.lower_bound(make_pair(view.titlePrefix, string()));
+			it != m_byTitle.end() && it->first.compare(0, view.titlePrefix.size(), view.titlePrefix) == 0; ++it)
+		{
+			auto entryIt = m_entries.find(it->second);
+			if (matches(entryIt))
+				candidates.push_back(entryIt);
+		}
+
+		sort(candidates.begin(), candidates.end(), [](EntryIt a, EntryIt b) { return a->first < b->first; });
+
+		for (auto it : candidates)
+			if (!add(it))
+				break;
+	}
+	else if (!view.ruleSet.empty() || view.color != PlayersColor::UNDEFINED)
+	{
+		const set<string>* matchIDs;
+
+		if (view.ruleSet.empty())
+			matchIDs = &m_byColor[colorIndex(view.color)];
+		else
+		{
+			auto it = m_byRuleSet.find(view.ruleSet);
+			if (it == m_byRuleSet.end())
+				return ret;
+
+			matchIDs = &it->second;
+		}
+
+		for (const auto& matchID : *matchIDs)
+		{
+			auto entryIt = m_entries.find(matchID);
+			if (matches(entryIt) && !add(entryIt))
+				break;
+		}
+	}
+	else
+	{
+		for (auto it = m_entries.begin(); it != m_entries.end(); ++it)
+			if (!add(it))
+				break;
+	}
+
+	return ret;
+}
+
+shared_ptr<const string> CachedGamesList::getListUpdate() const
+{
+	if (!m_listUpdate || m_listUpdateVersion != m_version)
+	{
+		m_listUpdate = make_shared<const string>(Json::FastWriter().write(json::listUpdate(m_name, m_entries)));
+		m_listUpdateVersion = m_version;
+	}
+
+	return m_listUpdate;
+}
+
+shared_ptr<const string> CachedGamesList::getListUpdate(const GamesListView& view, string& boundary) const
+{
+	boundary.clear();
+
+	if (view.isWholeList())
+		return getListUpdate();
+
+	auto slice = getSlice(view);
+
+	if (view.count && slice.size() > view.count)
+	{
+		boundary = slice.back()->first;
+		slice.pop_back();
+	}
+
+	GamesListMap entries;
+	for (auto it : slice)
+		entries.emplace_hint(entries.end(), *it);
+
+	auto msg = json::listUpdate(m_name, entries);
+	msg[NOTIFICATION_DATA][ListUpdateExt::OFFSET] = Json::UInt64(view.offset);
+	msg[NOTIFICATION_DATA][ListUpdateExt::MORE]   = !boundary.empty();
+
+	return make_shared<const string>(Json::FastWriter().write(msg));
+}
+
+size_t CachedGamesList::getFootprint() const
+{
+	// std::map / std::set nodes have three pointers and a color besides the value
+	const size_t nodeSize = 4 * sizeof(void*);
+
+	size_t ret = m_entries.size() * (sizeof(GamesListMap::value_type) + nodeSize);
+
+	for (const auto& entry : m_entries)
+		ret += entry.first.capacity() + entry.second.title.capacity();
+
+	// the rule sets and the indexes hold four more copies of the match id and one of the title
+	ret += m_entries.size() * 5 * (sizeof(string) + nodeSize);
+
+	if (m_listUpdate)
+		ret += m_listUpdate->capacity();
+
+	return ret;
+}
+
+void GamesListSubscribers::refresh(const GamesListView& view, ViewState& state, const CachedGamesList& list)
+{
+	state.listUpdate = list.getListUpdate(view, state.boundary);
+}
+
+shared_ptr<const string> GamesListSubscribers::subscribe(websocketpp::connection_hdl hdl, const GamesListView& view, const CachedGamesList& list)
+{
+	unsubscribe(hdl);
+
+	auto it = m_views.find(view);
+	if (it == m_views.end())
+	{
+		it = m_views.emplace(view, ViewState()).first;
+		refresh(view, it->second, list);
+	}
+
+	it->second.subscribers.insert(hdl);
+	m_subscriptions.emplace(hdl, it);
+
+	// an empty page is still sent, the client asked for it
+	if (view.isWholeList() && list.getEntries().empty())
+		return nullptr;
+
+	return it->second.listUpdate;
+}
+
+bool GamesListSubscribers::unsubscribe(websocketpp::connection_hdl hdl)
+{
+	auto it = m_subscriptions.find(hdl);
+	if (it == m_subscriptions.end())
+		return false;
+
+	auto viewIt = it->second;
+	viewIt->second.subscribers.erase(hdl);
+
+	if (viewIt->second.subscribers.empty())
+		m_views.erase(viewIt);
+
+	m_subscriptions.erase(it);
+	return true;
+}
+
+vector<GamesListSubscribers::ViewUpdate> GamesListSubscribers::update(const CachedGamesList& list, const vector<CachedGamesList::Change>& changes)
+{
+	vector<ViewUpdate> ret;
+
+	for (auto& viewIt : m_views)
+	{
+		const auto& view = viewIt.first;
+		auto& state = viewIt.second;
+
+		bool affected = false;
+		for (const auto& change : changes)
+		{
+			// behind the first entry after the page
+			if (!state.boundary.empty() && change.matchID > state.boundary)
+				continue;
+
+			if (change.existed && view.matches(change.entry, change.ruleSet))
+				affected = true;
+			else
+			{
+				auto it = list.getEntries().find(change.matchID);
+				affected = it != list.getEntries().end() && view.matches(it->second, list.getRuleSet(change.matchID));
+			}
+
+			if (affected)
+				break;
+		}
+
+		if (!affected)
+			continue;
+
+		auto old = state.listUpdate;
+		refresh(view, state, list);
+
+		if (!old || *old != *state.listUpdate)
+			ret.push_back({&state.subscribers, state.listUpdate});
+	}
+
+	return ret;
+}
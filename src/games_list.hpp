@@ -0,0 +1,213 @@
+/* Copyright 2015 Jonas Platte
+ *
+ * This file is part of Cyvasse Online.
+ *
+ * Cyvasse Online is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Affero General Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later version.
+ *
+ * Cyvasse Online is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE. See the GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License along with this program.
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef _GAMES_LIST_HPP_
+#define _GAMES_LIST_HPP_
+
+#include <array>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+#include <cstdint>
+#include <cyvasse/player.hpp>
+#include <cyvws/notification.hpp>
+#include <websocketpp/common/connection_hdl.hpp>
+
+// The part of a games list a subscriber is looking at: the entries that match
+// the filter, in match id order, starting at offset. count = 0 means all of
+// them, that's what clients that don't send a view get.
+struct GamesListView
+{
+	static constexpr size_t maxCount = 100;
+
+	// empty = any
+	std::string ruleSet;
+	// the color the joining player gets, UNDEFINED = any
+	cyvasse::PlayersColor color = cyvasse::PlayersColor::UNDEFINED;
+	// empty = any
+	std::string titlePrefix;
+
+	size_t offset = 0;
+	size_t count  = 0;
+
+	bool hasFilter() const
+	{ return !ruleSet.empty() || color != cyvasse::PlayersColor::UNDEFINED || !titlePrefix.empty(); }
+
+	bool isWholeList() const
+	{ return !hasFilter() && offset == 0 && count == 0; }
+
+	bool matches(const cyvws::GamesListMappedType& entry, const std::string& entryRuleSet) const
+	{
+		return (ruleSet.empty() || entryRuleSet == ruleSet)
+			&& (color == cyvasse::PlayersColor::UNDEFINED || entry.color == color)
+			&& entry.title.compare(0, titlePrefix.size(), titlePrefix) == 0;
+	}
+
+	bool operator<(const GamesListView& other) const
+	{
+		return std::tie(ruleSet, color, titlePrefix, offset, count)
+			< std::tie(other.ruleSet, other.color, other.titlePrefix, other.offset, other.count);
+	}
+};
+
+// A games list together with its listUpdate notification, serialized once
+// per version instead of once per subscribe / broadcast. Every change has to
+// go through insert(), erase() or setTitle(), they keep the indexes that
+// views are evaluated with up to date and remember the changed entries for
+// GamesListSubscribers::update().
+// Not thread-safe, guard with SharedServerData::gameListsMtx.
+class CachedGamesList
+{
+	public:
+		typedef cyvws::GamesListMap::const_iterator EntryIt;
+
+		// an entry as it was before a change, see takeChanges()
+		struct Change
+		{
+			std::string matchID;
+			bool existed; // false for new entries
+			cyvws::GamesListMappedType entry;
+			std::string ruleSet;
+		};
+
+	private:
+		const char* const m_name; // as used in the protocol
+
+		cyvws::GamesListMap m_entries;
+		std::map<std::string, std::string> m_ruleSets; // by match id
+
+		// indexes over the entries for the filters of GamesListView
+		std::map<std::string, std::set<std::string>> m_byRuleSet;
+		std::array<std::set<std::string>, 2> m_byColor; // white, black
+		std::set<std::pair<std::string, std::string>> m_byTitle; // (title, match id)
+
+		std::vector<Change> m_changes;
+		uint64_t m_version = 0;
+
+		mutable std::shared_ptr<const std::string> m_listUpdate;
+		mutable uint64_t m_listUpdateVersion = 0;
+
+		static size_t colorIndex(cyvasse::PlayersColor color)
+		{ return color == cyvasse::PlayersColor::WHITE ? 0 : 1; }
+
+		void addToIndexes(const std::string& matchID, const cyvws::GamesListMappedType&, const std::string& ruleSet);
+		void removeFromIndexes(const std::string& matchID, const cyvws::GamesListMappedType&, const std::string& ruleSet);
+
+		// records the entry before it's changed
+		void changing(const std::string& matchID);
+
+	public:
+		explicit CachedGamesList(const char* name)
+			: m_name(name)
+		{ }
+
+		const char* getName() const
+		{ return m_name; }
+
+		const cyvws::GamesListMap& getEntries() const
+		{ return m_entries; }
+
+		// empty if there is no such entry
+		std::string getRuleSet(const std::string& matchID) const;
+
+		// replaces the entry if there already is one
+		void insert(const std::string& matchID, cyvws::GamesListMappedType entry, const std::string& ruleSet);
+		// both return false if there is no such entry
+		bool erase(const std::string& matchID);
+		bool setTitle(const std::string& matchID, const std::string& title);
+
+		uint64_t getVersion() const
+		{ return m_version; }
+
+		// the changes since the last call, in order
+		std::vector<Change> takeChanges();
+
+		// Entries in the view, plus the first one after it (if there is
+		// one) so the caller can tell whether there is another page.
+		std::vector<EntryIt> getSlice(const GamesListView&) const;
+
+		// can still be used after the lock was released
+		std::shared_ptr<const std::string> getListUpdate() const;
+		// listUpdate with only the entries of the view (and its offset and
+		// whether there are more), not cached. Sets boundary to the match id
+		// of the first entry after the view, to an empty string if there's none.
+		std::shared_ptr<const std::string> getListUpdate(const GamesListView&, std::string& boundary) const;
+
+		// rough number of bytes used by the entries, the indexes and
+		// the cached listUpdate, see MemoryBudget
+		size_t getFootprint() const;
+};
+
+// The subscribers of one games list, grouped by the view they subscribed
+// with, so a change is evaluated and serialized once per distinct view.
+// A change only reaches the views whose slice it could change: the entry
+// has to match the filter (before or after the change) and must not come
+// after the first entry behind the page.
+// Not thread-safe, guard with SharedServerData::listSubscribersMtx.
+class GamesListSubscribers
+{
+	public:
+		typedef std::set<websocketpp::connection_hdl, std::owner_less<websocketpp::connection_hdl>> ConnectionSet;
+
+		struct ViewUpdate
+		{
+			const ConnectionSet* subscribers;
+			std::shared_ptr<const std::string> listUpdate;
+		};
+
+	private:
+		struct ViewState
+		{
+			ConnectionSet subscribers;
+
+			// the last listUpdate the subscribers got
+			std::shared_ptr<const std::string> listUpdate;
+			// see CachedGamesList::getListUpdate(const GamesListView&, std::string&)
+			std::string boundary;
+		};
+
+		typedef std::map<GamesListView, ViewState> ViewMap;
+
+		ViewMap m_views;
+		std::map<websocketpp::connection_hdl, ViewMap::iterator, std::owner_less<websocketpp::connection_hdl>> m_subscriptions;
+
+		static void refresh(const GamesListView&, ViewState&, const CachedGamesList&);
+
+	public:
+		// replaces an earlier subscription of the connection. Returns the listUpdate
+		// to send to it, empty for a whole list subscription of an empty list.
+		std::shared_ptr<const std::string> subscribe(websocketpp::connection_hdl, const GamesListView&, const CachedGamesList&);
+		// returns false if the connection wasn't subscribed
+		bool unsubscribe(websocketpp::connection_hdl);
+
+		bool empty() const
+		{ return m_subscriptions.empty(); }
+
+		size_t size() const
+		{ return m_subscriptions.size(); }
+
+		size_t getViewCount() const
+		{ return m_views.size(); }
+
+		// returns the views whose listUpdate changed, the pointers to
+		// the subscribers are only valid until the lock is released
+		std::vector<ViewUpdate> update(const CachedGamesList&, const std::vector<CachedGamesList::Change>&);
+};
+
+#endif // _GAMES_LIST_HPP_
@@ -0,0 +1,204 @@
+/* Copyright 2015 Jonas Platte
+ *
+ * This file is part of Cyvasse Online.
+ *
+ * Cyvasse Online is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Affero General Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later version.
+ *
+ * Cyvasse Online is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE. See the GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License along with this program.
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "handoff.hpp"
+
+#include <fstream>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using namespace std;
+
+extern char** environ;
+
+namespace handoff
+{
+	// more than we will ever listen on
+	constexpr size_t maxFds = 16;
+
+	string executablePath()
+	{
+		char buf[4096];
+
+		auto len = readlink("/proc/self/exe", buf, sizeof(buf) - 1);
+		if (len <= 0)
+			return {};
+
+		buf[len] = '\0';
+		return buf;
+	}
+
+	int spawnSuccessor(const string& exePath, pid_t& pid)
+	{
+		if (exePath.empty())
+			return -1;
+
+		int socks[2];
+		if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, socks) == -1)
+			return -1;
+
+		// everything the child needs is prepared before fork(),
+		// between fork() and exec() only async-signal-safe calls are allowed
+		string envVar = string(envVarName) + "=" + to_string(socks[1]);
+
+		vector<char*> envp;
+		for (char** it = environ; *it; ++it)
+			if (strncmp(*it, envVarName, strlen(envVarName)) != 0)
+				envp.push_back(*it);
+
+		envp.push_back(&envVar[0]);
+		envp.push_back(nullptr);
+
+		char* argv[] = { const_cast<char*>(exePath.c_str()), nullptr };
+
+		auto maxFd = sysconf(_SC_OPEN_MAX);
+
+		pid = fork();
+		if (pid == -1)
+		{
+			close(socks[0]);
+			close(socks[1]);
+			return -1;
+		}
+
+		if (pid == 0)
+		{
+			// don't leak client connections into the new process,
+			// they have to close when the old one is done with them
+			for (int fd = 3; fd < maxFd; fd++)
+				if (fd != socks[1])
+					close(fd);
+
+			fcntl(socks[1], F_SETFD, 0);
+			execve(argv[0], argv, envp.data());
+			_exit(127);
+		}
+
+		close(socks[1]);
+		return socks[0];
+	}
+
+	int inheritedSocket()
+	{
+		const char* val = getenv(envVarName);
+		if (!val)
+			return -1;
+
+		int sock = atoi(val);
+		unsetenv(envVarName);
+
+		fcntl(sock, F_SETFD, FD_CLOEXEC);
+		return sock;
+	}
+
+	bool sendFds(int sock, const vector<int>& fds)
+	{
+		if (fds.empty() || fds.size() > maxFds)
+			return false;
+
+		char cmsgBuf[CMSG_SPACE(sizeof(int) * maxFds)] = {};
+
+		uint8_t nFds = fds.size();
+		iovec iov { &nFds, 1 };
+
+		msghdr msg {};
+		msg.msg_iov        = &iov;
+		msg.msg_iovlen     = 1;
+		msg.msg_control    = cmsgBuf;
+		msg.msg_controllen = CMSG_SPACE(sizeof(int) * fds.size());
+
+		auto cmsg = CMSG_FIRSTHDR(&msg);
+		cmsg->cmsg_level = SOL_SOCKET;
+		cmsg->cmsg_type  = SCM_RIGHTS;
+		cmsg->cmsg_len   = CMSG_LEN(sizeof(int) * fds.size());
+		memcpy(CMSG_DATA(cmsg), fds.data(), sizeof(int) * fds.size());
+
+		return sendmsg(sock, &msg, MSG_NOSIGNAL) == 1;
+	}
+
+	vector<int> receiveFds(int sock)
+	{
+		char cmsgBuf[CMSG_SPACE(sizeof(int) * maxFds)] = {};
+
+		uint8_t nFds = 0;
+		iovec iov { &nFds, 1 };
+
+		msghdr msg {};
+		msg.msg_iov        = &iov;
+		msg.msg_iovlen     = 1;
+		msg.msg_control    = cmsgBuf;
+		msg.msg_controllen = sizeof(cmsgBuf);
+
+		if (recvmsg(sock, &msg, MSG_CMSG_CLOEXEC) != 1)
+			return {};
+
+		vector<int> fds;
+
+		for (auto cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg))
+		{
+			if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS)
+				continue;
+
+			size_t n = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+			fds.resize(n);
+			memcpy(fds.data(), CMSG_DATA(cmsg), sizeof(int) * n);
+		}
+
+		if (fds.size() != nFds)
+		{
+			for (int fd : fds)
+				close(fd);
+
+			return {};
+		}
+
+		return fds;
+	}
+
+	bool sendReady(int sock)
+	{
+		char c = 'R';
+		return send(sock, &c, 1, MSG_NOSIGNAL) == 1;
+	}
+
+	bool waitReady(int sock, chrono::milliseconds timeout)
+	{
+		pollfd pfd { sock, POLLIN, 0 };
+		if (poll(&pfd, 1, timeout.count()) != 1)
+			return false;
+
+		char c;
+		return recv(sock, &c, 1, 0) == 1 && c == 'R';
+	}
+
+	void writePidFile(pid_t pid)
+	{
+		ofstream pidFile(pidFileName);
+		if (pidFile)
+			pidFile << pid << endl;
+	}
+
+	void removePidFile()
+	{
+		remove(pidFileName);
+	}
+}
@@ -0,0 +1,58 @@
+/* Copyright 2015 Jonas Platte
+ *
+ * This file is part of Cyvasse Online.
+ *
+ * Cyvasse Online is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Affero General Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later version.
+ *
+ * Cyvasse Online is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE. See the GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License along with this program.
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _HANDOFF_HPP_
+#define _HANDOFF_HPP_
+
+#include <chrono>
+#include <string>
+#include <vector>
+#include <sys/types.h>
+
+// Passing the listening sockets from a running server process to a freshly
+// started one (the binary at the same path, usually a new build) over a unix
+// socket, see CyvasseServer::handOff
+namespace handoff
+{
+	// set in the environment of the new process, the value is its end of the unix socket
+	constexpr const char* envVarName = "CYVASSE_HANDOFF_FD";
+
+	// has to be called before the binary is replaced on disk
+	std::string executablePath();
+
+	// fork + exec exePath, returns our end of the unix socket or -1
+	int spawnSuccessor(const std::string& exePath, pid_t& pid);
+
+	// in the new process: the socket from envVarName or -1 if we weren't started by handoff
+	int inheritedSocket();
+
+	bool sendFds(int sock, const std::vector<int>& fds);
+	std::vector<int> receiveFds(int sock);
+
+	// the new process signals that it is accepting connections
+	bool sendReady(int sock);
+	bool waitReady(int sock, std::chrono::milliseconds timeout);
+
+	// The pid file names the process that accepts new connections. It is
+	// written once we listen, after a handoff by the previous process as
+	// soon as the new one is ready, so a failed handoff doesn't touch it.
+	constexpr const char* pidFileName = "cyvasse-server.pid";
+
+	void writePidFile(pid_t);
+	void removePidFile();
+}
+
+#endif // _HANDOFF_HPP_
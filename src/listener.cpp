@@ -0,0 +1,328 @@
+/* Copyright 2015 Jonas Platte
+ *
+ * This file is part of Cyvasse Online.
+ *
+ * Cyvasse Online is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Affero General Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later version.
+ *
+ * Cyvasse Online is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE. See the GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License along with this program.
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "listener.hpp"
+
+#include <system_error>
+#include <cerrno>
+#include <cstring>
+
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "logger.hpp"
+#include "uring.hpp"
+
+using namespace std;
+using namespace websocketpp;
+
+// missing from kernel headers older than 5.19, the kernel's
+// answer to it is checked at runtime (see handleCompletions)
+#ifndef IORING_ACCEPT_MULTISHOT
+#define IORING_ACCEPT_MULTISHOT (1U << 0)
+#endif
+
+// user_data of the io_uring requests
+static constexpr uint64_t acceptTag = 1;
+static constexpr uint64_t cancelTag = 2;
+
+Listener::Listener(WSServer& wsServer, int fd, bool useIoUring)
+	: m_wsServer(wsServer)
+	, m_acceptor(wsServer.get_io_service())
+	, m_useIoUring(useIoUring)
+{
+	// the protocol is only used for the accepted sockets
+	m_acceptor.assign(lib::asio::ip::tcp::v6(), fd);
+}
+
+// defined here because IoUring is incomplete in the header
+Listener::~Listener() = default;
+
+void Listener::start()
+{
+	if (!m_useIoUring || !startUringAccept())
+		startAccept();
+}
+
+void Listener::close()
+{
+	if (m_ring)
+	{
+		// the multishot accept holds a reference to the socket, it would keep
+		// accepting even after it is closed. Sockets accepted before the
+		// cancellation are still handed to websocketpp. Without a free sqe
+		// for the cancel, closing the ring below cancels it as well.
+		if (m_uringAcceptArmed)
+		{
+			if (auto sqe = m_ring->getSqe())
+			{
+				sqe->opcode    = IORING_OP_ASYNC_CANCEL;
+				sqe->addr      = acceptTag;
+				sqe->user_data = cancelTag;
+
+				while (m_uringAcceptArmed && m_ring->submit(1) >= 0)
+					handleCompletions();
+			}
+		}
+
+		m_ringDesc.reset();
+		m_ring.reset();
+	}
+
+	lib::asio::error_code ec;
+	m_acceptor.close(ec);
+}
+
+int Listener::getNativeHandle()
+{
+	return m_acceptor.native_handle();
+}
+
+void Listener::startAccept()
+{
+	auto con = m_wsServer.get_connection();
+
+	m_acceptor.async_accept(con->get_raw_socket(), [this, con](const lib::asio::error_code& ec) {
+		if (ec)
+		{
+			// same as websocketpp's server::handle_accept
+			con->terminate(error::make_error_code(error::general));
+
+			if (ec == lib::asio::error::operation_aborted)
+				return;
+		}
+		else
+			con->start();
+
+		startAccept();
+	});
+}
+
+void Listener::startConnection(int fd)
+{
+	auto con = m_wsServer.get_connection();
+
+	lib::asio::error_code ec;
+	con->get_raw_socket().assign(lib::asio::ip::tcp::v6(), fd, ec);
+
+	if (ec)
+	{
+		::close(fd);
+		con->terminate(error::make_error_code(error::general));
+		return;
+	}
+
+	con->start();
+}
+
+bool Listener::startUringAccept()
+{
+	try
+	{
+		m_ring = make_unique<IoUring>(64);
+	}
+	catch (system_error& e)
+	{
+		LOG_INFO("io_uring isn't available, accepting with asio", e.what());
+		return false;
+	}
+
+	if (!m_ring->supports(IORING_OP_ACCEPT) || !m_ring->supports(IORING_OP_ASYNC_CANCEL) || !submitUringAccept())
+	{
+		LOG_INFO("io_uring doesn't support accept, accepting with asio");
+		m_ring.reset();
+		return false;
+	}
+
+	// the descriptor closes its fd, the ring closes its own one
+	m_ringDesc = make_unique<lib::asio::posix::stream_descriptor>(m_wsServer.get_io_service(), dup(m_ring->getFd()));
+
+	waitForCompletions();
+	return true;
+}
+
+bool Listener::submitUringAccept()
+{
+	auto sqe = m_ring->getSqe();
+	if (!sqe)
+		return false;
+
+	sqe->opcode       = IORING_OP_ACCEPT;
+	sqe->fd           = m_acceptor.native_handle();
+	sqe->ioprio       = IORING_ACCEPT_MULTISHOT;
+	sqe->accept_flags = SOCK_CLOEXEC;
+	sqe->user_data    = acceptTag;
+
+	if (m_ring->submit() < 0)
+		return false;
+
+	m_uringAcceptArmed = true;
+	return true;
+}
+
+void Listener::waitForCompletions()
+{
+	m_ringDesc->async_wait(lib::asio::posix::stream_descriptor::wait_read, [this](const lib::asio::error_code& ec) {
+		if (ec)
+			return;
+
+		if (!handleCompletions())
+		{
+			LOG_INFO("io_uring doesn't support multishot accept, accepting with asio");
+
+			m_ringDesc.reset();
+			m_ring.reset();
+
+			startAccept();
+			return;
+		}
+
+		if (!m_uringAcceptArmed && !submitUringAccept())
+		{
+			LOG_ERROR("couldn't resubmit the io_uring accept, accepting with asio");
+
+			m_ringDesc.reset();
+			m_ring.reset();
+
+			startAccept();
+			return;
+		}
+
+		waitForCompletions();
+	});
+}
+
+bool Listener::handleCompletions()
+{
+	bool supported = true;
+
+	m_ring->forEachCompletion([&](const io_uring_cqe& cqe) {
+		if (cqe.user_data != acceptTag)
+			return;
+
+		// a multishot request ends when a completion comes without this
+		// flag (on errors, mostly), it has to be submitted again then
+		if (!(cqe.flags & IORING_CQE_F_MORE))
+			m_uringAcceptArmed = false;
+
+		if (cqe.res >= 0)
+		{
+			m_uringAccepted = true;
+			startConnection(cqe.res);
+		}
+		else if (cqe.res == -EINVAL && !m_uringAccepted)
+			supported = false; // older kernels don't know IORING_ACCEPT_MULTISHOT
+		else if (cqe.res != -ECANCELED)
+			LOG_WARNING("io_uring accept failed", strerror(-cqe.res));
+	});
+
+	return supported;
+}
+
+int Listener::listenTCP(uint16_t port, int backlog)
+{
+	int fd = socket(AF_INET6, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd == -1)
+		throw system_error(errno, system_category(), "socket");
+
+	auto fail = [fd](const char* what) {
+		int err = errno;
+		::close(fd);
+		throw system_error(err, system_category(), what);
+	};
+
+	int off = 0, on = 1;
+	if (setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, &off, sizeof(off)) == -1)
+		fail("setsockopt(IPV6_V6ONLY)");
+	if (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on)) == -1)
+		fail("setsockopt(SO_REUSEADDR)");
+
+	sockaddr_in6 addr {};
+	addr.sin6_family = AF_INET6;
+	addr.sin6_addr   = in6addr_any;
+	addr.sin6_port   = htons(port);
+
+	if (bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == -1)
+		fail("bind");
+	if (listen(fd, backlog ? backlog : SOMAXCONN) == -1)
+		fail("listen");
+
+	return fd;
+}
+
+int Listener::listenUnix(const string& path, unsigned mode, int backlog)
+{
+	sockaddr_un addr {};
+	addr.sun_family = AF_UNIX;
+
+	if (path.size() >= sizeof(addr.sun_path))
+		throw system_error(ENAMETOOLONG, system_category(), "unix socket path " + path);
+
+	memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+
+	int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd == -1)
+		throw system_error(errno, system_category(), "socket");
+
+	auto fail = [fd, &path](const char* what) {
+		int err = errno;
+		::close(fd);
+		throw system_error(err, system_category(), string(what) + " " + path);
+	};
+
+	// A socket file left behind by a previous run (they aren't removed, a process
+	// taking over through handoff still listens on it) is replaced, unless another
+	// server still accepts connections on it. Only a refused connection means
+	// nobody listens, other errors (no permission to connect, ...) are
+	// reported instead of removing the file.
+	struct stat st;
+	if (lstat(path.c_str(), &st) == 0 && S_ISSOCK(st.st_mode))
+	{
+		if (connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0)
+		{
+			errno = EADDRINUSE;
+			fail("bind");
+		}
+
+		if (errno != ECONNREFUSED)
+			fail("connect");
+
+		// the failed connect leaves the socket usable for bind
+		unlink(path.c_str());
+	}
+
+	if (bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == -1)
+		fail("bind");
+
+	// Connecting fails until listen() is called, so the permissions bind left
+	// (umask is process-wide, changing it would race with other threads) can be
+	// narrowed before anybody gets through. fchmod only reaches the socket inode,
+	// not the file in the filesystem.
+	if (chmod(path.c_str(), mode) == -1)
+	{
+		int err = errno;
+		unlink(path.c_str());
+		errno = err;
+		fail("chmod");
+	}
+
+	if (listen(fd, backlog ? backlog : SOMAXCONN) == -1)
+		fail("listen");
+
+	return fd;
+}
@@ -0,0 +1,81 @@
+/* Copyright 2015 Jonas Platte
+ *
+ * This file is part of Cyvasse Online.
+ *
+ * Cyvasse Online is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Affero General Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later version.
+ *
+ * Cyvasse Online is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE. See the GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License along with this program.
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _LISTENER_HPP_
+#define _LISTENER_HPP_
+
+#include <memory>
+#include <string>
+#include <cstdint>
+#include "shared_server_data.hpp"
+
+class IoUring;
+
+// Accept loop for a listening socket that was created outside of websocketpp,
+// either by listenTCP() / listenUnix() or by the previous server process (see handoff.hpp).
+// Accepted sockets are handed to websocketpp like its own acceptor would.
+// With useIoUring, a single multishot accept request on an io_uring replaces
+// the accept() call per connection, if the kernel supports that (5.19+).
+// Only accepting goes through the ring, websocketpp reads and writes the
+// accepted sockets with asio.
+class Listener
+{
+	private:
+		WSServer& m_wsServer;
+
+		websocketpp::lib::asio::ip::tcp::acceptor m_acceptor;
+
+		const bool m_useIoUring;
+
+		// the ring's fd is watched by asio, so its completions
+		// are handled on the I/O thread like any other event
+		std::unique_ptr<IoUring> m_ring;
+		std::unique_ptr<websocketpp::lib::asio::posix::stream_descriptor> m_ringDesc;
+		bool m_uringAccepted = false;
+		bool m_uringAcceptArmed = false;
+
+		void startAccept();
+		void startConnection(int fd);
+
+		bool startUringAccept();
+		bool submitUringAccept();
+		void waitForCompletions();
+		// returns false if multishot accept turned out to be unsupported
+		bool handleCompletions();
+
+	public:
+		// takes ownership of fd, which has to be a socket in listening state
+		Listener(WSServer&, int fd, bool useIoUring = false);
+		~Listener();
+
+		void start();
+		// stops accepting, the socket stays open in other processes that have it
+		void close();
+
+		int getNativeHandle();
+
+		bool usesIoUring() const
+		{ return m_ring != nullptr; }
+
+		// Create a socket listening on a dual-stack TCP port or a unix domain
+		// socket at path, throw std::system_error. A backlog of 0 means SOMAXCONN.
+		// Sockets accepted from a unix domain socket are handed to websocketpp
+		// as TCP sockets, that works since it only reads and writes them.
+		static int listenTCP(uint16_t port, int backlog = 0);
+		static int listenUnix(const std::string& path, unsigned mode, int backlog = 0);
+};
+
+#endif // _LISTENER_HPP_
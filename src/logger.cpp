@@ -0,0 +1,314 @@
+/* Copyright 2015 Jonas Platte
+ *
+ * This file is part of Cyvasse Online.
+ *
+ * Cyvasse Online is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Affero General Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later version.
+ *
+ * Cyvasse Online is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE. See the GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License along with this program.
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "logger.hpp"
+
+#include <array>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#include <cstring>
+#include <ctime>
+
+#include "b64.hpp"
+
+using namespace std;
+using namespace std::chrono;
+
+namespace
+{
+	struct LogRecord
+	{
+		int64_t time; // system_clock, ns
+		uint64_t connID;
+		uint64_t suppressed;
+		uint32_t matchID;
+		LogLevel level;
+		const char* msg;
+
+		uint8_t detailLen;
+		char detail[111];
+	};
+
+	// Single producer / single consumer ring, the producer is the owning thread
+	class LogBuffer
+	{
+		public:
+			static constexpr size_t capacity = 4096;
+
+		private:
+			array<LogRecord, capacity> m_records;
+
+			atomic<uint64_t> m_head = {0}; // written by the producer
+			atomic<uint64_t> m_tail = {0}; // written by the consumer
+
+		public:
+			LogRecord* reserve()
+			{
+				auto head = m_head.load(memory_order_relaxed);
+				if (head - m_tail.load(memory_order_acquire) == capacity)
+					return nullptr;
+
+				return &m_records[head % capacity];
+			}
+
+			void commit()
+			{
+				m_head.store(m_head.load(memory_order_relaxed) + 1, memory_order_release);
+			}
+
+			template <typename Func>
+			void consume(Func&& func)
+			{
+				auto tail = m_tail.load(memory_order_relaxed);
+				auto head = m_head.load(memory_order_acquire);
+
+				for (; tail != head; tail++)
+					func(m_records[tail % capacity]);
+
+				m_tail.store(tail, memory_order_release);
+			}
+	};
+
+	atomic<LogLevel> minLevel = {LogLevel::INFO};
+	atomic<uint64_t> droppedRecords = {0};
+	uint64_t reportedDrops = 0; // sink thread only
+
+	// buffers live as long as the process, the server's threads do too
+	mutex buffersMtx;
+	vector<LogBuffer*> buffers;
+
+	ostream* out = &cerr;
+	ofstream outFile;
+
+	atomic<bool> sinkRunning = {false};
+	thread sinkThread;
+
+	thread_local LogBuffer* threadBuffer = nullptr;
+	thread_local uint64_t contextConnID = 0;
+	thread_local uint32_t contextMatchID = 0;
+
+	LogBuffer& getThreadBuffer()
+	{
+		if (!threadBuffer)
+		{
+			lock_guard<mutex> lock(buffersMtx);
+
+			threadBuffer = new LogBuffer;
+			buffers.push_back(threadBuffer);
+		}
+
+		return *threadBuffer;
+	}
+
+	const char* levelName(LogLevel level)
+	{
+		switch (level)
+		{
+			case LogLevel::DEBUG:   return "debug";
+			case LogLevel::INFO:    return "info";
+			case LogLevel::WARNING: return "warning";
+			case LogLevel::ERROR:   return "error";
+		}
+
+		return "unknown";
+	}
+
+	void writeQuoted(ostream& os, const char* str, size_t len)
+	{
+		os << '"';
+		for (size_t i = 0; i < len; i++)
+		{
+			if (str[i] == '"' || str[i] == '\\')
+				os << '\\' << str[i];
+			else if (str[i] == '\n')
+				os << "\\n";
+			else
+				os << str[i];
+		}
+		os << '"';
+	}
+
+	void format(ostream& os, const LogRecord& record)
+	{
+		time_t secs = record.time / 1000000000;
+		unsigned millis = (record.time / 1000000) % 1000;
+
+		tm utc;
+		gmtime_r(&secs, &utc);
+
+		char timeStr[32];
+		strftime(timeStr, sizeof(timeStr), "%Y-%m-%dT%H:%M:%S", &utc);
+
+		os << "time=" << timeStr << '.' << setw(3) << setfill('0') << millis << "Z"
+			<< " level=" << levelName(record.level);
+
+		if (record.connID)
+			os << " conn=" << record.connID;
+		if (record.matchID)
+			os << " match=" << int24ToB64ID(record.matchID);
+
+		os << " msg=";
+		writeQuoted(os, record.msg, strlen(record.msg));
+
+		if (record.detailLen)
+		{
+			os << " detail=";
+			writeQuoted(os, record.detail, record.detailLen);
+		}
+
+		if (record.suppressed)
+			os << " suppressed=" << record.suppressed;
+
+		os << '\n';
+	}
+
+	void flushBuffers()
+	{
+		lock_guard<mutex> lock(buffersMtx);
+
+		for (auto buffer : buffers)
+			buffer->consume([](const LogRecord& record) { format(*out, record); });
+
+		auto dropped = droppedRecords.load();
+		if (dropped != reportedDrops)
+		{
+			*out << "level=warning msg=\"log buffer full, records dropped\" dropped=" << dropped - reportedDrops << '\n';
+			reportedDrops = dropped;
+		}
+
+		out->flush();
+	}
+
+	void sinkLoop()
+	{
+		while (sinkRunning)
+		{
+			flushBuffers();
+			this_thread::sleep_for(milliseconds(10));
+		}
+
+		flushBuffers();
+	}
+}
+
+void Logger::start(LogLevel level, const string& fileName)
+{
+	minLevel = level;
+
+	if (!fileName.empty())
+	{
+		outFile.open(fileName, ios::app);
+		if (!outFile)
+			throw runtime_error("couldn't open log file " + fileName);
+
+		out = &outFile;
+	}
+
+	sinkRunning = true;
+	sinkThread = thread(sinkLoop);
+}
+
+void Logger::stop()
+{
+	if (!sinkRunning.exchange(false))
+		return;
+
+	sinkThread.join();
+}
+
+bool Logger::enabled(LogLevel level)
+{
+	return level >= minLevel.load(memory_order_relaxed);
+}
+
+void Logger::write(LogSite& site, const char* msg)
+{
+	write(site, msg, string());
+}
+
+void Logger::write(LogSite& site, const char* msg, const string& detail)
+{
+	auto now = system_clock::now().time_since_epoch();
+	auto second = duration_cast<seconds>(now).count();
+
+	// rate limiting, racy between threads but never by much
+	if (site.window.load(memory_order_relaxed) != second)
+	{
+		site.window.store(second, memory_order_relaxed);
+		site.count.store(0, memory_order_relaxed);
+	}
+
+	if (site.count.fetch_add(1, memory_order_relaxed) >= rateLimit)
+	{
+		site.suppressed.fetch_add(1, memory_order_relaxed);
+		return;
+	}
+
+	auto& buffer = getThreadBuffer();
+	auto record = buffer.reserve();
+
+	if (!record)
+	{
+		droppedRecords++;
+		return;
+	}
+
+	record->time       = duration_cast<nanoseconds>(now).count();
+	record->connID     = contextConnID;
+	record->matchID    = contextMatchID;
+	record->suppressed = site.suppressed.exchange(0, memory_order_relaxed);
+	record->level      = site.level;
+	record->msg        = msg;
+
+	record->detailLen  = min(detail.size(), sizeof(record->detail));
+	memcpy(record->detail, detail.data(), record->detailLen);
+
+	buffer.commit();
+}
+
+LogLevel Logger::parseLevel(const string& str)
+{
+	for (auto level : { LogLevel::DEBUG, LogLevel::INFO, LogLevel::WARNING, LogLevel::ERROR })
+		if (str == levelName(level))
+			return level;
+
+	throw invalid_argument("invalid log level \"" + str + "\"");
+}
+
+uint64_t Logger::dropped()
+{
+	return droppedRecords;
+}
+
+LogContext::LogContext(uint64_t connID, uint32_t matchID)
+	: m_prevConnID(contextConnID)
+	, m_prevMatchID(contextMatchID)
+{
+	contextConnID = connID;
+	contextMatchID = matchID;
+}
+
+LogContext::~LogContext()
+{
+	contextConnID = m_prevConnID;
+	contextMatchID = m_prevMatchID;
+}
@@ -0,0 +1,109 @@
+/* Copyright 2015 Jonas Platte
+ *
+ * This file is part of Cyvasse Online.
+ *
+ * Cyvasse Online is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Affero General Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later version.
+ *
+ * Cyvasse Online is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE. See the GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License along with this program.
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _LOGGER_HPP_
+#define _LOGGER_HPP_
+
+#include <atomic>
+#include <string>
+#include <cstdint>
+
+// Asynchronous structured logging. LOG() copies the message into a lock-free
+// buffer of the calling thread, a background thread formats the records as
+// logfmt lines (key=value) and writes them out, so logging never blocks a
+// worker on I/O. Every record carries the connection / match the thread is
+// currently handling (see LogContext). Each LOG() call site allows a burst of
+// Logger::rateLimit records per second, the rest is counted and reported
+// with the next record from that site.
+//
+// The message has to be a string literal, variable parts go into the detail.
+
+enum class LogLevel : uint8_t
+{
+	DEBUG,
+	INFO,
+	WARNING,
+	ERROR
+};
+
+// one per LOG() call site
+struct LogSite
+{
+	const LogLevel level;
+
+	std::atomic<int64_t> window     = {0}; // current second
+	std::atomic<uint32_t> count     = {0}; // records in that second
+	std::atomic<uint64_t> suppressed = {0};
+
+	explicit LogSite(LogLevel level_)
+		: level(level_)
+	{ }
+};
+
+class Logger
+{
+	public:
+		static constexpr unsigned rateLimit = 20;
+
+		// fileName empty = stderr
+		static void start(LogLevel minLevel, const std::string& fileName);
+		// writes out everything that is still buffered
+		static void stop();
+
+		static bool enabled(LogLevel level);
+
+		static void write(LogSite&, const char* msg);
+		static void write(LogSite&, const char* msg, const std::string& detail);
+
+		// throws std::invalid_argument
+		static LogLevel parseLevel(const std::string&);
+
+		static uint64_t dropped();
+};
+
+// Sets the context fields of all records the current thread logs while it exists
+class LogContext
+{
+	private:
+		uint64_t m_prevConnID;
+		uint32_t m_prevMatchID;
+
+	public:
+		// 0 = none, match IDs are the raw 24-bit ones
+		LogContext(uint64_t connID, uint32_t matchID);
+		~LogContext();
+
+		LogContext(const LogContext&) = delete;
+		LogContext& operator=(const LogContext&) = delete;
+};
+
+#define LOG(level, ...) \
+	do \
+	{ \
+		if (Logger::enabled(level)) \
+		{ \
+			static LogSite logSite_(level); \
+			Logger::write(logSite_, __VA_ARGS__); \
+		} \
+	} \
+	while (false)
+
+#define LOG_DEBUG(...)   LOG(LogLevel::DEBUG, __VA_ARGS__)
+#define LOG_INFO(...)    LOG(LogLevel::INFO, __VA_ARGS__)
+#define LOG_WARNING(...) LOG(LogLevel::WARNING, __VA_ARGS__)
+#define LOG_ERROR(...)   LOG(LogLevel::ERROR, __VA_ARGS__)
+
+#endif // _LOGGER_HPP_
@@ -25,14 +25,12 @@
 #include <yaml-cpp/yaml.h>
 //#include <cyvdb/config.hpp>
 #include "cyvasse_server.hpp"
+#include "handoff.hpp"
+#include "logger.hpp"
+#include "server_config.hpp"
 
 using namespace std;
 
-static constexpr const char* pidFileName = "cyvasse-server.pid";
-
-void createPidFile();
-void removePidFile();
-
 unique_ptr<CyvasseServer> server;
 
 void setupSignals();
@@ -42,7 +40,7 @@ int main()
 	setupSignals();
 
 	auto config = YAML::LoadFile("config.yml");
-	auto listenPort   = config["listenPort"].as<int>();
+	ServerConfig serverConfig(config);
 	/*auto matchDataUrl = config["matchDataUrl"].as<string>();
 
 	if(matchDataUrl.empty())
@@ -57,10 +55,9 @@ int main()
 
 	try
 	{
-		createPidFile();
-
-		server = make_unique<CyvasseServer>();
-		server->run(listenPort, 1);
+		Logger::start(Logger::parseLevel(serverConfig.logLevel), serverConfig.logFile);
+		server = make_unique<CyvasseServer>(serverConfig);
+		server->run(serverConfig.nWorkers);
 	}
 	catch (std::exception& e)
 	{
@@ -68,23 +65,11 @@ int main()
 		retVal = 1;
 	}
 
-	removePidFile();
-	return retVal;
-}
+	if (server && server->ownsPidFile())
+		handoff::removePidFile();
 
-void createPidFile()
-{
-	ofstream pidFile(pidFileName);
-	if (pidFile)
-	{
-		pidFile << getpid() << endl;
-		pidFile.close();
-	}
-}
-
-void removePidFile()
-{
-	remove(pidFileName);
+	Logger::stop();
+	return retVal;
 }
 
 extern "C"
@@ -94,11 +79,14 @@ extern "C"
 		if (server)
 		{
 			server->stop();
-			server.reset();
 
-			removePidFile();
+			if (server->ownsPidFile())
+				handoff::removePidFile();
+
+			server.reset();
 		}
 
+		Logger::stop();
 		exit(0);
 	}
 
@@ -0,0 +1,412 @@
+/* Copyright 2015 Jonas Platte
+ *
+ * This file is part of Cyvasse Online.
+ *
+ * Cyvasse Online is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Affero General Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later version.
+ *
+ * Cyvasse Online is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE. See the GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License along with this program.
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "match_archive.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+#include <system_error>
+#include <cerrno>
+#include <cstddef>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <json/value.h>
+#include <cyvasse/player.hpp>
+#include "b64.hpp"
+#include "protocol_ext.hpp"
+
+using namespace cyvasse;
+using namespace std;
+
+namespace
+{
+	constexpr char magic[8] = {'C', 'Y', 'V', 'A', 'R', 'C', 'H', '1'};
+
+	// the file is extended in steps of this size
+	constexpr size_t growSize = 1 << 20;
+
+	constexpr size_t recordAlignment = 8;
+
+	size_t alignUp(size_t size, size_t alignment)
+	{ return (size + alignment - 1) / alignment * alignment; }
+
+	system_error lastError(const string& what)
+	{ return system_error(errno, system_category(), what); }
+
+	// serializes appends with the other processes using the file
+	class FileLock
+	{
+		private:
+			int m_fd;
+			bool m_locked;
+
+		public:
+			explicit FileLock(int fd)
+				: m_fd(fd)
+			{
+				int ret;
+				while ((ret = flock(m_fd, LOCK_EX)) == -1 && errno == EINTR)
+					;
+
+				m_locked = ret == 0;
+			}
+
+			~FileLock()
+			{
+				if (m_locked)
+					flock(m_fd, LOCK_UN);
+			}
+
+			bool locked() const
+			{ return m_locked; }
+
+			FileLock(const FileLock&) = delete;
+			FileLock& operator=(const FileLock&) = delete;
+	};
+}
+
+constexpr uint16_t MatchHistory::promotionBit;
+
+static_assert(offsetof(MatchArchive::RecordHeader, opening) == 40, "the record layout is part of the file format");
+
+MatchArchive::MatchArchive(const string& fileName, size_t maxSize)
+	: m_maxSize(alignUp(max(maxSize, growSize), growSize))
+{
+	m_fd = open(fileName.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+	if (m_fd == -1)
+		throw lastError("couldn't open match archive " + fileName);
+
+	try
+	{
+		// another process could be creating the file header right now
+		FileLock fileLock(m_fd);
+		if (!fileLock.locked())
+			throw lastError("flock");
+
+		load(fileName);
+	}
+	catch (...)
+	{
+		release();
+		throw;
+	}
+}
+
+void MatchArchive::load(const string& fileName)
+{
+	struct stat st;
+	if (fstat(m_fd, &st) == -1)
+		throw lastError("fstat");
+
+	m_fileSize = size_t(st.st_size);
+	if (m_fileSize > m_maxSize)
+		throw runtime_error(fileName + " is larger than archiveMaxSizeMB");
+
+	// reserve the whole range now, only the part inside the file can be touched
+	void* map = mmap(nullptr, m_maxSize, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+	if (map == MAP_FAILED)
+		throw lastError("mmap");
+
+	m_map = static_cast<char*>(map);
+
+	if (m_fileSize == 0)
+	{
+		if (ftruncate(m_fd, growSize) == -1)
+			throw lastError("ftruncate");
+
+		m_fileSize = growSize;
+		memcpy(header().magic, magic, sizeof(magic));
+		header().end = sizeof(FileHeader);
+	}
+	else if (m_fileSize < sizeof(FileHeader) || memcmp(header().magic, magic, sizeof(magic)) != 0
+		|| header().end > m_fileSize)
+		throw runtime_error(fileName + " is not a match archive");
+
+	// rebuild the indexes, this only reads the record headers
+	m_indexedEnd = sizeof(FileHeader);
+	if (!catchUp())
+		throw runtime_error(fileName + " is corrupt");
+}
+
+MatchArchive::~MatchArchive()
+{
+	release();
+}
+
+void MatchArchive::release()
+{
+	if (m_map)
+		munmap(m_map, m_maxSize);
+	if (m_fd != -1)
+		close(m_fd);
+
+	m_map = nullptr;
+	m_fd = -1;
+}
+
+uint64_t MatchArchive::playerKey(const char* id, size_t len)
+{
+	uint64_t key = 0;
+	memcpy(&key, id, min(len, sizeof(key)));
+
+	return key;
+}
+
+bool MatchArchive::validRecord(uint64_t offset, uint64_t end) const
+{
+	if (end - offset < sizeof(RecordHeader))
+		return false;
+
+	auto rec = record(offset);
+	size_t used = sizeof(RecordHeader) + rec->moveCount * sizeof(uint16_t)
+		+ rec->usernameLengths[0] + rec->usernameLengths[1];
+
+	return rec->size % recordAlignment == 0 && rec->size >= used && rec->size <= end - offset;
+}
+
+void MatchArchive::addToIndexes(uint64_t offset) const
+{
+	auto rec = record(offset);
+
+	m_byTime.push_back(offset);
+	m_byMatch[rec->matchID] = offset;
+
+	for (int color = 0; color < 2; color++)
+	{
+		auto& offsets = m_byPlayer[playerKey(rec->playerIDs[color], sizeof(rec->playerIDs[color]))];
+
+		// both seats can be taken by the same player
+		if (offsets.empty() || offsets.back() != offset)
+			offsets.push_back(offset);
+	}
+}
+
+bool MatchArchive::catchUp() const
+{
+	uint64_t end = min<uint64_t>(header().end.load(memory_order_acquire), m_maxSize);
+
+	for (; m_indexedEnd < end; m_indexedEnd += record(m_indexedEnd)->size)
+	{
+		if (!validRecord(m_indexedEnd, end))
+			return false;
+
+		addToIndexes(m_indexedEnd);
+	}
+
+	return true;
+}
+
+bool MatchArchive::append(uint32_t matchID, int64_t finishTime, const MatchHistory& history)
+{
+	RecordHeader rec {};
+	rec.matchID    = matchID;
+	rec.finishTime = finishTime;
+	rec.result     = uint8_t(history.result);
+	rec.winner     = int8_t(history.winner);
+	rec.moveCount  = uint16_t(min(history.moves.size(), size_t(UINT16_MAX)));
+
+	for (int color = 0; color < 2; color++)
+	{
+		const auto& id = history.playerIDs[color];
+		memcpy(rec.playerIDs[color], id.data(), min(id.size(), sizeof(rec.playerIDs[color])));
+
+		rec.usernameLengths[color] = uint8_t(min(history.usernames[color].size(), size_t(UINT8_MAX)));
+	}
+
+	memcpy(rec.opening, history.opening.data(), sizeof(rec.opening));
+
+	size_t movesSize = rec.moveCount * sizeof(uint16_t);
+	size_t size = sizeof(RecordHeader) + movesSize + rec.usernameLengths[0] + rec.usernameLengths[1];
+	rec.size = uint32_t(alignUp(size, recordAlignment));
+
+	lock_guard<mutex> lock(m_appendMtx);
+	FileLock fileLock(m_fd);
+
+	// another process can have extended the file
+	struct stat st;
+	if (!fileLock.locked() || fstat(m_fd, &st) == -1)
+		return false;
+
+	m_fileSize = max(m_fileSize, size_t(st.st_size));
+
+	uint64_t offset = header().end;
+	if (offset + rec.size > m_maxSize)
+		return false;
+
+	if (offset + rec.size > m_fileSize)
+	{
+		size_t newSize = min(alignUp(offset + rec.size, growSize), m_maxSize);
+		if (ftruncate(m_fd, newSize) == -1)
+			return false;
+
+		m_fileSize = newSize;
+	}
+
+	char* pos = m_map + offset;
+	memcpy(pos, &rec, sizeof(rec));
+	pos += sizeof(rec);
+
+	memcpy(pos, history.moves.data(), movesSize);
+	pos += movesSize;
+
+	for (int color = 0; color < 2; color++)
+	{
+		memcpy(pos, history.usernames[color].data(), rec.usernameLengths[color]);
+		pos += rec.usernameLengths[color];
+	}
+
+	// the record is complete, publish it
+	header().end.store(offset + rec.size, memory_order_release);
+
+	lock_guard<mutex> indexLock(m_indexMtx);
+	catchUp();
+
+	return true;
+}
+
+vector<MatchArchive::ArchivedMatch> MatchArchive::getRecent(size_t maxCount) const
+{
+	vector<ArchivedMatch> ret;
+
+	lock_guard<mutex> lock(m_indexMtx);
+	catchUp();
+
+	for (auto it = m_byTime.rbegin(); it != m_byTime.rend() && ret.size() < maxCount; ++it)
+		ret.emplace_back(record(*it));
+
+	return ret;
+}
+
+vector<MatchArchive::ArchivedMatch> MatchArchive::getByPlayer(const string& playerID, size_t maxCount) const
+{
+	vector<ArchivedMatch> ret;
+
+	lock_guard<mutex> lock(m_indexMtx);
+	catchUp();
+
+	auto it = m_byPlayer.find(playerKey(playerID.data(), playerID.size()));
+	if (it == m_byPlayer.end())
+		return ret;
+
+	for (auto offIt = it->second.rbegin(); offIt != it->second.rend() && ret.size() < maxCount; ++offIt)
+		ret.emplace_back(record(*offIt));
+
+	return ret;
+}
+
+bool MatchArchive::find(uint32_t matchID, ArchivedMatch& match) const
+{
+	lock_guard<mutex> lock(m_indexMtx);
+	catchUp();
+
+	auto it = m_byMatch.find(matchID);
+	if (it == m_byMatch.end())
+		return false;
+
+	match = ArchivedMatch(record(it->second));
+	return true;
+}
+
+size_t MatchArchive::size() const
+{
+	lock_guard<mutex> lock(m_indexMtx);
+	catchUp();
+
+	return m_byTime.size();
+}
+
+uint64_t MatchArchive::getBytes() const
+{
+	return header().end.load(memory_order_acquire);
+}
+
+namespace ArchiveJson
+{
+	namespace
+	{
+		const char* resultToStr(MatchResult result)
+		{
+			switch (result)
+			{
+				case MatchResult::TIMEOUT:       return ArchiveExt::TIMEOUT;
+				case MatchResult::KING_CAPTURED: return ArchiveExt::KING_CAPTURED;
+				default:                         return ArchiveExt::ABANDONED;
+			}
+		}
+
+		PlayersColor colorFromIndex(int color)
+		{ return color == 0 ? PlayersColor::WHITE : PlayersColor::BLACK; }
+	}
+
+	Json::Value summary(const MatchArchive::ArchivedMatch& match)
+	{
+		Json::Value ret;
+		ret[ArchiveExt::MATCH_ID]    = int24ToB64ID(match.getMatchID());
+		ret[ArchiveExt::FINISH_TIME] = Json::Value::Int64(match.getFinishTime());
+		ret[ArchiveExt::RESULT]      = resultToStr(match.getResult());
+
+		if (match.getWinner() >= 0)
+			ret[ArchiveExt::WINNER] = PlayersColorToStr(colorFromIndex(match.getWinner()));
+
+		auto& players = ret[ArchiveExt::PLAYERS];
+		for (int color = 0; color < 2; color++)
+		{
+			auto& player = players[PlayersColorToStr(colorFromIndex(color))];
+			player[ArchiveExt::PLAYER_ID] = match.getPlayerID(color);
+			player[ArchiveExt::USERNAME]  = match.getUsername(color);
+		}
+
+		return ret;
+	}
+
+	Json::Value replay(const MatchArchive::ArchivedMatch& match)
+	{
+		Json::Value ret = summary(match);
+		ret[ArchiveExt::OPENING] = BoardSnapshot::encode(match.getOpening());
+
+		auto& moves = ret[ArchiveExt::MOVES];
+		moves = Json::Value(Json::arrayValue);
+
+		auto coordinate = [](int index) {
+			return CoordJson::coordinate(BoardSnapshot::Coordinate(index % BoardSnapshot::gridSize, index / BoardSnapshot::gridSize));
+		};
+
+		for (size_t i = 0; i < match.getMoveCount(); i++)
+		{
+			auto move = match.getMove(i);
+
+			Json::Value jsonMove(Json::arrayValue);
+			if (move & MatchHistory::promotionBit)
+			{
+				jsonMove.append(coordinate((move & ~MatchHistory::promotionBit) >> 8));
+				jsonMove.append(PieceTypeToStr(PieceType(move & 0xFF)));
+			}
+			else
+			{
+				jsonMove.append(coordinate(move >> 8));
+				jsonMove.append(coordinate(move & 0xFF));
+			}
+
+			moves.append(jsonMove);
+		}
+
+		return ret;
+	}
+}
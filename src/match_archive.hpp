@@ -0,0 +1,232 @@
+/* Copyright 2015 Jonas Platte
+ *
+ * This file is part of Cyvasse Online.
+ *
+ * Cyvasse Online is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Affero General Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later version.
+ *
+ * Cyvasse Online is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE. See the GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License along with this program.
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef _MATCH_ARCHIVE_HPP_
+#define _MATCH_ARCHIVE_HPP_
+
+#include <array>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include "board_snapshot.hpp"
+
+namespace Json { class Value; }
+
+// how a match ended, stored in the archive
+enum class MatchResult : uint8_t
+{
+	ABANDONED,     // both players left before it was decided
+	TIMEOUT,       // flag fall, see GameClock
+	KING_CAPTURED  // by a move the server validated
+};
+
+// What is kept of a match after it's removed. Collected while the match
+// runs, guarded by MatchData::getMatchMtx(). Colors are indexed 0 = white.
+struct MatchHistory
+{
+	bool started = false; // the setup of both players is done
+
+	std::array<std::string, 2> playerIDs;
+	std::array<std::string, 2> usernames;
+
+	// the board when the setup was done, both opening arrays
+	std::array<uint8_t, BoardSnapshot::tileCount> opening {};
+	// grid indices (see BoardSnapshot), from << 8 | to. Promotions have
+	// promotionBit set, the index of the piece and its new type instead.
+	std::vector<uint16_t> moves;
+
+	MatchResult result = MatchResult::ABANDONED;
+	int winner = -1; // color index, -1 = none
+
+	// never set for a move, grid indices are below 0x80
+	static constexpr uint16_t promotionBit = 0x8000;
+
+	static int colorIndex(cyvasse::PlayersColor color)
+	{ return color == cyvasse::PlayersColor::WHITE ? 0 : 1; }
+
+	static uint16_t promotion(BoardSnapshot::Coordinate coord, cyvasse::PieceType newType)
+	{ return uint16_t(promotionBit | BoardSnapshot::index(coord) << 8 | uint8_t(newType)); }
+};
+
+// Append-only file of finished matches. The file is mapped with MAP_SHARED
+// into an address range reserved for its maximum size at startup, so it
+// grows with ftruncate only and records never move. Queries read the
+// records straight from the mapping through ArchivedMatch views.
+//
+// File layout: a 16 byte header (magic, end of the valid data), then the
+// records, each starting 8 byte aligned with a RecordHeader followed by
+// the moves and the usernames. A record only counts once the end in the
+// header covers it, anything after that (a crash during a write) is
+// overwritten by the next append.
+//
+// The indexes (finish order, player id, match id) are kept in memory,
+// they are rebuilt from the record headers when the archive is opened.
+//
+// Several processes can use the same file (an old one draining after a
+// handoff and its successor): appends hold an exclusive flock on it, and
+// records that other processes appended are indexed on the next query.
+class MatchArchive
+{
+	public:
+		struct RecordHeader
+		{
+			uint32_t size;       // of the whole record including padding
+			uint32_t matchID;
+			int64_t finishTime;  // unix time in seconds
+			char playerIDs[2][8];
+			uint8_t usernameLengths[2];
+			uint8_t result;      // MatchResult
+			int8_t winner;
+			uint16_t moveCount;
+			uint8_t reserved[2];
+			uint8_t opening[BoardSnapshot::tileCount];
+			// uint16_t moves[moveCount], char usernames[]
+		};
+
+		// Only valid as long as the archive exists, reads from the mapping
+		class ArchivedMatch
+		{
+			private:
+				const RecordHeader* m_header;
+
+				const char* data() const
+				{ return reinterpret_cast<const char*>(m_header) + sizeof(RecordHeader); }
+
+			public:
+				explicit ArchivedMatch(const RecordHeader* header = nullptr)
+					: m_header(header)
+				{ }
+
+				uint32_t getMatchID() const
+				{ return m_header->matchID; }
+
+				int64_t getFinishTime() const
+				{ return m_header->finishTime; }
+
+				MatchResult getResult() const
+				{ return MatchResult(m_header->result); }
+
+				int getWinner() const
+				{ return m_header->winner; }
+
+				std::string getPlayerID(int color) const
+				{ return std::string(m_header->playerIDs[color], strnlen(m_header->playerIDs[color], 8)); }
+
+				std::string getUsername(int color) const
+				{
+					auto offset = m_header->moveCount * sizeof(uint16_t) + (color ? m_header->usernameLengths[0] : 0);
+					return std::string(data() + offset, m_header->usernameLengths[color]);
+				}
+
+				const uint8_t* getOpening() const
+				{ return m_header->opening; }
+
+				size_t getMoveCount() const
+				{ return m_header->moveCount; }
+
+				// see MatchHistory::moves, the moves aren't aligned
+				uint16_t getMove(size_t i) const
+				{
+					uint16_t move;
+					memcpy(&move, data() + i * sizeof(uint16_t), sizeof(uint16_t));
+					return move;
+				}
+		};
+
+	private:
+		struct FileHeader
+		{
+			char magic[8];
+			std::atomic<uint64_t> end;
+		};
+
+		int m_fd = -1;
+		char* m_map = nullptr;
+		size_t m_maxSize;
+		size_t m_fileSize = 0;
+
+		std::mutex m_appendMtx;
+
+		// mutable as queries catch up with the records of other processes
+		mutable std::mutex m_indexMtx;
+		mutable std::vector<uint64_t> m_byTime;
+		mutable std::unordered_map<uint64_t, std::vector<uint64_t>> m_byPlayer;
+		mutable std::unordered_map<uint32_t, uint64_t> m_byMatch;
+		mutable uint64_t m_indexedEnd = 0;
+
+		FileHeader& header() const
+		{ return *reinterpret_cast<FileHeader*>(m_map); }
+
+		const RecordHeader* record(uint64_t offset) const
+		{ return reinterpret_cast<const RecordHeader*>(m_map + offset); }
+
+		static uint64_t playerKey(const char* id, size_t len);
+
+		// maps the file and builds the indexes, the file has to be locked
+		void load(const std::string& fileName);
+
+		// the sizes in the record header fit into the record and the record into end
+		bool validRecord(uint64_t offset, uint64_t end) const;
+
+		// m_indexMtx has to be locked
+		void addToIndexes(uint64_t offset) const;
+		// indexes the records up to the end in the file header, returns
+		// false if one of them is corrupt (it and later ones are skipped)
+		bool catchUp() const;
+
+		void release();
+
+	public:
+		// throws std::system_error if the file can't be opened or
+		// mapped, std::runtime_error if it isn't a match archive
+		MatchArchive(const std::string& fileName, size_t maxSize);
+		~MatchArchive();
+
+		MatchArchive(const MatchArchive&) = delete;
+		MatchArchive& operator=(const MatchArchive&) = delete;
+
+		// thread-safe, writes to the file (call it from the BlockingPool).
+		// Returns false if the archive is full or the file can't be extended.
+		bool append(uint32_t matchID, int64_t finishTime, const MatchHistory&);
+
+		// thread-safe, newest first
+		std::vector<ArchivedMatch> getRecent(size_t maxCount) const;
+		std::vector<ArchivedMatch> getByPlayer(const std::string& playerID, size_t maxCount) const;
+		// returns false if there is no record of the match
+		bool find(uint32_t matchID, ArchivedMatch&) const;
+
+		size_t size() const;
+		uint64_t getBytes() const;
+		size_t getMaxSize() const
+		{ return m_maxSize; }
+};
+
+// TODO: move to cyvws, see protocol_ext.hpp
+namespace ArchiveJson
+{
+	// matchID, finishTime, result, winner, players
+	Json::Value summary(const MatchArchive::ArchivedMatch&);
+	// summary + opening (base64 of the tiles, see BoardSnapshot) and the
+	// moves as [[oldX, oldY], [newX, newY]], promotions as [[x, y], newType]
+	Json::Value replay(const MatchArchive::ArchivedMatch&);
+}
+
+#endif // _MATCH_ARCHIVE_HPP_
@@ -18,9 +18,17 @@
 #define _MATCH_DATA_HPP_
 
 #include <memory>
+#include <mutex>
 #include <set>
 #include <cassert>
+#include <cstdint>
 #include <cyvasse/match.hpp>
+#include "async.hpp"
+#include "b64.hpp"
+#include "board_snapshot.hpp"
+#include "game_clock.hpp"
+#include "match_archive.hpp"
+#include "memory_pool.hpp"
 
 class ClientData;
 
@@ -31,24 +39,125 @@ class MatchData
 		typedef std::set<ClientDataPtr, std::owner_less<ClientDataPtr>> ClientDataSets;
 
 	private:
+		// declared before m_match so it is destroyed after
+		// the pieces that were allocated from it
+		MatchArena m_arena;
+
+		uint32_t m_id;
 		cyvasse::Match m_match;
+		BoardSnapshot m_board;
+
+		// the seat taken by Worker::addBot, also in m_clientDataSets
+		ClientDataPtr m_bot;
+
+		// only set for matches created with a time control
+		std::unique_ptr<GameClock> m_clock;
+		bool m_finished = false;
+
+		cyvasse::PlayersColor m_toMove = cyvasse::PlayersColor::UNDEFINED;
+
+		// the piece that was moved last, until it is promoted
+		BoardSnapshot::Coordinate m_promotable {5, 5};
+		bool m_hasPromotable = false;
+
+		MatchHistory m_history;
+
+		// shared, so continuations can still run after the match is removed
+		std::shared_ptr<MatchStrand> m_strand = std::make_shared<MatchStrand>();
 
 		ClientDataSets m_clientDataSets;
 
+		mutable std::mutex m_clientDataSetsMtx;
+		mutable std::mutex m_matchMtx;
+
 	public:
-		MatchData(const std::string& matchID) // TODO: random, _public
-			: m_match(matchID)
+		MatchData(uint32_t matchID) // TODO: random, _public
+			: m_id(matchID)
+			, m_match(int24ToB64ID(matchID))
 		{ }
 
+		// the raw id, getMatch().getID() is its base64 form used in the protocol
+		uint32_t getID() const
+		{ return m_id; }
+
 		cyvasse::Match& getMatch()
 		{ return m_match; }
 
+		// mirrors getMatch().getActivePieces(), guarded by getMatchMtx() as well
+		BoardSnapshot& getBoard()
+		{ return m_board; }
+
+		const BoardSnapshot& getBoard() const
+		{ return m_board; }
+
+		// Set once, while both getClientDataSetsMtx() and getMatchMtx() are
+		// locked, so reading it only needs one of them. Empty without a bot.
+		const ClientDataPtr& getBot() const
+		{ return m_bot; }
+
+		void setBot(ClientDataPtr bot)
+		{ m_bot = std::move(bot); }
+
+		// guarded by getMatchMtx()
+		GameClock* getClock()
+		{ return m_clock.get(); }
+
+		void setClock(std::unique_ptr<GameClock> clock)
+		{ m_clock = std::move(clock); }
+
+		// UNDEFINED during the setup, guarded by getMatchMtx()
+		cyvasse::PlayersColor getToMove() const
+		{ return m_toMove; }
+
+		void setToMove(cyvasse::PlayersColor color)
+		{ m_toMove = color; }
+
+		// guarded by getMatchMtx() as well, see Worker::processPromoteMsg
+		bool isPromotable(BoardSnapshot::Coordinate coord) const
+		{ return m_hasPromotable && m_promotable == coord; }
+
+		void setPromotable(BoardSnapshot::Coordinate coord)
+		{
+			m_promotable = coord;
+			m_hasPromotable = true;
+		}
+
+		void clearPromotable()
+		{ m_hasPromotable = false; }
+
+		// no more game messages are accepted, guarded by getMatchMtx()
+		bool isFinished() const
+		{ return m_finished; }
+
+		void setFinished()
+		{ m_finished = true; }
+
+		// written to the MatchArchive when the match is removed, guarded by getMatchMtx()
+		MatchHistory& getHistory()
+		{ return m_history; }
+
+		// orders the continuations of the match's asynchronous operations
+		const std::shared_ptr<MatchStrand>& getStrand() const
+		{ return m_strand; }
+
+		MatchArena& getArena()
+		{ return m_arena; }
+
 		ClientDataSets& getClientDataSets()
 		{ return m_clientDataSets; }
 
 		const ClientDataSets& getClientDataSets() const
 		{ return m_clientDataSets; }
 
+		// Guards getClientDataSets() and the state of getMatch() (players, pieces,
+		// setup, clock). Lock order: SharedServerData::matchDataMtx, getClientDataSetsMtx(),
+		// getMatchMtx(). Sending while holding either of them is fine.
+		std::mutex& getClientDataSetsMtx() const
+		{ return m_clientDataSetsMtx; }
+
+		std::mutex& getMatchMtx() const
+		{ return m_matchMtx; }
+
 		/*bool operator==(const MatchData& other) const
 		{ return m_id == other.m_id; }
 
@@ -0,0 +1,201 @@
+/* Copyright 2015 Jonas Platte
+ *
+ * This file is part of Cyvasse Online.
+ *
+ * Cyvasse Online is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Affero General Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later version.
+ *
+ * Cyvasse Online is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE. See the GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License along with this program.
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _MATCH_TABLE_HPP_
+#define _MATCH_TABLE_HPP_
+
+#include <memory>
+#include <utility>
+#include <vector>
+#include <cassert>
+#include <cstdint>
+
+// Open addressing hash table (linear probing, backward shift deletion) keyed
+// by the 24-bit integer match IDs. Keys are stored separately from the values
+// so a probe sequence only touches one or two cache lines.
+// Not thread-safe, guard with SharedServerData::matchDataMtx.
+template <typename T>
+class MatchTable
+{
+	public:
+		typedef uint32_t key_type;
+		typedef std::shared_ptr<T> mapped_type;
+
+		// can't be the result of a 24-bit random number generator
+		static constexpr key_type emptyKey = 0xFFFFFFFF;
+
+		// slot() shifts by 32 - log2(capacity), which has to be less than 32
+		static constexpr size_t minCapacity = 2;
+
+	private:
+		std::vector<key_type> m_keys;
+		std::vector<mapped_type> m_values;
+
+		size_t m_size = 0;
+		size_t m_mask;
+		unsigned m_shift;
+
+		static unsigned log2(size_t capacity)
+		{
+			unsigned ret = 0;
+			while ((size_t(1) << ret) < capacity)
+				ret++;
+
+			return ret;
+		}
+
+		static size_t clampCapacity(size_t capacity)
+		{ return capacity < minCapacity ? minCapacity : capacity; }
+
+		size_t slot(key_type key) const
+		{
+			// fibonacci hashing, the ids are random already but
+			// this spreads sequential ids (tests, replays) as well
+			return uint32_t(key * 2654435769u) >> m_shift;
+		}
+
+		void rehash(size_t newCapacity)
+		{
+			std::vector<key_type> oldKeys(newCapacity, emptyKey);
+			std::vector<mapped_type> oldValues(newCapacity);
+
+			oldKeys.swap(m_keys);
+			oldValues.swap(m_values);
+
+			m_mask = newCapacity - 1;
+			m_shift = 32 - log2(newCapacity);
+
+			for (size_t i = 0; i < oldKeys.size(); i++)
+			{
+				if (oldKeys[i] == emptyKey)
+					continue;
+
+				size_t pos = slot(oldKeys[i]);
+				while (m_keys[pos] != emptyKey)
+					pos = (pos + 1) & m_mask;
+
+				m_keys[pos] = oldKeys[i];
+				m_values[pos] = std::move(oldValues[i]);
+			}
+		}
+
+		size_t findSlot(key_type key) const
+		{
+			for (size_t pos = slot(key); ; pos = (pos + 1) & m_mask)
+			{
+				if (m_keys[pos] == key)
+					return pos;
+				if (m_keys[pos] == emptyKey)
+					return m_keys.size();
+			}
+		}
+
+	public:
+		explicit MatchTable(size_t initialCapacity = 64)
+			: m_keys(clampCapacity(initialCapacity), emptyKey)
+			, m_values(m_keys.size())
+			, m_mask(m_keys.size() - 1)
+			, m_shift(32 - log2(m_keys.size()))
+		{
+			assert(initialCapacity != 0 && (initialCapacity & (initialCapacity - 1)) == 0);
+		}
+
+		size_t size() const
+		{ return m_size; }
+
+		bool empty() const
+		{ return m_size == 0; }
+
+		size_t capacity() const
+		{ return m_keys.size(); }
+
+		bool contains(key_type key) const
+		{ return findSlot(key) != m_keys.size(); }
+
+		// returns an empty pointer if there is no entry for key
+		mapped_type find(key_type key) const
+		{
+			size_t pos = findSlot(key);
+			return pos != m_keys.size() ? m_values[pos] : mapped_type();
+		}
+
+		// returns false if there already is an entry for key
+		bool insert(key_type key, mapped_type value)
+		{
+			assert(key != emptyKey);
+
+			// keep the load factor at or below 1/2
+			if ((m_size + 1) * 2 > m_keys.size())
+				rehash(m_keys.size() * 2);
+
+			size_t pos = slot(key);
+			for (; m_keys[pos] != emptyKey; pos = (pos + 1) & m_mask)
+			{
+				if (m_keys[pos] == key)
+					return false;
+			}
+
+			m_keys[pos] = key;
+			m_values[pos] = std::move(value);
+			m_size++;
+
+			return true;
+		}
+
+		bool erase(key_type key)
+		{
+			size_t pos = findSlot(key);
+			if (pos == m_keys.size())
+				return false;
+
+			m_values[pos].reset();
+			m_size--;
+
+			// move following entries of the probe sequence
+			// back so no tombstone is needed
+			for (size_t next = (pos + 1) & m_mask; m_keys[next] != emptyKey; next = (next + 1) & m_mask)
+			{
+				size_t home = slot(m_keys[next]);
+
+				// can the entry at next be moved to the hole at pos?
+				if (((next - home) & m_mask) >= ((next - pos) & m_mask))
+				{
+					m_keys[pos] = m_keys[next];
+					m_values[pos] = std::move(m_values[next]);
+					pos = next;
+				}
+			}
+
+			m_keys[pos] = emptyKey;
+			return true;
+		}
+
+		template <typename Func>
+		void forEach(Func&& func) const
+		{
+			for (size_t i = 0; i < m_keys.size(); i++)
+				if (m_keys[i] != emptyKey)
+					func(m_keys[i], m_values[i]);
+		}
+};
+
+template <typename T>
+constexpr typename MatchTable<T>::key_type MatchTable<T>::emptyKey;
+
+template <typename T>
+constexpr size_t MatchTable<T>::minCapacity;
+
+#endif // _MATCH_TABLE_HPP_
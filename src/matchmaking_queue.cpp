@@ -0,0 +1,103 @@
+/* Copyright 2015 Jonas Platte
+ *
+ * This file is part of Cyvasse Online.
+ *
+ * Cyvasse Online is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Affero General Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later version.
+ *
+ * Cyvasse Online is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE. See the GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License along with this program.
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "matchmaking_queue.hpp"
+
+#include <algorithm>
+#include <vector>
+
+using namespace std;
+
+bool MatchmakingQueue::pairOrEnqueue(const string& ruleSet, const Entry& self, const ClaimFunc& claim, Entry& opponent)
+{
+	static const array<vector<Preference>, 3> compatible {{
+		{ ANY_COLOR, WHITE, BLACK }, // ANY_COLOR
+		{ BLACK, ANY_COLOR },        // WHITE
+		{ WHITE, ANY_COLOR },        // BLACK
+	}};
+
+	lock_guard<mutex> lock(m_mtx);
+
+	auto queuesIt = m_queues.find(ruleSet);
+	if (queuesIt == m_queues.end())
+		queuesIt = m_queues.emplace(ruleSet, Queues()).first;
+
+	auto& queues = queuesIt->second;
+
+	for (auto pref : compatible[self.preference])
+	{
+		auto& queue = queues[pref];
+
+		while (!queue.empty())
+		{
+			Entry entry = queue.front();
+			queue.pop_front();
+			m_size--;
+
+			if (claim(entry))
+			{
+				if (all_of(queues.begin(), queues.end(), [](const deque<Entry>& q) { return q.empty(); }))
+					m_queues.erase(queuesIt);
+
+				opponent = entry;
+				return true;
+			}
+		}
+	}
+
+	queues[self.preference].push_back(self);
+	m_size++;
+
+	return false;
+}
+
+void MatchmakingQueue::remove(uint64_t ticket)
+{
+	lock_guard<mutex> lock(m_mtx);
+
+	for (auto it = m_queues.begin(); it != m_queues.end(); ++it)
+	{
+		bool empty = true;
+		bool removed = false;
+
+		for (auto& queue : it->second)
+		{
+			auto entry = find_if(queue.begin(), queue.end(), [=](const Entry& e) { return e.ticket == ticket; });
+			if (entry != queue.end())
+			{
+				queue.erase(entry);
+				m_size--;
+				removed = true;
+			}
+
+			empty = empty && queue.empty();
+		}
+
+		if (removed)
+		{
+			if (empty)
+				m_queues.erase(it);
+
+			return;
+		}
+	}
+}
+
+size_t MatchmakingQueue::size() const
+{
+	lock_guard<mutex> lock(m_mtx);
+	return m_size;
+}
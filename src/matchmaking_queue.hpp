@@ -0,0 +1,77 @@
+/* Copyright 2015 Jonas Platte
+ *
+ * This file is part of Cyvasse Online.
+ *
+ * Cyvasse Online is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Affero General Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later version.
+ *
+ * Cyvasse Online is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE. See the GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License along with this program.
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _MATCHMAKING_QUEUE_HPP_
+#define _MATCHMAKING_QUEUE_HPP_
+
+#include <array>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <cstdint>
+#include <websocketpp/common/connection_hdl.hpp>
+
+// Clients looking for a random opponent, grouped by rule set and colour
+// preference. A new client is paired with a waiting one right away if there
+// is one with a compatible preference, otherwise it is queued.
+//
+// Clients are removed when they cancel or disconnect. An entry can still be
+// popped while its client is leaving, the claim callback rejects it then.
+class MatchmakingQueue
+{
+	public:
+		enum Preference
+		{
+			ANY_COLOR = 0,
+			WHITE     = 1,
+			BLACK     = 2
+		};
+
+		struct Entry
+		{
+			websocketpp::connection_hdl connHdl;
+			uint64_t ticket;
+			unsigned msgID; // of the request, answered when an opponent is found
+			Preference preference;
+		};
+
+		// called with the queue locked, has to atomically check that the entry is
+		// still valid and mark it as taken, see Worker::processFindMatchRequest
+		typedef std::function<bool(const Entry&)> ClaimFunc;
+
+	private:
+		typedef std::array<std::deque<Entry>, 3> Queues; // indexed by Preference
+
+		// rule sets without waiting clients are erased
+		std::map<std::string, Queues> m_queues;
+		size_t m_size = 0;
+
+		mutable std::mutex m_mtx;
+
+	public:
+		// returns true and sets opponent if a waiting client was found,
+		// otherwise self is queued
+		bool pairOrEnqueue(const std::string& ruleSet, const Entry& self, const ClaimFunc& claim, Entry& opponent);
+
+		// doesn't do anything if the ticket isn't queued (anymore)
+		void remove(uint64_t ticket);
+
+		size_t size() const;
+};
+
+#endif // _MATCHMAKING_QUEUE_HPP_
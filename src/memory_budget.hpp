@@ -0,0 +1,91 @@
+/* Copyright 2015 Jonas Platte
+ *
+ * This file is part of Cyvasse Online.
+ *
+ * Cyvasse Online is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Affero General Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later version.
+ *
+ * Cyvasse Online is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE. See the GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License along with this program.
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _MEMORY_BUDGET_HPP_
+#define _MEMORY_BUDGET_HPP_
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include "memory_pool.hpp"
+
+// Approximate memory usage of the server, split by what it is used for, and
+// the budget new matches are checked against. Matches (MatchData, ClientData
+// and the pieces in their arenas) are read from the pool statistics so they
+// are always up to date, connections are accounted for in onOpen / onClose,
+// the games lists and the websocketpp send buffers are sampled periodically
+// by CyvasseServer::sampleMemory.
+class MemoryBudget
+{
+	public:
+		enum Category
+		{
+			MATCHES,
+			CONNECTIONS,
+			GAMES_LISTS,
+			SEND_BUFFERS,
+			CATEGORY_COUNT
+		};
+
+	private:
+		std::array<std::atomic<size_t>, CATEGORY_COUNT> m_bytes {};
+
+		size_t m_limit = 0; // 0 = unlimited
+		size_t m_softLimit = 0;
+
+	public:
+		// new matches are refused once softLimitPercent of limit are in use
+		void setLimit(size_t limit, unsigned softLimitPercent)
+		{
+			m_limit = limit;
+			m_softLimit = limit / 100 * softLimitPercent;
+		}
+
+		size_t getLimit() const
+		{ return m_limit; }
+
+		void add(Category category, size_t bytes)
+		{ m_bytes[category] += bytes; }
+
+		void sub(Category category, size_t bytes)
+		{ m_bytes[category] -= bytes; }
+
+		void set(Category category, size_t bytes)
+		{ m_bytes[category] = bytes; }
+
+		size_t get(Category category) const
+		{
+			if (category == MATCHES)
+				return SizeClassPool::instance().getStats().bytesInUse + MatchArena::globalStats().bytesReserved;
+
+			return m_bytes[category];
+		}
+
+		size_t total() const
+		{
+			size_t ret = 0;
+			for (int i = 0; i < CATEGORY_COUNT; i++)
+				ret += get(Category(i));
+
+			return ret;
+		}
+
+		bool exhausted() const
+		{ return m_limit != 0 && total() >= m_softLimit; }
+};
+
+#endif // _MEMORY_BUDGET_HPP_
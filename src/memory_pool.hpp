@@ -0,0 +1,291 @@
+/* Copyright 2015 Jonas Platte
+ *
+ * This file is part of Cyvasse Online.
+ *
+ * Cyvasse Online is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Affero General Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later version.
+ *
+ * Cyvasse Online is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE. See the GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License along with this program.
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _MEMORY_POOL_HPP_
+#define _MEMORY_POOL_HPP_
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <new>
+
+struct MemoryPoolStats
+{
+	std::atomic<size_t> bytesReserved = {0};
+	std::atomic<size_t> bytesInUse    = {0};
+	std::atomic<size_t> allocations   = {0};
+};
+
+// Free list allocator for the small objects that are created per match and
+// per client (MatchData, ClientData and their shared_ptr control blocks).
+// Blocks are rounded up to a multiple of 16 bytes, and freed blocks are put
+// back into the free list of their size class instead of being returned to
+// the system, so a busy lobby doesn't go through malloc for every new match.
+class SizeClassPool
+{
+	public:
+		static constexpr size_t granularity  = 16;
+		static constexpr size_t maxBlockSize = 512;
+		static constexpr size_t chunkSize    = 64 * 1024;
+
+	private:
+		struct FreeBlock
+		{
+			FreeBlock* next;
+		};
+
+		std::array<FreeBlock*, maxBlockSize / granularity> m_freeLists {};
+
+		char* m_chunkPos = nullptr;
+		char* m_chunkEnd = nullptr;
+
+		std::mutex m_mtx;
+
+		MemoryPoolStats m_stats;
+
+		static size_t sizeClass(size_t size)
+		{ return (size + granularity - 1) / granularity - 1; }
+
+	public:
+		// Intentionally never destroyed: objects allocated from the pool can be
+		// released during static destruction (e.g. after exit() in stopServer)
+		static SizeClassPool& instance()
+		{
+			static SizeClassPool* pool = new SizeClassPool;
+			return *pool;
+		}
+
+		void* allocate(size_t size)
+		{
+			m_stats.allocations++;
+
+			if (size > maxBlockSize)
+			{
+				m_stats.bytesInUse += size;
+				return ::operator new(size);
+			}
+
+			const size_t idx = sizeClass(size);
+			const size_t blockSize = (idx + 1) * granularity;
+
+			std::lock_guard<std::mutex> lock(m_mtx);
+			m_stats.bytesInUse += blockSize;
+
+			if (FreeBlock* block = m_freeLists[idx])
+			{
+				m_freeLists[idx] = block->next;
+				return block;
+			}
+
+			if (static_cast<size_t>(m_chunkEnd - m_chunkPos) < blockSize)
+			{
+				// the rest of the old chunk is lost, but that's at most maxBlockSize bytes
+				m_chunkPos = static_cast<char*>(::operator new(chunkSize));
+				m_chunkEnd = m_chunkPos + chunkSize;
+				m_stats.bytesReserved += chunkSize;
+			}
+
+			void* ret = m_chunkPos;
+			m_chunkPos += blockSize;
+			return ret;
+		}
+
+		void deallocate(void* ptr, size_t size)
+		{
+			if (size > maxBlockSize)
+			{
+				m_stats.bytesInUse -= size;
+				::operator delete(ptr);
+				return;
+			}
+
+			const size_t idx = sizeClass(size);
+
+			std::lock_guard<std::mutex> lock(m_mtx);
+			m_stats.bytesInUse -= (idx + 1) * granularity;
+
+			auto block = static_cast<FreeBlock*>(ptr);
+			block->next = m_freeLists[idx];
+			m_freeLists[idx] = block;
+		}
+
+		const MemoryPoolStats& getStats() const
+		{ return m_stats; }
+};
+
+// Stateless allocator for std::allocate_shared and containers
+template <typename T>
+struct PoolAllocator
+{
+	typedef T value_type;
+
+	PoolAllocator() = default;
+
+	template <typename U>
+	PoolAllocator(const PoolAllocator<U>&)
+	{ }
+
+	T* allocate(size_t n)
+	{ return static_cast<T*>(SizeClassPool::instance().allocate(n * sizeof(T))); }
+
+	void deallocate(T* ptr, size_t n)
+	{ SizeClassPool::instance().deallocate(ptr, n * sizeof(T)); }
+};
+
+template <typename T, typename U>
+bool operator==(const PoolAllocator<T>&, const PoolAllocator<U>&)
+{ return true; }
+
+template <typename T, typename U>
+bool operator!=(const PoolAllocator<T>&, const PoolAllocator<U>&)
+{ return false; }
+
+// Bump allocator that owns everything allocated for a single match (its
+// pieces, mostly). Nothing is freed individually, all chunks are released
+// at once when the MatchData owning the arena is destroyed.
+class MatchArena
+{
+	public:
+		static constexpr size_t chunkSize = 8 * 1024;
+
+	private:
+		struct Chunk
+		{
+			Chunk* prev;
+			size_t size;
+		};
+
+		Chunk* m_lastChunk = nullptr;
+
+		char* m_pos = nullptr;
+		char* m_end = nullptr;
+
+		size_t m_bytesReserved = 0;
+
+		std::mutex m_mtx;
+
+		void addChunk(size_t minSize)
+		{
+			size_t size = sizeof(Chunk) + (minSize > chunkSize ? minSize : chunkSize);
+
+			auto chunk = static_cast<Chunk*>(::operator new(size));
+			chunk->prev = m_lastChunk;
+			chunk->size = size;
+			m_lastChunk = chunk;
+
+			m_pos = reinterpret_cast<char*>(chunk + 1);
+			m_end = reinterpret_cast<char*>(chunk) + size;
+
+			m_bytesReserved += size;
+			globalStats().bytesReserved += size;
+		}
+
+	public:
+		MatchArena() = default;
+		MatchArena(const MatchArena&) = delete;
+		MatchArena& operator=(const MatchArena&) = delete;
+
+		~MatchArena()
+		{
+			while (m_lastChunk)
+			{
+				auto prev = m_lastChunk->prev;
+				::operator delete(m_lastChunk);
+				m_lastChunk = prev;
+			}
+
+			globalStats().bytesReserved -= m_bytesReserved;
+		}
+
+		// accumulated over all arenas that currently exist
+		static MemoryPoolStats& globalStats()
+		{
+			static MemoryPoolStats* stats = new MemoryPoolStats;
+			return *stats;
+		}
+
+		void* allocate(size_t size, size_t alignment)
+		{
+			std::lock_guard<std::mutex> lock(m_mtx);
+
+			auto align = [&] {
+				auto offset = reinterpret_cast<uintptr_t>(m_pos) % alignment;
+				return offset ? m_pos + (alignment - offset) : m_pos;
+			};
+
+			char* ret = align();
+			if (!m_pos || ret + size > m_end)
+			{
+				addChunk(size + alignment);
+				ret = align();
+			}
+
+			m_pos = ret + size;
+
+			globalStats().bytesInUse += size;
+			globalStats().allocations++;
+
+			return ret;
+		}
+
+		size_t getBytesReserved() const
+		{ return m_bytesReserved; }
+};
+
+// Allocator for std::allocate_shared that places objects in a MatchArena.
+// Objects allocated this way must not outlive the arena.
+template <typename T>
+class ArenaAllocator
+{
+	template <typename U>
+	friend class ArenaAllocator;
+
+	private:
+		MatchArena* m_arena;
+
+	public:
+		typedef T value_type;
+
+		explicit ArenaAllocator(MatchArena& arena)
+			: m_arena(&arena)
+		{ }
+
+		template <typename U>
+		ArenaAllocator(const ArenaAllocator<U>& other)
+			: m_arena(other.m_arena)
+		{ }
+
+		T* allocate(size_t n)
+		{ return static_cast<T*>(m_arena->allocate(n * sizeof(T), alignof(T))); }
+
+		void deallocate(T*, size_t n)
+		{
+			// memory is only released together with the whole arena
+			MatchArena::globalStats().bytesInUse -= n * sizeof(T);
+		}
+
+		template <typename U>
+		bool operator==(const ArenaAllocator<U>& other) const
+		{ return m_arena == other.m_arena; }
+
+		template <typename U>
+		bool operator!=(const ArenaAllocator<U>& other) const
+		{ return m_arena != other.m_arena; }
+};
+
+#endif // _MEMORY_POOL_HPP_
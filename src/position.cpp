@@ -0,0 +1,346 @@
+/* Copyright 2015 Jonas Platte
+ *
+ * This file is part of Cyvasse Online.
+ *
+ * Cyvasse Online is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Affero General Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later version.
+ *
+ * Cyvasse Online is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE. See the GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License along with this program.
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "position.hpp"
+
+#include <cstdlib>
+#include <cyvasse/match.hpp>
+
+using namespace cyvasse;
+using namespace std;
+
+constexpr size_t Position::tileCount;
+constexpr uint8_t Position::noTile;
+constexpr size_t Position::maxMoves;
+
+namespace
+{
+	enum class Movement : uint8_t
+	{
+		NONE,
+		ORTHOGONAL, // to a neighboring tile
+		DIAGONAL,   // between two neighboring tiles
+		HEXAGONAL,  // either of them
+		RANGE       // to any tile within range, jumping over others
+	};
+
+	struct PieceRules
+	{
+		Movement movement;
+		uint8_t range; // 0 = unlimited
+		int value;
+	};
+
+	PieceRules rulesOf(PieceType type)
+	{
+		switch (type)
+		{
+			case PieceType::RABBLE:      return {Movement::ORTHOGONAL, 1, 100};
+			case PieceType::CROSSBOWS:   return {Movement::ORTHOGONAL, 3, 250};
+			case PieceType::SPEARS:      return {Movement::DIAGONAL,   2, 250};
+			case PieceType::LIGHT_HORSE: return {Movement::HEXAGONAL,  3, 300};
+			case PieceType::TREBUCHET:   return {Movement::ORTHOGONAL, 0, 450};
+			case PieceType::ELEPHANT:    return {Movement::DIAGONAL,   0, 450};
+			case PieceType::HEAVY_HORSE: return {Movement::HEXAGONAL,  0, 550};
+			case PieceType::DRAGON:      return {Movement::RANGE,      4, 900};
+			case PieceType::KING:        return {Movement::ORTHOGONAL, 1, 0};
+			default:                     return {Movement::NONE,       0, 0};
+		}
+	}
+
+	constexpr int gridSize = BoardSnapshot::gridSize;
+	constexpr int center   = gridSize / 2;
+
+	constexpr size_t nDirections = 12; // orthogonal ones first
+	constexpr int directions[nDirections][2] = {
+		{1, 0}, {-1, 0}, {0, 1}, {0, -1}, {1, -1}, {-1, 1},
+		{1, 1}, {-1, -1}, {2, -1}, {-2, 1}, {1, -2}, {-1, 2}
+	};
+
+	// tile codes are type + 1 and the black bit, only
+	// the low nibble of the type is used for indexing
+	size_t codeIndex(uint8_t tile)
+	{ return (tile & 0x0F) | ((tile & BoardSnapshot::blackBit) ? 0x10 : 0); }
+
+	int distance(int x1, int y1, int x2, int y2)
+	{
+		int dx = x2 - x1, dy = y2 - y1;
+		return (abs(dx) + abs(dy) + abs(dx + dy)) / 2;
+	}
+
+	BoardSnapshot::Coordinate at(int x, int y)
+	{ return BoardSnapshot::Coordinate(x, y); }
+
+	bool onBoard(int x, int y)
+	{ return x >= 0 && x < gridSize && y >= 0 && y < gridSize && distance(x, y, center, center) <= center; }
+
+	uint64_t splitMix64(uint64_t& state)
+	{
+		uint64_t z = (state += 0x9E3779B97F4A7C15);
+		z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9;
+		z = (z ^ (z >> 27)) * 0x94D049BB133111EB;
+		return z ^ (z >> 31);
+	}
+
+	// everything that only depends on the board geometry, built once
+	struct Tables
+	{
+		std::array<std::array<uint8_t, nDirections>, Position::tileCount> step;
+		std::array<std::vector<uint8_t>, Position::tileCount> dragonTargets;
+
+		std::array<PieceRules, 0x10> rules;
+		// value of a piece on a tile, for the side owning it
+		std::array<std::array<int, Position::tileCount>, 0x20> pieceSquare;
+
+		std::array<std::array<uint64_t, Position::tileCount>, 0x20> zobrist;
+		uint64_t zobristBlackToMove;
+
+		Tables()
+		{
+			for (uint8_t code = 0; code < 0x10; code++)
+				rules[code] = code ? rulesOf(PieceType(code - 1)) : PieceRules{Movement::NONE, 0, 0};
+
+			uint64_t seed = 0x5EED;
+			zobristBlackToMove = splitMix64(seed);
+
+			for (int y = 0; y < gridSize; y++)
+			{
+				for (int x = 0; x < gridSize; x++)
+				{
+					size_t index = y * gridSize + x;
+
+					for (size_t dir = 0; dir < nDirections; dir++)
+					{
+						int nx = x + directions[dir][0], ny = y + directions[dir][1];
+						step[index][dir] = onBoard(x, y) && onBoard(nx, ny) ? uint8_t(ny * gridSize + nx) : Position::noTile;
+					}
+
+					if (!onBoard(x, y))
+						continue;
+
+					for (int ty = 0; ty < gridSize; ty++)
+						for (int tx = 0; tx < gridSize; tx++)
+							if (onBoard(tx, ty) && (tx != x || ty != y) && distance(x, y, tx, ty) <= 4)
+								dragonTargets[index].push_back(uint8_t(ty * gridSize + tx));
+
+					for (size_t code = 0; code < 0x20; code++)
+					{
+						auto value = rules[code & 0x0F].value;
+						// pieces near the center reach more tiles
+						pieceSquare[code][index] = value ? value + 4 * (center - distance(x, y, center, center)) : 0;
+						zobrist[code][index] = splitMix64(seed);
+					}
+				}
+			}
+		}
+	};
+
+	const Tables& tables()
+	{
+		static const Tables t;
+		return t;
+	}
+}
+
+Position::Position(const BoardSnapshot& board, PlayersColor toMove)
+	: m_tiles(board.getTiles())
+	, m_toMove(toMove)
+	, m_hash(toMove == PlayersColor::BLACK ? tables().zobristBlackToMove : 0)
+	, m_material{{0, 0}}
+	, m_kings{{0, 0}}
+{
+	for (size_t i = 0; i < tileCount; i++)
+	{
+		auto tile = m_tiles[i];
+		if (tile == BoardSnapshot::emptyTile)
+			continue;
+
+		m_tiles[i] = BoardSnapshot::emptyTile;
+		put(uint8_t(i), tile);
+	}
+}
+
+void Position::put(uint8_t index, uint8_t tile)
+{
+	const auto& t = tables();
+	auto code = codeIndex(tile);
+	auto color = (tile & BoardSnapshot::blackBit) ? 1 : 0;
+
+	m_tiles[index] = tile;
+	m_hash ^= t.zobrist[code][index];
+	m_material[color] += t.pieceSquare[code][index];
+
+	if (PieceType((tile & 0x7F) - 1) == PieceType::KING)
+		m_kings[color]++;
+}
+
+void Position::clear(uint8_t index)
+{
+	const auto& t = tables();
+	auto tile = m_tiles[index];
+	auto code = codeIndex(tile);
+	auto color = (tile & BoardSnapshot::blackBit) ? 1 : 0;
+
+	m_tiles[index] = BoardSnapshot::emptyTile;
+	m_hash ^= t.zobrist[code][index];
+	m_material[color] -= t.pieceSquare[code][index];
+
+	if (PieceType((tile & 0x7F) - 1) == PieceType::KING)
+		m_kings[color]--;
+}
+
+void Position::generateMoves(MoveList& list) const
+{
+	const auto& t = tables();
+	const uint8_t ownBit = (m_toMove == PlayersColor::BLACK) ? BoardSnapshot::blackBit : 0;
+	const uint8_t mountains = uint8_t(int(PieceType::MOUNTAINS) + 1);
+
+	// target tiles have to be empty or hold a piece of the opponent (except mountains)
+	auto canEnter = [&](uint8_t tile) {
+		return tile == BoardSnapshot::emptyTile ||
+			((tile & BoardSnapshot::blackBit) != ownBit && (tile & 0x7F) != mountains);
+	};
+
+	list.size = 0;
+
+	for (uint8_t from = 0; from < tileCount; from++)
+	{
+		auto tile = m_tiles[from];
+		if (tile == BoardSnapshot::emptyTile || (tile & BoardSnapshot::blackBit) != ownBit)
+			continue;
+
+		const auto& rules = t.rules[tile & 0x0F];
+
+		if (rules.movement == Movement::NONE)
+			continue;
+
+		if (rules.movement == Movement::RANGE)
+		{
+			for (auto to : t.dragonTargets[from])
+				if (canEnter(m_tiles[to]))
+					list.push(from, to);
+
+			continue;
+		}
+
+		size_t firstDir = (rules.movement == Movement::DIAGONAL) ? 6 : 0;
+		size_t lastDir  = (rules.movement == Movement::ORTHOGONAL) ? 6 : nDirections;
+
+		for (size_t dir = firstDir; dir < lastDir; dir++)
+		{
+			uint8_t to = from;
+			for (unsigned dist = 1; rules.range == 0 || dist <= rules.range; dist++)
+			{
+				to = t.step[to][dir];
+				if (to == noTile)
+					break;
+
+				auto target = m_tiles[to];
+				if (canEnter(target))
+					list.push(from, to);
+
+				// sliding pieces stop at the first piece in their way
+				if (target != BoardSnapshot::emptyTile)
+					break;
+			}
+		}
+	}
+}
+
+uint8_t Position::make(Move move)
+{
+	auto captured = m_tiles[move.to];
+	auto piece = m_tiles[move.from];
+
+	if (captured != BoardSnapshot::emptyTile)
+		clear(move.to);
+
+	clear(move.from);
+	put(move.to, piece);
+
+	m_toMove = !m_toMove;
+	m_hash ^= tables().zobristBlackToMove;
+
+	return captured;
+}
+
+void Position::unmake(Move move, uint8_t captured)
+{
+	auto piece = m_tiles[move.to];
+
+	clear(move.to);
+	put(move.from, piece);
+
+	if (captured != BoardSnapshot::emptyTile)
+		put(move.to, captured);
+
+	m_toMove = !m_toMove;
+	m_hash ^= tables().zobristBlackToMove;
+}
+
+int Position::evaluate() const
+{
+	auto own = colorIndex(m_toMove);
+	return m_material[own] - m_material[own ^ 1];
+}
+
+auto Position::standardOpening(PlayersColor color) -> OpeningArray
+{
+	// black's setup zone is the half with y < 5, white's is mirrored
+	static const OpeningArray black {
+		{PieceType::TREBUCHET,   at(5, 0)}, {PieceType::ELEPHANT,    at(6, 0)}, {PieceType::KING,      at(7, 0)},
+		{PieceType::ELEPHANT,    at(8, 0)}, {PieceType::TREBUCHET,   at(9, 0)}, {PieceType::DRAGON,    at(10, 0)},
+		{PieceType::HEAVY_HORSE, at(4, 1)}, {PieceType::MOUNTAINS,   at(5, 1)}, {PieceType::CROSSBOWS, at(6, 1)},
+		{PieceType::MOUNTAINS,   at(7, 1)}, {PieceType::CROSSBOWS,   at(8, 1)}, {PieceType::MOUNTAINS, at(9, 1)},
+		{PieceType::HEAVY_HORSE, at(10, 1)},
+		{PieceType::LIGHT_HORSE, at(3, 2)}, {PieceType::SPEARS,      at(4, 2)}, {PieceType::RABBLE,    at(5, 2)},
+		{PieceType::MOUNTAINS,   at(6, 2)}, {PieceType::RABBLE,      at(7, 2)}, {PieceType::MOUNTAINS, at(8, 2)},
+		{PieceType::SPEARS,      at(9, 2)}, {PieceType::LIGHT_HORSE, at(10, 2)},
+		{PieceType::MOUNTAINS,   at(2, 3)}, {PieceType::RABBLE,      at(4, 3)}, {PieceType::RABBLE,    at(6, 3)},
+		{PieceType::RABBLE,      at(8, 3)}, {PieceType::RABBLE,      at(10, 3)}
+	};
+
+	if (color == PlayersColor::BLACK)
+		return black;
+
+	OpeningArray white;
+	white.reserve(black.size());
+
+	for (const auto& it : black)
+		white.emplace_back(it.first, Coordinate(gridSize - 1 - it.second.x(), gridSize - 1 - it.second.y()));
+
+	return white;
+}
+
+void Position::legalMoves(Match& match, PlayersColor color, MoveList& list)
+{
+	list.size = 0;
+
+	for (const auto& it : match.getActivePieces())
+	{
+		const auto& piece = it.second;
+		if (piece->getColor() != color)
+			continue;
+
+		for (const auto& target : piece->getPossibleTargetTiles())
+		{
+			if (list.size == maxMoves)
+				return;
+
+			list.push(toIndex(it.first), toIndex(target));
+		}
+	}
+}
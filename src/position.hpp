@@ -0,0 +1,142 @@
+/* Copyright 2015 Jonas Platte
+ *
+ * This file is part of Cyvasse Online.
+ *
+ * Cyvasse Online is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Affero General Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later version.
+ *
+ * Cyvasse Online is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE. See the GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License along with this program.
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _POSITION_HPP_
+#define _POSITION_HPP_
+
+#include <array>
+#include <utility>
+#include <vector>
+#include <cstdint>
+#include <cyvasse/piece.hpp>
+#include <cyvasse/player.hpp>
+#include "board_snapshot.hpp"
+
+namespace cyvasse { class Match; }
+
+// Board of the bot's search and of cyvasse-perft. The tiles use the
+// BoardSnapshot encoding, so a position is created from the snapshot of a
+// match with one copy. Material is kept up to date by make() / unmake() and
+// so is a zobrist hash for the transposition table.
+// Below the root, moves are generated by a table of the pieces' movement
+// ranges instead of cyvasse::Piece to keep the search fast: a move is
+// allowed if the piece can reach the target tile and it isn't occupied by a
+// piece of the same color or mountains. That is an approximation of the
+// rules, so the moves that are actually played come from legalMoves().
+// The game is over when a king is captured.
+class Position
+{
+	public:
+		typedef BoardSnapshot::Coordinate Coordinate;
+
+		static constexpr size_t tileCount = BoardSnapshot::tileCount;
+		static constexpr uint8_t noTile   = 0xFF;
+
+		// never exceeded by a legal position (26 pieces per side)
+		static constexpr size_t maxMoves = 512;
+
+		struct Move
+		{
+			uint8_t from;
+			uint8_t to;
+
+			uint16_t pack() const
+			{ return uint16_t(from << 8 | to); }
+
+			static Move unpack(uint16_t packed)
+			{ return Move{uint8_t(packed >> 8), uint8_t(packed & 0xFF)}; }
+
+			bool operator==(const Move& other) const
+			{ return from == other.from && to == other.to; }
+
+			bool operator!=(const Move& other) const
+			{ return !(*this == other); }
+		};
+
+		struct MoveList
+		{
+			std::array<Move, maxMoves> moves;
+			size_t size = 0;
+
+			void push(uint8_t from, uint8_t to)
+			{ moves[size++] = Move{from, to}; }
+
+			Move* begin()
+			{ return moves.data(); }
+
+			Move* end()
+			{ return moves.data() + size; }
+		};
+
+		// the pieces of one side in a standard setup, used
+		// for the bot's opening array and by cyvasse-perft
+		typedef std::vector<std::pair<cyvasse::PieceType, Coordinate>> OpeningArray;
+
+	private:
+		std::array<uint8_t, tileCount> m_tiles;
+
+		cyvasse::PlayersColor m_toMove;
+		uint64_t m_hash;
+
+		// indexed by colorIndex()
+		std::array<int, 2> m_material;
+		std::array<unsigned, 2> m_kings;
+
+		static size_t colorIndex(cyvasse::PlayersColor color)
+		{ return color == cyvasse::PlayersColor::WHITE ? 0 : 1; }
+
+		void put(uint8_t index, uint8_t tile);
+		void clear(uint8_t index);
+
+	public:
+		Position(const BoardSnapshot&, cyvasse::PlayersColor toMove);
+
+		cyvasse::PlayersColor getToMove() const
+		{ return m_toMove; }
+
+		uint64_t getHash() const
+		{ return m_hash; }
+
+		uint8_t getTile(uint8_t index) const
+		{ return m_tiles[index]; }
+
+		// the side to move lost its king
+		bool isLost() const
+		{ return m_kings[colorIndex(m_toMove)] == 0; }
+
+		void generateMoves(MoveList&) const;
+
+		// returns the tile that was captured, pass it to unmake()
+		uint8_t make(Move);
+		void unmake(Move, uint8_t captured);
+
+		// material and piece placement, positive if the side to move is ahead
+		int evaluate() const;
+
+		static Coordinate toCoordinate(uint8_t index)
+		{ return Coordinate(index % BoardSnapshot::gridSize, index / BoardSnapshot::gridSize); }
+
+		static uint8_t toIndex(Coordinate coord)
+		{ return uint8_t(coord.y() * BoardSnapshot::gridSize + coord.x()); }
+
+		static OpeningArray standardOpening(cyvasse::PlayersColor);
+
+		// the moves cyvasse::Piece allows color in match, guard
+		// the match with MatchData::getMatchMtx()
+		static void legalMoves(cyvasse::Match&, cyvasse::PlayersColor, MoveList&);
+};
+
+#endif // _POSITION_HPP_
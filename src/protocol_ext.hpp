@@ -0,0 +1,147 @@
+/* Copyright 2015 Jonas Platte
+ *
+ * This file is part of Cyvasse Online.
+ *
+ * Cyvasse Online is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Affero General Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later version.
+ *
+ * Cyvasse Online is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE. See the GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License along with this program.
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef _PROTOCOL_EXT_HPP_
+#define _PROTOCOL_EXT_HPP_
+
+// Everything this server adds to the protocol defined by cyvws, so the wire
+// format has a single definition until it is moved there. Clients that
+// don't know about the additions can ignore them, the server falls back to
+// the plain cyvws behaviour if a request doesn't use them.
+// TODO: move to cyvws
+
+namespace ServerRequestActionExt
+{
+	// join the matchmaking queue of a rule set / leave it again
+	constexpr const char* FIND_MATCH        = "findMatch";
+	constexpr const char* CANCEL_FIND_MATCH = "cancelFindMatch";
+}
+
+namespace ServerReplyErrMsgExt
+{
+	constexpr const char* MEMORY_BUDGET_EXHAUSTED = "memoryBudgetExhausted";
+	constexpr const char* BOTS_DISABLED           = "botsDisabled";
+	constexpr const char* INVALID_LIST_VIEW       = "invalidListView";
+	constexpr const char* INVALID_RULE_SET        = "invalidRuleSet";
+	// in cluster mode, the error data is the URL of the node the match lives on
+	constexpr const char* GAME_ON_OTHER_SERVER    = "gameOnOtherServer";
+}
+
+namespace RuleSetExt
+{
+	// the only one so far, used if a request doesn't name one
+	// TODO: replace with cyvasse::RuleSet once it exists
+	constexpr const char* DEFAULT = "default";
+}
+
+namespace SubscrGameListExt
+{
+	// besides ruleSet and color, see GamesListView
+	constexpr const char* TITLE_PREFIX = "titlePrefix";
+	constexpr const char* OFFSET       = "offset";
+	constexpr const char* COUNT        = "count";
+}
+
+namespace ListUpdateExt
+{
+	// only in the listUpdates of views
+	constexpr const char* OFFSET = "offset";
+	constexpr const char* MORE   = "more";
+}
+
+namespace CreateGameExt
+{
+	// see TimeControlExt, the match is untimed if it's not set
+	constexpr const char* TIME_CONTROL = "timeControl";
+	// true = play against a bot right away
+	constexpr const char* BOT = "bot";
+}
+
+namespace JoinGameExt
+{
+	// true = the client decodes GameStatusExt::BOARD, it gets that instead of PIECE_POSITIONS
+	constexpr const char* BOARD = "board";
+}
+
+namespace GameStatusExt
+{
+	// BoardSnapshot::getEncoded(), sent instead of PIECE_POSITIONS, see JoinGameExt
+	constexpr const char* BOARD = "board";
+	// see ClockStatusExt, only for matches with a time control
+	constexpr const char* CLOCKS = "clocks";
+}
+
+namespace GameMsgExt
+{
+	// param of move and moveCapture, see CoordJson
+	constexpr const char* OLD_POS = "oldPos";
+	constexpr const char* NEW_POS = "newPos";
+
+	// param of promote, the piece on pos becomes a newType
+	constexpr const char* POS      = "pos";
+	constexpr const char* NEW_TYPE = "newType";
+
+	constexpr const char* BOT_USERNAME = "Computer";
+}
+
+// {"base": seconds, "increment": seconds}
+namespace TimeControlExt
+{
+	constexpr const char* BASE      = "base";
+	constexpr const char* INCREMENT = "increment";
+}
+
+// {"white": ms, "black": ms, "toMove": color}
+namespace ClockStatusExt
+{
+	constexpr const char* WHITE   = "white";
+	constexpr const char* BLACK   = "black";
+	constexpr const char* TO_MOVE = "toMove";
+}
+
+namespace NotificationExt
+{
+	constexpr const char* TYPE   = "type";
+	constexpr const char* REASON = "reason";
+	constexpr const char* WINNER = "winner";
+	constexpr const char* CLOCKS = "clocks";
+
+	constexpr const char* GAME_ENDED    = "gameEnded";
+	constexpr const char* TIMEOUT       = "timeout";
+	constexpr const char* KING_CAPTURED = "kingCaptured";
+}
+
+// replies of the /archive/* HTTP resources, see ArchiveJson
+namespace ArchiveExt
+{
+	constexpr const char* MATCH_ID    = "matchID";
+	constexpr const char* FINISH_TIME = "finishTime";
+	constexpr const char* RESULT      = "result";
+	constexpr const char* WINNER      = "winner";
+	constexpr const char* PLAYERS     = "players";
+	constexpr const char* PLAYER_ID   = "playerID";
+	constexpr const char* USERNAME    = "username";
+	constexpr const char* OPENING     = "opening";
+	constexpr const char* MOVES       = "moves";
+
+	// values of RESULT
+	constexpr const char* ABANDONED     = "abandoned";
+	constexpr const char* TIMEOUT       = "timeout";
+	constexpr const char* KING_CAPTURED = "kingCaptured";
+}
+
+#endif // _PROTOCOL_EXT_HPP_
@@ -0,0 +1,263 @@
+/* Copyright 2015 Jonas Platte
+ *
+ * This file is part of Cyvasse Online.
+ *
+ * Cyvasse Online is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Affero General Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later version.
+ *
+ * Cyvasse Online is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE. See the GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License along with this program.
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "raw_json.hpp"
+
+#include <cctype>
+#include <cstring>
+
+using namespace std;
+
+constexpr size_t RawJsonObject::maxMembers;
+constexpr unsigned RawJsonObject::maxDepth;
+
+RawJsonObject::RawJsonObject(const string& json, size_t begin, size_t end)
+	: m_json(json)
+{
+	end = min(end, json.size());
+
+	size_t pos = skipWhitespace(begin, end);
+	if (pos == end || json[pos] != '{')
+		return;
+
+	m_begin = pos;
+	pos = skipWhitespace(pos + 1, end);
+
+	if (pos < end && json[pos] == '}')
+	{
+		m_valid = skipWhitespace(pos + 1, end) == end;
+		return;
+	}
+
+	while (pos < end)
+	{
+		if (m_size == maxMembers || json[pos] != '"')
+			return;
+
+		Member& member = m_members[m_size++];
+		member.keyBegin = pos + 1;
+
+		pos = skipString(pos, end);
+		if (pos == string::npos)
+			return;
+
+		member.keyEnd = pos - 1;
+
+		pos = skipWhitespace(pos, end);
+		if (pos == end || json[pos] != ':')
+			return;
+
+		member.valueBegin = skipWhitespace(pos + 1, end);
+		member.valueEnd   = skipValue(member.valueBegin, end, 1);
+		if (member.valueEnd == string::npos)
+			return;
+
+		pos = skipWhitespace(member.valueEnd, end);
+		if (pos == end)
+			return;
+
+		if (json[pos] == '}')
+		{
+			m_valid = skipWhitespace(pos + 1, end) == end;
+			return;
+		}
+
+		if (json[pos] != ',')
+			return;
+
+		pos = skipWhitespace(pos + 1, end);
+	}
+}
+
+size_t RawJsonObject::skipWhitespace(size_t pos, size_t end) const
+{
+	while (pos < end && (m_json[pos] == ' ' || m_json[pos] == '\t' || m_json[pos] == '\n' || m_json[pos] == '\r'))
+		pos++;
+
+	return pos;
+}
+
+size_t RawJsonObject::skipString(size_t pos, size_t end) const
+{
+	// pos is at the opening quote
+	for (pos++; pos < end; pos++)
+	{
+		auto c = static_cast<unsigned char>(m_json[pos]);
+
+		if (c == '"')
+			return pos + 1;
+
+		if (c < 0x20)
+			return string::npos;
+
+		if (c != '\\')
+			continue;
+
+		if (++pos == end)
+			return string::npos;
+
+		if (m_json[pos] == 'u')
+		{
+			for (int i = 0; i < 4; i++)
+				if (++pos == end || !isxdigit(static_cast<unsigned char>(m_json[pos])))
+					return string::npos;
+		}
+		else if (!strchr("\"\\/bfnrt", m_json[pos]) || m_json[pos] == '\0')
+			return string::npos;
+	}
+
+	return string::npos;
+}
+
+size_t RawJsonObject::skipNumber(size_t pos, size_t end) const
+{
+	auto isDigit = [&](size_t i) { return i < end && m_json[i] >= '0' && m_json[i] <= '9'; };
+	auto skipDigits = [&](size_t i) {
+		while (isDigit(i))
+			i++;
+		return i;
+	};
+
+	if (pos < end && m_json[pos] == '-')
+		pos++;
+
+	// no leading zeros
+	if (pos < end && m_json[pos] == '0')
+		pos++;
+	else if (isDigit(pos))
+		pos = skipDigits(pos);
+	else
+		return string::npos;
+
+	if (pos < end && m_json[pos] == '.')
+	{
+		if (!isDigit(++pos))
+			return string::npos;
+
+		pos = skipDigits(pos);
+	}
+
+	if (pos < end && (m_json[pos] == 'e' || m_json[pos] == 'E'))
+	{
+		if (++pos < end && (m_json[pos] == '+' || m_json[pos] == '-'))
+			pos++;
+
+		if (!isDigit(pos))
+			return string::npos;
+
+		pos = skipDigits(pos);
+	}
+
+	return pos;
+}
+
+size_t RawJsonObject::skipLiteral(size_t pos, size_t end, const char* literal) const
+{
+	size_t len = strlen(literal);
+	if (end - pos < len || m_json.compare(pos, len, literal) != 0)
+		return string::npos;
+
+	return pos + len;
+}
+
+size_t RawJsonObject::skipContainer(size_t pos, size_t end, unsigned depth) const
+{
+	bool isObject = m_json[pos] == '{';
+	char closing = isObject ? '}' : ']';
+
+	pos = skipWhitespace(pos + 1, end);
+	if (pos < end && m_json[pos] == closing)
+		return pos + 1;
+
+	while (pos < end)
+	{
+		if (isObject)
+		{
+			if (m_json[pos] != '"')
+				return string::npos;
+
+			pos = skipWhitespace(skipString(pos, end), end);
+			if (pos >= end || m_json[pos] != ':')
+				return string::npos;
+
+			pos = skipWhitespace(pos + 1, end);
+		}
+
+		pos = skipValue(pos, end, depth + 1);
+		if (pos == string::npos)
+			return pos;
+
+		pos = skipWhitespace(pos, end);
+		if (pos == end)
+			return string::npos;
+
+		if (m_json[pos] == closing)
+			return pos + 1;
+
+		if (m_json[pos] != ',')
+			return string::npos;
+
+		pos = skipWhitespace(pos + 1, end);
+	}
+
+	return string::npos;
+}
+
+size_t RawJsonObject::skipValue(size_t pos, size_t end, unsigned depth) const
+{
+	if (pos >= end || depth > maxDepth)
+		return string::npos;
+
+	switch (m_json[pos])
+	{
+		case '"': return skipString(pos, end);
+		case '{':
+		case '[': return skipContainer(pos, end, depth);
+		case 't': return skipLiteral(pos, end, "true");
+		case 'f': return skipLiteral(pos, end, "false");
+		case 'n': return skipLiteral(pos, end, "null");
+		default:  return skipNumber(pos, end);
+	}
+}
+
+auto RawJsonObject::find(const char* key) const -> const Member*
+{
+	size_t keyLen = strlen(key);
+
+	for (size_t i = 0; i < m_size; i++)
+	{
+		const Member& member = m_members[i];
+		if (member.keyEnd - member.keyBegin == keyLen && m_json.compare(member.keyBegin, keyLen, key) == 0)
+			return &member;
+	}
+
+	return nullptr;
+}
+
+bool RawJsonObject::getString(const char* key, string& value) const
+{
+	const Member* member = find(key);
+	if (!member || m_json[member->valueBegin] != '"')
+		return false;
+
+	size_t begin = member->valueBegin + 1;
+	size_t len   = member->valueEnd - 1 - begin;
+
+	if (m_json.find('\\', begin) < begin + len)
+		return false;
+
+	value.assign(m_json, begin, len);
+	return true;
+}
@@ -0,0 +1,79 @@
+/* Copyright 2015 Jonas Platte
+ *
+ * This file is part of Cyvasse Online.
+ *
+ * Cyvasse Online is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Affero General Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later version.
+ *
+ * Cyvasse Online is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE. See the GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License along with this program.
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef _RAW_JSON_HPP_
+#define _RAW_JSON_HPP_
+
+#include <array>
+#include <string>
+#include <cstddef>
+
+// Looks at the members of a JSON object in place, without parsing it into a
+// Json::Value. Used to relay messages the server doesn't need to understand,
+// so anything that isn't valid JSON (RFC 8259) makes the object invalid and
+// callers fall back to a full parse, which rejects it. Values nested deeper
+// than maxDepth are treated as invalid as well. Keys are compared without
+// unescaping them, so a key with escapes in it is simply not found.
+class RawJsonObject
+{
+	public:
+		static constexpr size_t maxMembers = 8;
+		static constexpr unsigned maxDepth = 32;
+
+		struct Member
+		{
+			size_t keyBegin, keyEnd;     // without the quotes
+			size_t valueBegin, valueEnd;
+		};
+
+	private:
+		const std::string& m_json;
+
+		std::array<Member, maxMembers> m_members;
+		size_t m_size = 0;
+
+		size_t m_begin = 0; // position of the '{'
+		bool m_valid = false;
+
+		size_t skipWhitespace(size_t pos, size_t end) const;
+		// all of them return the position after the value, or npos if it's malformed
+		size_t skipValue(size_t pos, size_t end, unsigned depth) const;
+		size_t skipString(size_t pos, size_t end) const;
+		size_t skipNumber(size_t pos, size_t end) const;
+		size_t skipLiteral(size_t pos, size_t end, const char* literal) const;
+		// an object or array, pos is at the opening bracket
+		size_t skipContainer(size_t pos, size_t end, unsigned depth) const;
+
+	public:
+		// scans the object in json[begin, end), which may be surrounded by whitespace;
+		// the object is treated as invalid if it has more than maxMembers members
+		explicit RawJsonObject(const std::string& json, size_t begin = 0, size_t end = std::string::npos);
+
+		bool valid() const
+		{ return m_valid; }
+
+		bool empty() const
+		{ return m_size == 0; }
+
+		size_t getBegin() const
+		{ return m_begin; }
+
+		const Member* find(const char* key) const;
+
+		// only succeeds for string values without escapes
+		bool getString(const char* key, std::string& value) const;
+};
+
+#endif // _RAW_JSON_HPP_
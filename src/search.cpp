@@ -0,0 +1,310 @@
+/* Copyright 2015 Jonas Platte
+ *
+ * This file is part of Cyvasse Online.
+ *
+ * Cyvasse Online is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Affero General Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later version.
+ *
+ * Cyvasse Online is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE. See the GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License along with this program.
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "search.hpp"
+
+#include <algorithm>
+#include <mutex>
+
+using namespace std;
+
+namespace
+{
+	constexpr int infinity  = 32000;
+	constexpr int mateScore = 30000;
+
+	// the clock is only looked at every this many nodes
+	constexpr uint64_t nodesPerCheck = 1024;
+
+	thread_local uint64_t t_nodes = 0;
+
+	uint64_t packEntry(const TranspositionTable::Entry& entry)
+	{
+		return uint64_t(uint16_t(int16_t(entry.score)))
+			| uint64_t(uint8_t(entry.depth)) << 16
+			| uint64_t(entry.bound) << 24
+			| uint64_t(entry.move) << 32;
+	}
+
+	TranspositionTable::Entry unpackEntry(uint64_t data)
+	{
+		return TranspositionTable::Entry {
+			int16_t(data & 0xFFFF),
+			int(uint8_t(data >> 16)),
+			TranspositionTable::Bound(uint8_t(data >> 24)),
+			uint16_t(data >> 32)
+		};
+	}
+}
+
+TranspositionTable::TranspositionTable(size_t bytes)
+{
+	size_t nSlots = 1;
+	while (nSlots * 2 * sizeof(Slot) <= bytes)
+		nSlots *= 2;
+
+	m_slots.reset(new Slot[nSlots]);
+	m_mask = nSlots - 1;
+
+	for (size_t i = 0; i < nSlots; i++)
+	{
+		m_slots[i].key  = 0;
+		m_slots[i].data = 0;
+	}
+}
+
+bool TranspositionTable::probe(uint64_t hash, Entry& entry) const
+{
+	const auto& slot = m_slots[hash & m_mask];
+
+	auto data = slot.data.load(memory_order_relaxed);
+	if ((slot.key.load(memory_order_relaxed) ^ data) != hash || data == 0)
+		return false;
+
+	entry = unpackEntry(data);
+	return true;
+}
+
+void TranspositionTable::store(uint64_t hash, const Entry& entry)
+{
+	auto& slot = m_slots[hash & m_mask];
+
+	// keep deeper results of the same position
+	Entry old;
+	if (probe(hash, old) && old.depth > entry.depth)
+		return;
+
+	auto data = packEntry(entry);
+	slot.key.store(hash ^ data, memory_order_relaxed);
+	slot.data.store(data, memory_order_relaxed);
+}
+
+struct BotEngine::Search
+{
+	Clock::time_point deadline;
+	atomic_bool stop = {false};
+	atomic<uint64_t> nodes = {0};
+
+	// best score of the current iteration, the lower bound of the root tasks
+	atomic<int> alpha = {-infinity};
+	mutex bestMtx;
+};
+
+BotEngine::BotEngine(const BotConfig& config)
+	: m_config(config)
+	, m_tt(config.hashSize)
+	, m_pool(config.threads)
+{ }
+
+int BotEngine::negamax(Search& search, Position& pos, int depth, int ply, int alpha, int beta)
+{
+	if (pos.isLost())
+		return -mateScore + ply;
+
+	if (depth == 0)
+		return pos.evaluate();
+
+	if (++t_nodes % nodesPerCheck == 0)
+	{
+		search.nodes += nodesPerCheck;
+		if (Clock::now() >= search.deadline)
+			search.stop = true;
+	}
+
+	if (search.stop)
+		return 0;
+
+	const int origAlpha = alpha;
+
+	TranspositionTable::Entry entry;
+	uint16_t ttMove = 0;
+
+	if (m_tt.probe(pos.getHash(), entry))
+	{
+		ttMove = entry.move;
+
+		if (entry.depth >= depth)
+		{
+			if (entry.bound == TranspositionTable::EXACT)
+				return entry.score;
+			else if (entry.bound == TranspositionTable::LOWER)
+				alpha = max(alpha, entry.score);
+			else
+				beta = min(beta, entry.score);
+
+			if (alpha >= beta)
+				return entry.score;
+		}
+	}
+
+	Position::MoveList moves;
+	pos.generateMoves(moves);
+
+	if (moves.size == 0)
+		return 0;
+
+	// the best move of an earlier search first, then captures
+	auto first = moves.begin();
+	if (ttMove)
+	{
+		auto it = find(moves.begin(), moves.end(), Position::Move::unpack(ttMove));
+		if (it != moves.end())
+			iter_swap(first++, it);
+	}
+
+	partition(first, moves.end(), [&](const Position::Move& move) {
+		return pos.getTile(move.to) != BoardSnapshot::emptyTile;
+	});
+
+	int best = -infinity;
+	Position::Move bestMove = moves.moves[0];
+
+	for (auto move : moves)
+	{
+		auto captured = pos.make(move);
+		int score = -negamax(search, pos, depth - 1, ply + 1, -beta, -alpha);
+		pos.unmake(move, captured);
+
+		if (search.stop)
+			return 0;
+
+		if (score > best)
+		{
+			best = score;
+			bestMove = move;
+		}
+
+		if (best > alpha)
+			alpha = best;
+
+		if (alpha >= beta)
+			break;
+	}
+
+	auto bound = best <= origAlpha ? TranspositionTable::UPPER
+		: best >= beta ? TranspositionTable::LOWER
+		: TranspositionTable::EXACT;
+
+	m_tt.store(pos.getHash(), {best, depth, bound, bestMove.pack()});
+	return best;
+}
+
+bool BotEngine::searchRoot(Search& search, const Position& root, Position::MoveList& rootMoves, int depth,
+	int& bestScore, Position::Move& best)
+{
+	auto scoreMove = [&](Position& pos, Position::Move move, int alpha) {
+		auto captured = pos.make(move);
+		int score = -negamax(search, pos, depth - 1, 1, -infinity, -alpha);
+		pos.unmake(move, captured);
+		return score;
+	};
+
+	// the first move is the best one of the last iteration, searching
+	// it alone gives the others a good bound to be cut off with
+	{
+		Position pos = root;
+		bestScore = scoreMove(pos, rootMoves.moves[0], -infinity);
+		best = rootMoves.moves[0];
+	}
+
+	if (search.stop)
+		return false;
+
+	search.alpha = bestScore;
+	atomic<size_t> next = {1};
+
+	auto searchRest = [&] {
+		Position pos = root;
+
+		for (size_t i; !search.stop && (i = next++) < rootMoves.size; )
+		{
+			int alpha = search.alpha;
+			int score = scoreMove(pos, rootMoves.moves[i], alpha);
+
+			if (search.stop || score <= alpha)
+				continue;
+
+			lock_guard<mutex> lock(search.bestMtx);
+			if (score > bestScore)
+			{
+				bestScore = score;
+				best = rootMoves.moves[i];
+				search.alpha = score;
+			}
+		}
+	};
+
+	WorkStealingPool::TaskGroup group;
+	for (unsigned i = 1; i < m_config.threadsPerGame && i < rootMoves.size; i++)
+		m_pool.post(group, searchRest);
+
+	searchRest();
+	m_pool.wait(group);
+
+	return !search.stop;
+}
+
+void BotEngine::search(const Position& pos, const Position::MoveList& legalMoves, Clock::duration budget,
+	ResultCallback done)
+{
+	m_stats.searches++;
+
+	auto deadline = Clock::now() + min<Clock::duration>(budget, m_config.moveTime);
+
+	m_pool.post([this, pos, legalMoves, deadline, done] {
+		Search search;
+		search.deadline = deadline;
+
+		Position root = pos;
+		Position::MoveList rootMoves = legalMoves;
+
+		if (rootMoves.size == 0)
+		{
+			done(false, Position::Move{0, 0});
+			return;
+		}
+
+		Position::Move best = rootMoves.moves[0];
+		unsigned completedDepth = 0;
+
+		for (unsigned depth = 1; depth <= m_config.maxDepth; depth++)
+		{
+			if (depth > 1 && Clock::now() >= deadline)
+				break;
+
+			int score;
+			Position::Move iterationBest;
+
+			// the result of an interrupted iteration is thrown away
+			if (!searchRoot(search, root, rootMoves, depth, score, iterationBest))
+				break;
+
+			best = iterationBest;
+			completedDepth = depth;
+
+			iter_swap(rootMoves.begin(), find(rootMoves.begin(), rootMoves.end(), best));
+
+			// a won game doesn't get any better by searching deeper
+			if (score >= mateScore - int(m_config.maxDepth))
+				break;
+		}
+
+		m_stats.nodes += search.nodes;
+		m_stats.depthSum += completedDepth;
+
+		done(true, best);
+	});
+}
@@ -0,0 +1,128 @@
+/* Copyright 2015 Jonas Platte
+ *
+ * This file is part of Cyvasse Online.
+ *
+ * Cyvasse Online is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Affero General Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later version.
+ *
+ * Cyvasse Online is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE. See the GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License along with this program.
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _SEARCH_HPP_
+#define _SEARCH_HPP_
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <cstdint>
+#include "position.hpp"
+#include "server_config.hpp"
+#include "work_stealing_pool.hpp"
+
+// Shared by all searches of the server, entries are written without a lock.
+// The key is stored xor'ed with the data, so an entry that two threads wrote
+// at the same time doesn't match either of their keys and is ignored.
+class TranspositionTable
+{
+	public:
+		enum Bound : uint8_t
+		{
+			EXACT,
+			LOWER, // failed high, the score is at least this
+			UPPER  // failed low, the score is at most this
+		};
+
+		struct Entry
+		{
+			int score;
+			int depth;
+			Bound bound;
+			uint16_t move; // Position::Move::pack(), 0 = none
+		};
+
+	private:
+		struct Slot
+		{
+			std::atomic<uint64_t> key;
+			std::atomic<uint64_t> data;
+		};
+
+		std::unique_ptr<Slot[]> m_slots;
+		size_t m_mask;
+
+	public:
+		// rounded down to a power of two slots
+		explicit TranspositionTable(size_t bytes);
+
+		bool probe(uint64_t hash, Entry&) const;
+		void store(uint64_t hash, const Entry&);
+
+		size_t getBytes() const
+		{ return (m_mask + 1) * sizeof(Slot); }
+};
+
+// Picks the moves of the bots: an iterative deepening alpha-beta search per
+// move on a WorkStealingPool. Below the first root move, the root moves are
+// split between up to threadsPerGame tasks that share the best score so far
+// and the transposition table.
+class BotEngine
+{
+	public:
+		typedef std::chrono::steady_clock Clock;
+
+		// found is false if the side to move has no moves left
+		typedef std::function<void(bool found, Position::Move)> ResultCallback;
+
+		struct Stats
+		{
+			std::atomic<uint64_t> searches = {0};
+			std::atomic<uint64_t> nodes    = {0};
+			std::atomic<uint64_t> depthSum = {0};
+		};
+
+	private:
+		const BotConfig m_config;
+
+		TranspositionTable m_tt;
+		Stats m_stats;
+
+		// last, its threads use the other members
+		WorkStealingPool m_pool;
+
+		struct Search;
+
+		int negamax(Search&, Position&, int depth, int ply, int alpha, int beta);
+		// returns false if the search was stopped before all root moves were searched
+		bool searchRoot(Search&, const Position& root, Position::MoveList& rootMoves, int depth,
+			int& bestScore, Position::Move& best);
+
+	public:
+		explicit BotEngine(const BotConfig&);
+
+		const BotConfig& getConfig() const
+		{ return m_config; }
+
+		// Returns immediately, done is called from a pool thread when the time
+		// budget (at most the configured moveTime) is used or maxDepth reached.
+		// The result is one of rootMoves, see Position::legalMoves().
+		void search(const Position&, const Position::MoveList& rootMoves, Clock::duration budget,
+			ResultCallback done);
+
+		const Stats& getStats() const
+		{ return m_stats; }
+
+		const WorkStealingPool& getPool() const
+		{ return m_pool; }
+
+		const TranspositionTable& getTranspositionTable() const
+		{ return m_tt; }
+};
+
+#endif // _SEARCH_HPP_
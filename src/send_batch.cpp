@@ -0,0 +1,159 @@
+/* Copyright 2015 Jonas Platte
+ *
+ * This file is part of Cyvasse Online.
+ *
+ * Cyvasse Online is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Affero General Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later version.
+ *
+ * Cyvasse Online is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE. See the GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License along with this program.
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "send_batch.hpp"
+
+#include "trace.hpp"
+
+using namespace std;
+using namespace websocketpp;
+
+namespace
+{
+	thread_local SendBatch* currentBatch = nullptr;
+
+	// RFC 6455 5.2, unmasked since frames from the server aren't masked.
+	// permessage-deflate isn't enabled, so the payload is sent as it is.
+	void appendFrame(string& out, const string& payload)
+	{
+		const size_t size = payload.size();
+
+		out += char(0x80 | frame::opcode::text); // FIN
+
+		if (size < 126)
+			out += char(size);
+		else if (size <= 0xFFFF)
+		{
+			out += char(126);
+			out += char(size >> 8);
+			out += char(size & 0xFF);
+		}
+		else
+		{
+			out += char(127);
+			for (int shift = 56; shift >= 0; shift -= 8)
+				out += char((uint64_t(size) >> shift) & 0xFF);
+		}
+
+		out += payload;
+	}
+}
+
+SendBatch::SendBatch(SharedServerData& data)
+	: m_data(data)
+	, m_active(!currentBatch)
+{
+	if (m_active)
+		currentBatch = this;
+}
+
+SendBatch::~SendBatch()
+{
+	if (!m_active)
+		return;
+
+	currentBatch = nullptr;
+	flush();
+}
+
+bool SendBatch::add(connection_hdl hdl, const string& data)
+{
+	if (!currentBatch)
+		return false;
+
+	currentBatch->m_frames[hdl].push_back(data);
+
+	// a worker job only has one, so checking the last is enough
+	auto& traceIDs = currentBatch->m_traceIDs;
+	auto traceID = Tracer::current();
+	if (traceID && (traceIDs.empty() || traceIDs.back() != traceID))
+		traceIDs.push_back(traceID);
+
+	return true;
+}
+
+void SendBatch::flush()
+{
+	for (auto& it : m_frames)
+		send(m_data, it.first, it.second);
+
+	m_frames.clear();
+
+	for (auto traceID : m_traceIDs)
+		Tracer::record(traceID, TraceStage::SENT);
+
+	m_traceIDs.clear();
+}
+
+void SendBatch::send(SharedServerData& data, connection_hdl hdl, const string& text)
+{
+	data.counters.framesSent++;
+	data.counters.writes++;
+
+	// sending can fail, but that's not a good reason to crash!
+	// maybe we should log when this happens, but for now it's
+	// only important that it doesn't kill the whole server.
+	try
+	{
+		data.wsServer->send(hdl, text, frame::opcode::text);
+	}
+	catch(std::exception& e)
+	{ }
+}
+
+void SendBatch::send(SharedServerData& data, connection_hdl hdl, vector<string>& frames)
+{
+	if (frames.size() == 1)
+	{
+		send(data, hdl, frames.front());
+		return;
+	}
+
+	auto con = data.getConnection(hdl);
+	if (!con)
+		return;
+
+	// the frames are only built here for RFC 6455 connections
+	if (con->get_request_header("Sec-WebSocket-Version") != "13")
+	{
+		for (const auto& text : frames)
+			send(data, hdl, text);
+
+		return;
+	}
+
+	size_t size = 0;
+	for (const auto& text : frames)
+		size += text.size() + 10; // the longest header
+
+	// a prepared message is written as it is, header and payload
+	auto msg = con->get_message(frame::opcode::text, size);
+	auto& payload = msg->get_raw_payload();
+	payload.reserve(size);
+
+	for (const auto& text : frames)
+		appendFrame(payload, text);
+
+	msg->set_header(string());
+	msg->set_prepared(true);
+
+	data.counters.framesSent += frames.size();
+	data.counters.writes++;
+	data.counters.coalescedWrites++;
+
+	con->send(msg);
+}
@@ -0,0 +1,67 @@
+/* Copyright 2015 Jonas Platte
+ *
+ * This file is part of Cyvasse Online.
+ *
+ * Cyvasse Online is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Affero General Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later version.
+ *
+ * Cyvasse Online is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE. See the GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License along with this program.
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef _SEND_BATCH_HPP_
+#define _SEND_BATCH_HPP_
+
+#include <map>
+#include <string>
+#include <vector>
+#include "shared_server_data.hpp"
+
+// Holds back the frames CyvasseServer::send is called with on this thread
+// while the batch exists (a worker job, an I/O tick). When the outermost
+// batch ends, the frames of each connection are framed here and handed to
+// websocketpp as one prepared message, which it writes in a single
+// vectored write together with its own queued frames. Without it every
+// frame is its own write if the socket is idle, so e.g. a requestSuccess
+// followed by two listUpdates took three syscalls and TCP segments.
+//
+// Batches can be nested, only the outermost one does anything. Frames
+// for one connection keep their order, frames for different connections
+// are sent in no particular order.
+class SendBatch
+{
+	private:
+		typedef std::map<connection_hdl, std::vector<std::string>, std::owner_less<connection_hdl>> FrameMap;
+
+		SharedServerData& m_data;
+		bool m_active;
+
+		FrameMap m_frames;
+		// the traces the frames belong to, see Tracer::current()
+		std::vector<uint64_t> m_traceIDs;
+
+		void flush();
+
+	public:
+		explicit SendBatch(SharedServerData&);
+		~SendBatch();
+
+		SendBatch(const SendBatch&) = delete;
+		SendBatch& operator=(const SendBatch&) = delete;
+
+		// returns false if there is no batch on this thread,
+		// otherwise data is sent when the batch ends
+		static bool add(connection_hdl, const std::string& data);
+
+		// sends the frames right away, joined into one message if there are several
+		static void send(SharedServerData&, connection_hdl, std::vector<std::string>& frames);
+		static void send(SharedServerData&, connection_hdl, const std::string& data);
+};
+
+#endif // _SEND_BATCH_HPP_
@@ -0,0 +1,140 @@
+/* Copyright 2015 Jonas Platte
+ *
+ * This file is part of Cyvasse Online.
+ *
+ * Cyvasse Online is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Affero General Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later version.
+ *
+ * Cyvasse Online is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE. See the GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License along with this program.
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "server_config.hpp"
+
+#include <stdexcept>
+#include <yaml-cpp/yaml.h>
+
+using namespace std;
+using namespace std::chrono;
+
+ServerConfig::ServerConfig(const YAML::Node& config)
+{
+	listenPort = config["listenPort"].as<uint16_t>(listenPort);
+	nWorkers   = config["workers"].as<unsigned>(nWorkers);
+
+	ioUringAccept = config["ioUringAccept"].as<bool>(ioUringAccept);
+
+	pingInterval     = seconds(config["pingInterval"].as<unsigned>(pingInterval.count()));
+	pongTimeout      = milliseconds(config["pongTimeout"].as<unsigned>(pongTimeout.count()));
+	lobbyIdleTimeout = seconds(config["lobbyIdleTimeout"].as<unsigned>(lobbyIdleTimeout.count()));
+	matchIdleTimeout = seconds(config["matchIdleTimeout"].as<unsigned>(matchIdleTimeout.count()));
+
+	blockingThreads = config["blockingThreads"].as<unsigned>(blockingThreads);
+
+	handoffDrainTimeout = seconds(config["handoffDrainTimeout"].as<unsigned>(handoffDrainTimeout.count()));
+
+	traceSampleRate = config["traceSampleRate"].as<unsigned>(traceSampleRate);
+	adminToken      = config["adminToken"].as<string>(adminToken);
+
+	logLevel = config["logLevel"].as<string>(logLevel);
+	logFile  = config["logFile"].as<string>(logFile);
+
+	captureFile = config["captureFile"].as<string>(captureFile);
+
+	archiveFile    = config["archiveFile"].as<string>(archiveFile);
+	archiveMaxSize = config["archiveMaxSizeMB"].as<size_t>(archiveMaxSize >> 20) << 20;
+
+	memoryBudget          = config["memoryBudgetMB"].as<size_t>(memoryBudget >> 20) << 20;
+	memoryBudgetSoftLimit = config["memoryBudgetSoftLimit"].as<unsigned>(memoryBudgetSoftLimit);
+
+	if (auto clusterConfig = config["cluster"])
+	{
+		cluster.nodeBits   = clusterConfig["nodeBits"].as<unsigned>();
+		cluster.nodeID     = clusterConfig["nodeID"].as<unsigned>();
+		cluster.socketPath = clusterConfig["socket"].as<string>();
+
+		for (const auto& node : clusterConfig["nodes"])
+			cluster.nodes.push_back({node["id"].as<unsigned>(), node["socket"].as<string>(), node["url"].as<string>()});
+
+		if (cluster.nodeBits == 0 || cluster.nodeBits > 8)
+			throw invalid_argument("cluster.nodeBits has to be between 1 and 8");
+		if (cluster.nodeID >= (1u << cluster.nodeBits))
+			throw invalid_argument("cluster.nodeID doesn't fit into cluster.nodeBits");
+	}
+
+	if (auto listenConfig = config["listen"])
+	{
+		for (const auto& node : listenConfig)
+		{
+			ListenConfig endpoint;
+			endpoint.port    = node["port"].as<uint16_t>(endpoint.port);
+			endpoint.path    = node["unix"].as<string>(endpoint.path);
+			endpoint.backlog = node["backlog"].as<int>(endpoint.backlog);
+
+			// a string, YAML doesn't have octal numbers with a leading 0
+			if (auto mode = node["mode"])
+			{
+				auto str = mode.as<string>();
+				// setuid / setgid / sticky bits don't mean anything for a socket
+				if (str.empty() || str.size() > 4 || str.find_first_not_of("01234567") != string::npos ||
+					stoul(str, nullptr, 8) > 0777)
+					throw invalid_argument("listen mode has to be an octal number up to 777");
+
+				endpoint.mode = stoul(str, nullptr, 8);
+			}
+
+			if (endpoint.isUnix() == (endpoint.port != 0))
+				throw invalid_argument("every listen entry needs either a port or a unix socket path");
+			if (endpoint.backlog < 0)
+				throw invalid_argument("listen backlog can't be negative");
+
+			listen.push_back(endpoint);
+		}
+
+		if (listen.empty())
+			throw invalid_argument("the listen section can't be empty");
+	}
+	else
+	{
+		listen.emplace_back();
+		listen.back().port = listenPort;
+	}
+
+	if (auto tlsConfig = config["tls"])
+	{
+		tls.certificateChain = tlsConfig["certificate"].as<string>();
+		tls.privateKey       = tlsConfig["privateKey"].as<string>();
+		tls.sessionTickets   = tlsConfig["sessionTickets"].as<bool>(tls.sessionTickets);
+		tls.sessionCacheSize = tlsConfig["sessionCacheSize"].as<size_t>(tls.sessionCacheSize);
+		tls.sessionTimeout   = seconds(tlsConfig["sessionTimeout"].as<unsigned>(tls.sessionTimeout.count()));
+	}
+
+	if (auto botConfig = config["bot"])
+	{
+		bot.threads        = botConfig["threads"].as<unsigned>(bot.threads);
+		bot.threadsPerGame = botConfig["threadsPerGame"].as<unsigned>(bot.threadsPerGame);
+		bot.moveTime       = milliseconds(botConfig["moveTime"].as<unsigned>(bot.moveTime.count()));
+		bot.maxDepth       = botConfig["maxDepth"].as<unsigned>(bot.maxDepth);
+		bot.hashSize       = botConfig["hashSizeMB"].as<size_t>(bot.hashSize >> 20) << 20;
+		bot.joinTimeout    = seconds(botConfig["joinTimeout"].as<unsigned>(bot.joinTimeout.count()));
+
+		if (bot.threadsPerGame == 0)
+			throw invalid_argument("bot.threadsPerGame has to be at least 1");
+		if (bot.maxDepth == 0 || bot.maxDepth > 64)
+			throw invalid_argument("bot.maxDepth has to be between 1 and 64");
+	}
+
+	if (nWorkers == 0)
+		throw invalid_argument("workers has to be at least 1");
+	if (pingInterval.count() == 0)
+		throw invalid_argument("pingInterval can't be 0");
+	if (blockingThreads == 0)
+		throw invalid_argument("blockingThreads has to be at least 1");
+	if (memoryBudgetSoftLimit == 0 || memoryBudgetSoftLimit > 100)
+		throw invalid_argument("memoryBudgetSoftLimit has to be between 1 and 100");
+}
@@ -0,0 +1,192 @@
+/* Copyright 2015 Jonas Platte
+ *
+ * This file is part of Cyvasse Online.
+ *
+ * Cyvasse Online is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Affero General Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later version.
+ *
+ * Cyvasse Online is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE. See the GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License along with this program.
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _SERVER_CONFIG_HPP_
+#define _SERVER_CONFIG_HPP_
+
+#include <chrono>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+namespace YAML { class Node; }
+
+struct ClusterNode
+{
+	unsigned id;
+
+	// unix socket the node accepts cluster connections on
+	std::string socketPath;
+	// where clients are redirected to when they try to join a game on this node
+	std::string publicUrl;
+};
+
+// In cluster mode the highest nodeBits bits of every 24-bit match ID are the
+// ID of the node the match lives on, the random games lists are shared
+// between all nodes (see ClusterLink).
+struct ClusterConfig
+{
+	unsigned nodeBits = 0; // 0 = no cluster
+	unsigned nodeID   = 0;
+
+	std::string socketPath;
+	std::vector<ClusterNode> nodes; // without this one
+
+	bool enabled() const
+	{ return nodeBits != 0; }
+
+	uint32_t makeMatchID(uint32_t random24) const
+	{
+		if (!enabled())
+			return random24;
+
+		return (nodeID << (24 - nodeBits)) | (random24 & ((1u << (24 - nodeBits)) - 1));
+	}
+
+	unsigned nodeOf(uint32_t matchID) const
+	{ return enabled() ? matchID >> (24 - nodeBits) : nodeID; }
+
+	const ClusterNode* findNode(unsigned id) const
+	{
+		for (const auto& node : nodes)
+			if (node.id == id)
+				return &node;
+
+		return nullptr;
+	}
+};
+
+// only used by builds configured with --enable-tls (see tls.hpp)
+struct TlsConfig
+{
+	std::string certificateChain; // PEM, the server's certificate first
+	std::string privateKey;       // PEM
+
+	// both let returning clients skip the full handshake: tickets keep the
+	// session state on the client, the cache keeps it in the server (0 = off)
+	bool sessionTickets     = true;
+	size_t sessionCacheSize = 20480;
+	std::chrono::seconds sessionTimeout = std::chrono::seconds(3600);
+
+	bool enabled() const
+	{ return !certificateChain.empty(); }
+};
+
+// computer opponents (see BotEngine)
+struct BotConfig
+{
+	// threads of the search pool, 0 = no bots
+	unsigned threads = 0;
+	// tasks that search the moves of one game in parallel
+	unsigned threadsPerGame = 1;
+
+	// strength: the search of a move stops after moveTime or maxDepth plies
+	std::chrono::milliseconds moveTime = std::chrono::milliseconds(1000);
+	unsigned maxDepth = 6;
+
+	// transposition table shared by all games, in bytes
+	size_t hashSize = 16 << 20;
+
+	// a bot takes the open seat of random games nobody joined after this, 0 = never
+	std::chrono::seconds joinTimeout = std::chrono::seconds(0);
+
+	bool enabled() const
+	{ return threads != 0; }
+};
+
+// a socket the server accepts connections on (see Listener)
+struct ListenConfig
+{
+	// TCP on all interfaces, used if path is empty
+	uint16_t port = 0;
+
+	// a unix domain socket, for a reverse proxy on the same machine.
+	// A stale socket file at path is replaced.
+	std::string path;
+	unsigned mode = 0660; // permissions of the socket file
+
+	// 0 = SOMAXCONN
+	int backlog = 0;
+
+	bool isUnix() const
+	{ return !path.empty(); }
+};
+
+struct ServerConfig
+{
+	// only used if there is no listen section
+	uint16_t listenPort = 2516;
+	unsigned nWorkers   = 1;
+
+	std::vector<ListenConfig> listen;
+
+	// accept connections with io_uring if the kernel supports it (see Listener),
+	// the connections themselves are still read and written by asio
+	bool ioUringAccept = false;
+
+	// every connection is pinged this often and closed if it
+	// doesn't answer within pongTimeout (must be non-zero)
+	std::chrono::seconds pingInterval     = std::chrono::seconds(30);
+	std::chrono::milliseconds pongTimeout = std::chrono::milliseconds(5000);
+
+	// how long a client may stay silent while it is waiting for an
+	// opponent in the random games list or playing a match, 0 = forever
+	std::chrono::seconds lobbyIdleTimeout = std::chrono::seconds(600);
+	std::chrono::seconds matchIdleTimeout = std::chrono::seconds(1800);
+
+	// how long the old process keeps serving running matches after handing
+	// the listening socket to a new one (see CyvasseServer::handOff)
+	std::chrono::seconds handoffDrainTimeout = std::chrono::seconds(3600);
+
+	ClusterConfig cluster;
+
+	TlsConfig tls;
+
+	BotConfig bot;
+
+	// threads for blocking calls (database access, archive writes, waiting for
+	// the new process in a handoff), see async.hpp. Has to be at least 1.
+	unsigned blockingThreads = 2;
+
+	// trace every nth message, 0 = tracing disabled (see trace.hpp)
+	unsigned traceSampleRate = 0;
+
+	// required as a bearer token by the admin HTTP resources, empty = they are disabled
+	std::string adminToken;
+
+	// debug, info, warning or error (see logger.hpp)
+	std::string logLevel = "info";
+	// empty = stderr
+	std::string logFile;
+
+	// record all traffic to this file for cyvasse-replay, empty = disabled
+	std::string captureFile;
+
+	// finished matches are appended to this file, empty = disabled (see match_archive.hpp)
+	std::string archiveFile;
+	size_t archiveMaxSize = size_t(1) << 30;
+
+	// new matches are refused once memoryBudgetSoftLimit percent of
+	// memoryBudget bytes are in use, 0 = no limit (see memory_budget.hpp)
+	size_t memoryBudget = 0;
+	unsigned memoryBudgetSoftLimit = 90;
+
+	ServerConfig() = default;
+	// keys that are missing from the config file keep their default value
+	explicit ServerConfig(const YAML::Node&);
+};
+
+#endif // _SERVER_CONFIG_HPP_
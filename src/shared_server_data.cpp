@@ -16,15 +16,112 @@
 
 #include "shared_server_data.hpp"
 
+#include "client_data.hpp"
+
 using namespace std;
 
+void SharedServerData::queueJob(ConnectionData& con, Job job)
+{
+	{
+		lock_guard<mutex> lock(con.jobsMtx);
+
+		if (con.jobActive)
+		{
+			con.pendingJobs.push(move(job));
+			return;
+		}
+
+		con.jobActive = true;
+	}
+
+	queueContinuation(move(job));
+}
+
+void SharedServerData::queueContinuation(Job job)
+{
+	{
+		lock_guard<mutex> lock(jobMtx);
+		jobQueue.push(move(job));
+	}
+
+	jobCond.notify_one();
+}
+
+void SharedServerData::jobDone(connection_hdl hdl)
+{
+	auto con = getConnection(hdl);
+	if (!con)
+		return;
+
+	unique_lock<mutex> lock(con->jobsMtx);
+
+	if (con->pendingJobs.empty())
+	{
+		con->jobActive = false;
+		return;
+	}
+
+	auto next = move(con->pendingJobs.front());
+	con->pendingJobs.pop();
+
+	lock.unlock();
+
+	// goes to the back of the queue, so one busy client can't starve the others
+	queueContinuation(move(next));
+}
+
+auto SharedServerData::getConnection(connection_hdl hdl) -> WSServer::connection_ptr
+{
+	websocketpp::lib::error_code ec;
+	auto con = wsServer->get_con_from_hdl(hdl, ec);
+
+	if (ec)
+		return {};
+
+	return con;
+}
+
 auto SharedServerData::getClientData(connection_hdl hdl) -> shared_ptr<ClientData>
 {
-	lock_guard<mutex> clientDataLock(clientDataMtx);
+	auto con = getConnection(hdl);
+	if (!con)
+		return {};
+
+	return atomic_load(&con->clientData);
+}
+
+bool SharedServerData::setClientData(connection_hdl hdl, shared_ptr<ClientData> data)
+{
+	auto con = getConnection(hdl);
+	if (!con)
+		return false;
+
+	auto old = atomic_exchange(&con->clientData, data);
+	if (!old)
+		clientCount++;
+
+	// CyvasseServer::onClose may have taken the client data of the
+	// connection already, don't leave ours on it if it's closing
+	if (con->get_state() != websocketpp::session::state::open)
+	{
+		if (atomic_compare_exchange_strong(&con->clientData, &data, shared_ptr<ClientData>()))
+			clientCount--;
+
+		return false;
+	}
+
+	return true;
+}
+
+auto SharedServerData::takeClientData(connection_hdl hdl) -> shared_ptr<ClientData>
+{
+	auto con = getConnection(hdl);
+	if (!con)
+		return {};
 
-	auto it1 = clientData.find(hdl);
-	if (it1 != clientData.end())
-		return it1->second;
+	auto old = atomic_exchange(&con->clientData, shared_ptr<ClientData>());
+	if (old)
+		clientCount--;
 
-	return {};
+	return old;
 }
@@ -20,60 +20,186 @@
 #include <array>
 #include <atomic>
 #include <condition_variable>
+#include <functional>
 #include <memory>
 #include <mutex>
+#include <queue>
 #include <cyvws/notification.hpp>
+#include "games_list.hpp"
+#include "match_table.hpp"
+#include "memory_budget.hpp"
+#include "matchmaking_queue.hpp"
+#include "timer_wheel.hpp"
 
 #define _WEBSOCKETPP_CPP11_STL_
+#ifdef CYVASSE_TLS
+#include <websocketpp/config/asio.hpp>
+#else
 #include <websocketpp/config/asio_no_tls.hpp>
+#endif
 #include <websocketpp/server.hpp>
 #undef _WEBSOCKETPP_CPP11_STL_
 
-typedef websocketpp::server<websocketpp::config::asio> WSServer;
+// builds configured with --enable-tls only serve wss://, see tls.hpp
+#ifdef CYVASSE_TLS
+typedef websocketpp::config::asio_tls WSCoreConfig;
+#else
+typedef websocketpp::config::asio WSCoreConfig;
+#endif
 
 class ClientData;
 class MatchData;
+class Worker;
 
 using websocketpp::connection_hdl;
 
 struct Job
 {
+	typedef std::function<void(Worker&)> ContinuationFn;
+
 	connection_hdl conn_hdl;
-	WSServer::message_ptr msg_ptr;
+	WSCoreConfig::message_type::ptr msg_ptr; // = WSServer::message_ptr
+	uint64_t trace_id; // 0 if not traced, see trace.hpp
+
+	// set instead of msg_ptr for work the server queues itself (bot moves, ...)
+	ContinuationFn continuation;
+	unsigned msg_id = 0;
 
-	Job(connection_hdl connHdl, WSServer::message_ptr msgPtr)
+	Job(connection_hdl connHdl, WSCoreConfig::message_type::ptr msgPtr, uint64_t traceID = 0)
 		: conn_hdl(connHdl)
 		, msg_ptr(msgPtr)
+		, trace_id(traceID)
+	{ }
+
+	Job(connection_hdl connHdl, ContinuationFn fn, unsigned msgID, uint64_t traceID)
+		: conn_hdl(connHdl)
+		, trace_id(traceID)
+		, continuation(std::move(fn))
+		, msg_id(msgID)
 	{ }
 };
 
+// Per-connection state, websocketpp makes it a base class of the connection
+// so looking it up is only a weak_ptr lock instead of a map lookup
+struct ConnectionData
+{
+	// Only one job per connection is queued or handled at a time, so a
+	// client's messages are handled in order no matter how many workers there are.
+	// The others wait in here, see SharedServerData::queueJob / jobDone.
+	std::mutex jobsMtx;
+	std::queue<Job> pendingJobs;
+	bool jobActive = false;
+
+	// written by the worker that handles createGame / joinGame and read by all
+	// threads, so only access it through std::atomic_load / std::atomic_store
+	std::shared_ptr<ClientData> clientData;
+
+	// non-zero while the client waits in the matchmaking queue, see MatchmakingQueue
+	std::atomic<uint64_t> matchmakingTicket = {0};
+
+	// set in CyvasseServer::onOpen, identifies the connection in log records
+	uint64_t connID = 0;
+
+	// only accessed from the I/O thread
+	TimerWheel::Clock::time_point lastActivity;
+	TimerWheel::TimerID livenessTimer = 0;
+};
+
+struct WSConfig : public WSCoreConfig
+{
+	typedef WSCoreConfig core;
+
+	typedef core::concurrency_type concurrency_type;
+	typedef core::request_type request_type;
+	typedef core::response_type response_type;
+	typedef core::message_type message_type;
+	typedef core::con_msg_manager_type con_msg_manager_type;
+	typedef core::endpoint_msg_manager_type endpoint_msg_manager_type;
+	typedef core::alog_type alog_type;
+	typedef core::elog_type elog_type;
+	typedef core::rng_type rng_type;
+	typedef core::transport_type transport_type;
+	typedef core::endpoint_base endpoint_base;
+
+	typedef ConnectionData connection_base;
+};
+
+typedef websocketpp::server<WSConfig> WSServer;
+
 struct SharedServerData
 {
-	using ClientMap     = std::map<connection_hdl, std::shared_ptr<ClientData>, std::owner_less<connection_hdl>>;
-	using MatchMap      = std::map<std::string, std::shared_ptr<MatchData>>;
+	using MatchMap      = MatchTable<MatchData>;
 	using ConnectionSet = std::set<connection_hdl, std::owner_less<connection_hdl>>;
 
 	std::atomic_bool running = {true};
 	std::atomic_bool maintenance = {false};
 
+	// reported by the /stats http handler
+	struct Counters
+	{
+		std::atomic<uint64_t> idleLobbyEvictions = {0};
+		std::atomic<uint64_t> idleMatchEvictions = {0};
+		std::atomic<uint64_t> pingTimeouts       = {0};
+		std::atomic<uint64_t> matchmakingPairs   = {0};
+		std::atomic<uint64_t> memoryRefusals     = {0};
+		std::atomic<uint64_t> listUpdatesSent    = {0};
+
+		// counted by the continuation of the archive write, see CyvasseServer::archiveMatch
+		std::atomic<uint64_t> archivedMatches = {0};
+		std::atomic<uint64_t> archiveFailures = {0};
+
+		// see SendBatch, writes are messages handed to websocketpp
+		std::atomic<uint64_t> framesSent      = {0};
+		std::atomic<uint64_t> writes          = {0};
+		std::atomic<uint64_t> coalescedWrites = {0};
+	} counters;
+
 	std::queue<Job> jobQueue;
 
 	std::mutex jobMtx;
 	std::condition_variable jobCond;
 
-	ClientMap clientData;
-	MatchMap matchData;
+	// set by CyvasseServer, needed to get from a handle to its ConnectionData
+	WSServer* wsServer = nullptr;
+
+	std::atomic<size_t> clientCount = {0};
 
-	std::mutex clientDataMtx;
+	MemoryBudget memory;
+	std::atomic<uint64_t> nextConnID = {1};
+
+	MatchMap matchData;
 	std::mutex matchDataMtx;
 
-	std::array<cyvws::GamesListMap, 2> gameLists;
-	std::array<std::mutex, 2>          gameListsMtx;
+	// indexed by GamesListID
+	std::array<CachedGamesList, 2> gameLists {{
+		CachedGamesList(cyvws::GamesList::OPEN_RANDOM_GAMES),
+		CachedGamesList(cyvws::GamesList::RUNNING_PUBLIC_GAMES)
+	}};
+	std::array<std::mutex, 2> gameListsMtx;
 
-	std::array<ConnectionSet, 2> listSubscribers;
+	std::array<GamesListSubscribers, 2> listSubscribers;
 	std::array<std::mutex, 2>    listSubscribersMtx;
 
+	MatchmakingQueue matchmaking;
+	std::atomic<uint64_t> nextMatchmakingTicket = {1};
+
+	// queues the job of a received message, or parks it
+	// if another job of its connection is still active
+	void queueJob(ConnectionData&, Job);
+	// queues a job without checking its connection: the next parked job of a
+	// connection, or one without a connection that isn't ordered with others
+	void queueContinuation(Job);
+	// called after a job was handled, activates the next one of the connection
+	void jobDone(connection_hdl);
+
+	// returns an empty pointer if the connection is closed already
+	auto getConnection(connection_hdl hdl) -> WSServer::connection_ptr;
+
 	auto getClientData(connection_hdl hdl) -> std::shared_ptr<ClientData>;
+	// returns false if the connection doesn't exist anymore or is closing
+	bool setClientData(connection_hdl hdl, std::shared_ptr<ClientData> data);
+	// returns the previous client data and removes it from the connection
+	auto takeClientData(connection_hdl hdl) -> std::shared_ptr<ClientData>;
 };
 
 enum GamesListID
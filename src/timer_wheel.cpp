@@ -0,0 +1,231 @@
+/* Copyright 2015 Jonas Platte
+ *
+ * This file is part of Cyvasse Online.
+ *
+ * Cyvasse Online is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Affero General Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later version.
+ *
+ * Cyvasse Online is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE. See the GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License along with this program.
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "timer_wheel.hpp"
+
+#include <algorithm>
+#include <cassert>
+
+using namespace std;
+
+constexpr unsigned TimerWheel::levelBits;
+constexpr unsigned TimerWheel::nLevels;
+constexpr uint32_t TimerWheel::npos;
+constexpr uint32_t TimerWheel::slotsPerLevel;
+
+TimerWheel::TimerWheel(Clock::duration resolution)
+	: m_resolution(resolution)
+	, m_start(Clock::now())
+	, m_curTick{0}
+	, m_size{0}
+{
+	assert(resolution.count() > 0);
+	m_slots.fill(npos);
+}
+
+uint64_t TimerWheel::tickOf(Clock::time_point tp) const
+{
+	return (tp - m_start) / m_resolution;
+}
+
+void TimerWheel::link(uint32_t index)
+{
+	auto& timer = m_timers[index];
+
+	// the lowest level that reaches the expiry
+	uint64_t delta = timer.expiry > m_curTick ? timer.expiry - m_curTick : 0;
+
+	unsigned level = 0;
+	while (level + 1 < nLevels && delta >> (levelBits * (level + 1)))
+		level++;
+
+	// timers beyond the range of the wheel are put into the farthest slot
+	// and cascaded into the highest level again until they are in range
+	uint64_t expiry = min(max(timer.expiry, m_curTick), m_curTick + (uint64_t(1) << (levelBits * nLevels)) - 1);
+
+	timer.slot = level * slotsPerLevel + ((expiry >> (levelBits * level)) & (slotsPerLevel - 1));
+
+	auto& head = m_slots[timer.slot];
+
+	timer.prev = npos;
+	timer.next = head;
+
+	if (head != npos)
+		m_timers[head].prev = index;
+
+	head = index;
+}
+
+void TimerWheel::unlink(uint32_t index)
+{
+	auto& timer = m_timers[index];
+
+	if (timer.prev != npos)
+		m_timers[timer.prev].next = timer.next;
+	else
+		m_slots[timer.slot] = timer.next;
+
+	if (timer.next != npos)
+		m_timers[timer.next].prev = timer.prev;
+}
+
+void TimerWheel::release(uint32_t index)
+{
+	auto& timer = m_timers[index];
+
+	timer.active = false;
+	timer.callback = nullptr;
+	timer.generation++;
+
+	m_freeTimers.push_back(index);
+	m_size--;
+}
+
+auto TimerWheel::add(Clock::duration delay, Callback callback) -> TimerID
+{
+	lock_guard<mutex> lock(m_mtx);
+
+	uint32_t index;
+	if (m_freeTimers.empty())
+	{
+		index = m_timers.size();
+		m_timers.push_back(Timer{0, nullptr, npos, npos, 1, 0, false});
+	}
+	else
+	{
+		index = m_freeTimers.back();
+		m_freeTimers.pop_back();
+	}
+
+	// round up, a timer never fires early
+	auto expiry = tickOf(Clock::now() + delay + m_resolution - Clock::duration(1));
+
+	auto& timer = m_timers[index];
+	timer.expiry   = max(expiry, m_curTick + 1);
+	timer.callback = move(callback);
+	timer.active   = true;
+
+	link(index);
+	m_size++;
+
+	return (uint64_t(timer.generation) << 32) | index;
+}
+
+bool TimerWheel::cancel(TimerID id)
+{
+	uint32_t index = id & 0xFFFFFFFF;
+	uint32_t generation = id >> 32;
+
+	lock_guard<mutex> lock(m_mtx);
+
+	if (index >= m_timers.size())
+		return false;
+
+	auto& timer = m_timers[index];
+	if (!timer.active || timer.generation != generation)
+		return false;
+
+	unlink(index);
+	release(index);
+
+	return true;
+}
+
+void TimerWheel::cascade(unsigned level, uint32_t slot)
+{
+	auto& head = m_slots[level * slotsPerLevel + slot];
+
+	auto index = head;
+	head = npos;
+
+	while (index != npos)
+	{
+		auto next = m_timers[index].next;
+		link(index);
+		index = next;
+	}
+}
+
+void TimerWheel::advance(Clock::time_point now)
+{
+	vector<Callback> expired;
+
+	{
+		lock_guard<mutex> lock(m_mtx);
+
+		auto target = tickOf(now);
+
+		while (m_curTick < target)
+		{
+			auto tick = ++m_curTick;
+
+			// higher levels first, their timers can end up in the
+			// slot of a lower level that starts at this tick as well
+			for (unsigned level = nLevels - 1; level > 0; level--)
+			{
+				if ((tick & ((uint64_t(1) << (levelBits * level)) - 1)) == 0)
+					cascade(level, (tick >> (levelBits * level)) & (slotsPerLevel - 1));
+			}
+
+			auto& head = m_slots[tick & (slotsPerLevel - 1)];
+
+			auto index = head;
+			head = npos;
+
+			while (index != npos)
+			{
+				auto next = m_timers[index].next;
+
+				expired.push_back(move(m_timers[index].callback));
+				release(index);
+
+				index = next;
+			}
+		}
+	}
+
+	for (auto&& callback : expired)
+		callback();
+}
+
+void TimerWheel::clear()
+{
+	vector<Callback> callbacks;
+
+	{
+		lock_guard<mutex> lock(m_mtx);
+
+		for (uint32_t index = 0; index < m_timers.size(); index++)
+		{
+			if (!m_timers[index].active)
+				continue;
+
+			callbacks.push_back(move(m_timers[index].callback));
+			release(index);
+		}
+
+		m_slots.fill(npos);
+	}
+
+	// destroyed without the lock held, they might cancel other timers
+	callbacks.clear();
+}
+
+size_t TimerWheel::size() const
+{
+	lock_guard<mutex> lock(m_mtx);
+	return m_size;
+}
@@ -0,0 +1,103 @@
+/* Copyright 2015 Jonas Platte
+ *
+ * This file is part of Cyvasse Online.
+ *
+ * Cyvasse Online is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Affero General Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later version.
+ *
+ * Cyvasse Online is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE. See the GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License along with this program.
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _TIMER_WHEEL_HPP_
+#define _TIMER_WHEEL_HPP_
+
+#include <array>
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <vector>
+#include <cstdint>
+
+// Hierarchical timing wheel. All timers of the server (liveness checks, game
+// clocks, ...) are kept in here and one asio timer calls advance() every
+// resolution, so adding and cancelling a timer are O(1) no matter how many
+// there are. Every level has 256 slots that each span all slots of the level
+// below. A timer is put into the lowest level that reaches its expiry and
+// moved down a level (cascaded) when the wheel gets to the start of its slot.
+// Callbacks are invoked from advance(), without the internal lock held.
+class TimerWheel
+{
+	public:
+		typedef std::chrono::steady_clock Clock;
+		typedef std::function<void()> Callback;
+
+		// 0 is never a valid id
+		typedef uint64_t TimerID;
+
+		static constexpr unsigned levelBits = 8;
+		static constexpr unsigned nLevels   = 4; // 2^32 ticks, over 13 years at 100ms
+
+	private:
+		static constexpr uint32_t npos = 0xFFFFFFFF;
+		static constexpr uint32_t slotsPerLevel = 1u << levelBits;
+
+		struct Timer
+		{
+			uint64_t expiry;
+			Callback callback;
+
+			uint32_t prev;
+			uint32_t next;
+
+			uint32_t generation;
+			uint16_t slot; // index into m_slots
+			bool active;
+		};
+
+		const Clock::duration m_resolution;
+		const Clock::time_point m_start;
+
+		uint64_t m_curTick;
+
+		std::array<uint32_t, nLevels * slotsPerLevel> m_slots; // list heads
+		std::vector<Timer> m_timers;
+		std::vector<uint32_t> m_freeTimers;
+
+		size_t m_size;
+
+		mutable std::mutex m_mtx;
+
+		uint64_t tickOf(Clock::time_point) const;
+
+		void link(uint32_t index);
+		void unlink(uint32_t index);
+		void release(uint32_t index);
+
+		// relinks the timers of a slot, relative to m_curTick
+		void cascade(unsigned level, uint32_t slot);
+
+	public:
+		explicit TimerWheel(Clock::duration resolution);
+
+		TimerID add(Clock::duration delay, Callback);
+		// returns false if the timer already fired or was cancelled
+		bool cancel(TimerID);
+
+		void advance(Clock::time_point now = Clock::now());
+
+		// removes all timers without invoking them
+		void clear();
+
+		Clock::duration getResolution() const
+		{ return m_resolution; }
+
+		size_t size() const;
+};
+
+#endif // _TIMER_WHEEL_HPP_
@@ -0,0 +1,58 @@
+/* Copyright 2015 Jonas Platte
+ *
+ * This file is part of Cyvasse Online.
+ *
+ * Cyvasse Online is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Affero General Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later version.
+ *
+ * Cyvasse Online is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE. See the GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License along with this program.
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "tls.hpp"
+
+using namespace std;
+using websocketpp::lib::asio::ssl::context;
+
+tls::ContextPtr tls::makeServerContext(const TlsConfig& config)
+{
+	auto ctx = make_shared<context>(context::sslv23_server);
+
+	ctx->set_options(
+		context::default_workarounds |
+		context::no_sslv2 |
+		context::no_sslv3 |
+		context::no_tlsv1 |
+		context::no_tlsv1_1 |
+		context::single_dh_use
+	);
+
+	ctx->use_certificate_chain_file(config.certificateChain);
+	ctx->use_private_key_file(config.privateKey, context::pem);
+
+	auto native = ctx->native_handle();
+
+	// sessions are only resumed within the same id context
+	static const unsigned char sessionIDContext[] = "cyvasse-server";
+	SSL_CTX_set_session_id_context(native, sessionIDContext, sizeof(sessionIDContext) - 1);
+
+	if (config.sessionCacheSize != 0)
+	{
+		SSL_CTX_set_session_cache_mode(native, SSL_SESS_CACHE_SERVER);
+		SSL_CTX_sess_set_cache_size(native, config.sessionCacheSize);
+	}
+	else
+		SSL_CTX_set_session_cache_mode(native, SSL_SESS_CACHE_OFF);
+
+	SSL_CTX_set_timeout(native, config.sessionTimeout.count());
+
+	if (!config.sessionTickets)
+		SSL_CTX_set_options(native, SSL_OP_NO_TICKET);
+
+	return ctx;
+}
@@ -0,0 +1,41 @@
+/* Copyright 2015 Jonas Platte
+ *
+ * This file is part of Cyvasse Online.
+ *
+ * Cyvasse Online is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Affero General Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later version.
+ *
+ * Cyvasse Online is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE. See the GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License along with this program.
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _TLS_HPP_
+#define _TLS_HPP_
+
+#include <memory>
+#include <websocketpp/common/asio_ssl.hpp>
+#include "server_config.hpp"
+
+// TLS termination for builds configured with --enable-tls. The handshakes run
+// asynchronously on the I/O thread like all other socket operations. They
+// don't wait for the network there, but their key exchange is computed on it,
+// so a burst of full handshakes delays the frames of all other connections
+// (the workers aren't affected). Resumed sessions are much cheaper. Moving the
+// handshakes to their own threads would need the I/O thread state (liveness
+// timers, ...) to be thread-safe first.
+namespace tls
+{
+	typedef std::shared_ptr<websocketpp::lib::asio::ssl::context> ContextPtr;
+
+	// One context for all connections: OpenSSL keeps the session cache and the
+	// ticket key in it. Throws a system_error (the one of the asio flavour
+	// websocketpp uses) if the certificate or the private key can't be loaded.
+	ContextPtr makeServerContext(const TlsConfig&);
+}
+
+#endif // _TLS_HPP_
@@ -0,0 +1,245 @@
+/* Copyright 2015 Jonas Platte
+ *
+ * This file is part of Cyvasse Online.
+ *
+ * Cyvasse Online is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Affero General Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later version.
+ *
+ * Cyvasse Online is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE. See the GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License along with this program.
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "trace.hpp"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <vector>
+
+#include <json/value.h>
+#include <json/writer.h>
+
+using namespace std;
+using namespace std::chrono;
+
+namespace
+{
+	struct TraceEvent
+	{
+		uint64_t time; // ns
+		uint64_t traceID;
+		TraceStage stage;
+		uint32_t threadID;
+	};
+
+	// Single producer ring buffer, only the owning thread writes to it. The
+	// slots are atomics so a concurrent dump sees torn events at worst,
+	// which it discards by checking the head again after copying.
+	class TraceBuffer
+	{
+		public:
+			static constexpr size_t capacity = 16384;
+
+		private:
+			struct Slot
+			{
+				atomic<uint64_t> time;
+				atomic<uint64_t> traceID;
+				atomic<uint8_t> stage;
+			};
+
+			array<Slot, capacity> m_slots;
+			atomic<uint64_t> m_head = {0};
+
+			const uint32_t m_threadID;
+
+		public:
+			explicit TraceBuffer(uint32_t threadID)
+				: m_threadID(threadID)
+			{ }
+
+			void push(uint64_t time, uint64_t traceID, TraceStage stage)
+			{
+				auto head = m_head.load(memory_order_relaxed);
+				auto& slot = m_slots[head % capacity];
+
+				slot.time.store(time, memory_order_relaxed);
+				slot.traceID.store(traceID, memory_order_relaxed);
+				slot.stage.store(static_cast<uint8_t>(stage), memory_order_relaxed);
+
+				m_head.store(head + 1, memory_order_release);
+			}
+
+			void copyTo(vector<TraceEvent>& events) const
+			{
+				auto head = m_head.load(memory_order_acquire);
+				auto begin = head > capacity ? head - capacity : 0;
+
+				size_t first = events.size();
+				for (auto i = begin; i < head; i++)
+				{
+					const auto& slot = m_slots[i % capacity];
+					events.push_back({
+						slot.time.load(memory_order_relaxed),
+						slot.traceID.load(memory_order_relaxed),
+						static_cast<TraceStage>(slot.stage.load(memory_order_relaxed)),
+						m_threadID
+					});
+				}
+
+				// drop what was overwritten while we were copying
+				auto newHead = m_head.load(memory_order_acquire);
+				if (newHead > begin + capacity)
+				{
+					auto overwritten = min<uint64_t>(newHead - begin - capacity, head - begin);
+					events.erase(events.begin() + first, events.begin() + first + overwritten);
+				}
+			}
+	};
+
+	atomic<unsigned> sampleRate = {0};
+	atomic<uint64_t> nextTraceID = {1};
+
+	// buffers live as long as the process, the server's threads do too
+	mutex buffersMtx;
+	vector<TraceBuffer*> buffers;
+
+	thread_local TraceBuffer* threadBuffer = nullptr;
+	thread_local uint64_t currentTraceID = 0;
+	thread_local unsigned sampleCounter = 0;
+
+	TraceBuffer& getThreadBuffer()
+	{
+		if (!threadBuffer)
+		{
+			lock_guard<mutex> lock(buffersMtx);
+
+			threadBuffer = new TraceBuffer(buffers.size() + 1);
+			buffers.push_back(threadBuffer);
+		}
+
+		return *threadBuffer;
+	}
+
+	const char* stageName(TraceStage stage)
+	{
+		switch (stage)
+		{
+			case TraceStage::RECEIVED: return "received";
+			case TraceStage::DEQUEUED: return "dequeued";
+			case TraceStage::HANDLED:  return "handled";
+			case TraceStage::SENT:     return "sent";
+		}
+
+		return "unknown";
+	}
+}
+
+void Tracer::setSampleRate(unsigned rate)
+{
+	sampleRate = rate;
+}
+
+uint64_t Tracer::sample()
+{
+	auto rate = sampleRate.load(memory_order_relaxed);
+	if (rate == 0 || ++sampleCounter < rate)
+		return 0;
+
+	sampleCounter = 0;
+	return nextTraceID++;
+}
+
+void Tracer::record(uint64_t traceID, TraceStage stage)
+{
+	auto now = duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+	getThreadBuffer().push(now, traceID, stage);
+}
+
+uint64_t Tracer::current()
+{
+	return currentTraceID;
+}
+
+void Tracer::setCurrent(uint64_t traceID)
+{
+	currentTraceID = traceID;
+}
+
+string Tracer::dumpChromeTrace()
+{
+	vector<TraceEvent> events;
+
+	{
+		lock_guard<mutex> lock(buffersMtx);
+		for (auto buffer : buffers)
+			buffer->copyTo(events);
+	}
+
+	// the stages of one message are spread over several threads
+	map<uint64_t, map<TraceStage, const TraceEvent*>> byTrace;
+	for (const auto& event : events)
+		if (event.stage != TraceStage::SENT)
+			byTrace[event.traceID][event.stage] = &event;
+
+	Json::Value traceEvents(Json::arrayValue);
+
+	auto addEvent = [&](const char* name, const TraceEvent& event, const TraceEvent* end) {
+		Json::Value ev;
+		ev["name"] = name;
+		ev["cat"]  = "message";
+		ev["pid"]  = 1;
+		ev["tid"]  = event.threadID;
+		ev["ts"]   = event.time / 1000.0;
+
+		if (end)
+		{
+			ev["ph"]  = "X";
+			ev["dur"] = (end->time - event.time) / 1000.0;
+		}
+		else
+		{
+			ev["ph"] = "i";
+			ev["s"]  = "t";
+		}
+
+		ev["args"]["trace"] = Json::Value::UInt64(event.traceID);
+		traceEvents.append(ev);
+	};
+
+	for (const auto& it : byTrace)
+	{
+		const auto& stages = it.second;
+
+		auto stage = [&](TraceStage s) -> const TraceEvent* {
+			auto stageIt = stages.find(s);
+			return stageIt != stages.end() ? stageIt->second : nullptr;
+		};
+
+		auto received = stage(TraceStage::RECEIVED);
+		auto dequeued = stage(TraceStage::DEQUEUED);
+		auto handled  = stage(TraceStage::HANDLED);
+
+		if (received && dequeued)
+			addEvent("queued", *received, dequeued);
+		if (dequeued && handled)
+			addEvent("handle", *dequeued, handled);
+	}
+
+	for (const auto& event : events)
+		if (event.stage == TraceStage::SENT)
+			addEvent(stageName(event.stage), event, nullptr);
+
+	Json::Value root;
+	root["traceEvents"] = traceEvents;
+	root["displayTimeUnit"] = "ns";
+
+	return Json::FastWriter().write(root);
+}
@@ -0,0 +1,86 @@
+/* Copyright 2015 Jonas Platte
+ *
+ * This file is part of Cyvasse Online.
+ *
+ * Cyvasse Online is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Affero General Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later version.
+ *
+ * Cyvasse Online is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE. See the GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License along with this program.
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _TRACE_HPP_
+#define _TRACE_HPP_
+
+#include <string>
+#include <cstdint>
+
+// Optional per-message latency tracing. A sampled message gets a trace id in
+// onMessage, and every stage it passes through is recorded with a monotonic
+// timestamp into a ring buffer of the thread that handles the stage. Recording
+// is lock-free and only costs a clock read, so tracing can stay enabled with a
+// low sample rate in production. The buffers hold the most recent events and
+// are dumped in Chrome's trace event format (chrome://tracing, Perfetto).
+enum class TraceStage : uint8_t
+{
+	RECEIVED, // onMessage, I/O thread
+	DEQUEUED, // taken from the job queue by a worker
+	HANDLED,  // worker done with it
+	SENT      // a reply / notification caused by it was handed to websocketpp
+};
+
+class Tracer
+{
+	public:
+		// trace every nth message, 0 disables tracing
+		static void setSampleRate(unsigned);
+
+		// returns a new trace id if the next message should be traced, 0 otherwise
+		static uint64_t sample();
+
+		static void record(uint64_t traceID, TraceStage);
+
+		// the trace id of the message the current thread is handling, or 0
+		static uint64_t current();
+		static void setCurrent(uint64_t traceID);
+
+		static std::string dumpChromeTrace();
+};
+
+// Records DEQUEUED and HANDLED for a job and makes its
+// trace id the current one for the lifetime of the scope
+class TraceScope
+{
+	private:
+		uint64_t m_traceID;
+
+	public:
+		explicit TraceScope(uint64_t traceID)
+			: m_traceID(traceID)
+		{
+			if (m_traceID)
+			{
+				Tracer::record(m_traceID, TraceStage::DEQUEUED);
+				Tracer::setCurrent(m_traceID);
+			}
+		}
+
+		~TraceScope()
+		{
+			if (m_traceID)
+			{
+				Tracer::record(m_traceID, TraceStage::HANDLED);
+				Tracer::setCurrent(0);
+			}
+		}
+
+		TraceScope(const TraceScope&) = delete;
+		TraceScope& operator=(const TraceScope&) = delete;
+};
+
+#endif // _TRACE_HPP_
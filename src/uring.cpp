@@ -0,0 +1,167 @@
+/* Copyright 2015 Jonas Platte
+ *
+ * This file is part of Cyvasse Online.
+ *
+ * Cyvasse Online is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Affero General Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later version.
+ *
+ * Cyvasse Online is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE. See the GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License along with this program.
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "uring.hpp"
+
+#include <memory>
+#include <system_error>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+using namespace std;
+
+static int sysSetup(unsigned entries, io_uring_params* params)
+{
+	return syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int sysEnter(int fd, unsigned toSubmit, unsigned minComplete, unsigned flags)
+{
+	return syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags, nullptr, 0);
+}
+
+static int sysRegister(int fd, unsigned opcode, void* arg, unsigned nArgs)
+{
+	return syscall(__NR_io_uring_register, fd, opcode, arg, nArgs);
+}
+
+template <typename T>
+static T* offsetPtr(void* base, unsigned offset)
+{
+	return reinterpret_cast<T*>(static_cast<char*>(base) + offset);
+}
+
+IoUring::IoUring(unsigned entries)
+	: m_fd(sysSetup(entries, &m_params))
+{
+	if (m_fd == -1)
+		throw system_error(errno, system_category(), "io_uring_setup");
+
+	auto& sqOff = m_params.sq_off;
+	auto& cqOff = m_params.cq_off;
+
+	m_sqRingSize = sqOff.array + m_params.sq_entries * sizeof(unsigned);
+	m_cqRingSize = cqOff.cqes + m_params.cq_entries * sizeof(io_uring_cqe);
+
+	bool singleMmap = m_params.features & IORING_FEAT_SINGLE_MMAP;
+	if (singleMmap)
+		m_sqRingSize = m_cqRingSize = max(m_sqRingSize, m_cqRingSize);
+
+	auto map = [this](size_t size, off_t offset) {
+		void* ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, offset);
+		if (ptr == MAP_FAILED)
+		{
+			int err = errno;
+			unmap();
+			::close(m_fd);
+			throw system_error(err, system_category(), "mmap(io_uring)");
+		}
+
+		return ptr;
+	};
+
+	m_sqRing = map(m_sqRingSize, IORING_OFF_SQ_RING);
+	m_cqRing = singleMmap ? m_sqRing : map(m_cqRingSize, IORING_OFF_CQ_RING);
+
+	m_sqesSize = m_params.sq_entries * sizeof(io_uring_sqe);
+	m_sqes = static_cast<io_uring_sqe*>(map(m_sqesSize, IORING_OFF_SQES));
+
+	m_sqHead  = offsetPtr<unsigned>(m_sqRing, sqOff.head);
+	m_sqTail  = offsetPtr<unsigned>(m_sqRing, sqOff.tail);
+	m_sqMask  = offsetPtr<unsigned>(m_sqRing, sqOff.ring_mask);
+	m_sqArray = offsetPtr<unsigned>(m_sqRing, sqOff.array);
+	m_sqFlags = offsetPtr<unsigned>(m_sqRing, sqOff.flags);
+
+	m_cqHead = offsetPtr<unsigned>(m_cqRing, cqOff.head);
+	m_cqTail = offsetPtr<unsigned>(m_cqRing, cqOff.tail);
+	m_cqMask = offsetPtr<unsigned>(m_cqRing, cqOff.ring_mask);
+	m_cqes   = offsetPtr<io_uring_cqe>(m_cqRing, cqOff.cqes);
+
+	m_localTail = *m_sqTail;
+}
+
+IoUring::~IoUring()
+{
+	unmap();
+	::close(m_fd);
+}
+
+void IoUring::unmap()
+{
+	if (m_sqes)
+		munmap(m_sqes, m_sqesSize);
+	if (m_cqRing && m_cqRing != m_sqRing)
+		munmap(m_cqRing, m_cqRingSize);
+	if (m_sqRing)
+		munmap(m_sqRing, m_sqRingSize);
+
+	m_sqes = nullptr;
+	m_sqRing = m_cqRing = nullptr;
+}
+
+bool IoUring::supports(unsigned opcode) const
+{
+	const unsigned nOps = 256;
+	size_t size = sizeof(io_uring_probe) + nOps * sizeof(io_uring_probe_op);
+
+	unique_ptr<io_uring_probe, decltype(&free)> probe(static_cast<io_uring_probe*>(calloc(1, size)), &free);
+	if (!probe || sysRegister(m_fd, IORING_REGISTER_PROBE, probe.get(), nOps) == -1)
+		return false;
+
+	return opcode <= probe->last_op && (probe->ops[opcode].flags & IO_URING_OP_SUPPORTED);
+}
+
+bool IoUring::flushOverflow()
+{
+	if (!(__atomic_load_n(m_sqFlags, __ATOMIC_ACQUIRE) & IORING_SQ_CQ_OVERFLOW))
+		return false;
+
+	sysEnter(m_fd, 0, 0, IORING_ENTER_GETEVENTS);
+	return true;
+}
+
+io_uring_sqe* IoUring::getSqe()
+{
+	unsigned head = __atomic_load_n(m_sqHead, __ATOMIC_ACQUIRE);
+	if (m_localTail - head >= m_params.sq_entries)
+		return nullptr;
+
+	unsigned idx = m_localTail & *m_sqMask;
+	m_sqArray[idx] = idx;
+	m_localTail++;
+
+	auto sqe = &m_sqes[idx];
+	memset(sqe, 0, sizeof(*sqe));
+	return sqe;
+}
+
+int IoUring::submit(unsigned waitFor)
+{
+	unsigned toSubmit = m_localTail - *m_sqTail;
+	__atomic_store_n(m_sqTail, m_localTail, __ATOMIC_RELEASE);
+
+	int ret;
+	do
+		ret = sysEnter(m_fd, toSubmit, waitFor, waitFor ? IORING_ENTER_GETEVENTS : 0);
+	while (ret == -1 && errno == EINTR);
+
+	return ret == -1 ? -errno : ret;
+}
@@ -0,0 +1,110 @@
+/* Copyright 2015 Jonas Platte
+ *
+ * This file is part of Cyvasse Online.
+ *
+ * Cyvasse Online is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Affero General Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later version.
+ *
+ * Cyvasse Online is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE. See the GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License along with this program.
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _URING_HPP_
+#define _URING_HPP_
+
+#include <linux/io_uring.h>
+#include <cstddef>
+
+// Minimal io_uring wrapper on top of the raw system calls (there's no
+// dependency on liburing), just enough for the accept loop of Listener.
+// Not thread-safe, it is only used from the I/O thread.
+class IoUring
+{
+	private:
+		// before m_fd, io_uring_setup fills it in
+		io_uring_params m_params {};
+		int m_fd;
+
+		void* m_sqRing = nullptr;
+		void* m_cqRing = nullptr;
+		size_t m_sqRingSize = 0;
+		size_t m_cqRingSize = 0;
+
+		io_uring_sqe* m_sqes = nullptr;
+		size_t m_sqesSize = 0;
+
+		unsigned* m_sqHead;
+		unsigned* m_sqTail;
+		unsigned* m_sqMask;
+		unsigned* m_sqArray;
+		unsigned* m_sqFlags;
+
+		unsigned* m_cqHead;
+		unsigned* m_cqTail;
+		unsigned* m_cqMask;
+		io_uring_cqe* m_cqes;
+
+		unsigned m_localTail = 0; // sqes handed out by getSqe()
+
+		void unmap();
+
+		// Completions that didn't fit into the completion queue are kept by
+		// the kernel (and make the ring fd readable) until it is entered
+		// again. Returns false if there weren't any.
+		bool flushOverflow();
+
+	public:
+		// throws std::system_error if io_uring isn't available
+		explicit IoUring(unsigned entries);
+		~IoUring();
+
+		IoUring(const IoUring&) = delete;
+		IoUring& operator=(const IoUring&) = delete;
+
+		// readable when there are completions, can be watched with epoll
+		int getFd() const
+		{ return m_fd; }
+
+		// false if the kernel doesn't know the operation
+		bool supports(unsigned opcode) const;
+
+		// a zeroed entry, nullptr if the submission queue is full
+		io_uring_sqe* getSqe();
+
+		// submits all entries from getSqe() and waits until at least
+		// waitFor completions are available, returns -errno on failure
+		int submit(unsigned waitFor = 0);
+
+		// calls func(const io_uring_cqe&) for every available completion
+		template <typename Func>
+		size_t forEachCompletion(Func&& func)
+		{
+			size_t n = 0;
+
+			do
+			{
+				unsigned head = *m_cqHead;
+				unsigned tail = __atomic_load_n(m_cqTail, __ATOMIC_ACQUIRE);
+
+				for (; head != tail; head++, n++)
+				{
+					// copied, func might submit new entries which could
+					// produce a completion that overwrites this slot
+					io_uring_cqe cqe = m_cqes[head & *m_cqMask];
+					__atomic_store_n(m_cqHead, head + 1, __ATOMIC_RELEASE);
+
+					func(cqe);
+				}
+			}
+			while (flushOverflow());
+
+			return n;
+		}
+};
+
+#endif // _URING_HPP_
@@ -0,0 +1,186 @@
+/* Copyright 2015 Jonas Platte
+ *
+ * This file is part of Cyvasse Online.
+ *
+ * Cyvasse Online is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Affero General Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later version.
+ *
+ * Cyvasse Online is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE. See the GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License along with this program.
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "work_stealing_pool.hpp"
+
+#include <cassert>
+#include "logger.hpp"
+
+using namespace std;
+
+namespace
+{
+	// the pool the current thread belongs to, and its queue in there
+	thread_local const WorkStealingPool* t_pool = nullptr;
+	thread_local size_t t_queue = 0;
+}
+
+WorkStealingPool::WorkStealingPool(unsigned nThreads)
+{
+	assert(nThreads > 0);
+
+	for (unsigned i = 0; i < nThreads; i++)
+		m_queues.emplace_back(new Queue);
+
+	for (unsigned i = 0; i < nThreads; i++)
+		m_threads.emplace_back(&WorkStealingPool::run, this, i);
+}
+
+WorkStealingPool::~WorkStealingPool()
+{
+	{
+		lock_guard<mutex> lock(m_idleMtx);
+		m_running = false;
+	}
+
+	m_idleCond.notify_all();
+
+	for (auto&& t : m_threads)
+		t.join();
+}
+
+size_t WorkStealingPool::ownQueue() const
+{
+	return t_pool == this ? t_queue : m_queues.size();
+}
+
+void WorkStealingPool::push(size_t queue, Task task)
+{
+	{
+		lock_guard<mutex> lock(m_queues[queue]->mtx);
+		m_queues[queue]->tasks.push_back(move(task));
+	}
+
+	{
+		// so a thread that just found all queues empty doesn't miss it
+		lock_guard<mutex> lock(m_idleMtx);
+		m_queued++;
+	}
+
+	m_idleCond.notify_one();
+}
+
+void WorkStealingPool::post(Task task)
+{
+	auto queue = ownQueue();
+	if (queue == m_queues.size())
+		queue = m_nextQueue++ % m_queues.size();
+
+	push(queue, move(task));
+}
+
+void WorkStealingPool::post(TaskGroup& group, Task task)
+{
+	group.m_pending++;
+
+	post([&group, task] {
+		try
+		{
+			task();
+		}
+		catch (...)
+		{
+			group.m_pending--;
+			throw;
+		}
+
+		group.m_pending--;
+	});
+}
+
+bool WorkStealingPool::runOne(size_t self)
+{
+	Task task;
+
+	if (self < m_queues.size())
+	{
+		auto& own = *m_queues[self];
+		lock_guard<mutex> lock(own.mtx);
+
+		if (!own.tasks.empty())
+		{
+			task = move(own.tasks.back());
+			own.tasks.pop_back();
+		}
+	}
+
+	for (size_t i = 1; !task && i <= m_queues.size(); i++)
+	{
+		auto& victim = *m_queues[(self + i) % m_queues.size()];
+		lock_guard<mutex> lock(victim.mtx);
+
+		if (!victim.tasks.empty())
+		{
+			task = move(victim.tasks.front());
+			victim.tasks.pop_front();
+			m_stolen++;
+		}
+	}
+
+	if (!task)
+		return false;
+
+	m_queued--;
+
+	try
+	{
+		task();
+	}
+	catch (std::exception& e)
+	{
+		LOG_ERROR("pool task threw an exception", e.what());
+	}
+	catch (...)
+	{
+		LOG_ERROR("pool task threw an unrecognized error");
+	}
+
+	m_executed++;
+	return true;
+}
+
+void WorkStealingPool::run(size_t index)
+{
+	t_pool = this;
+	t_queue = index;
+
+	while (true)
+	{
+		if (runOne(index))
+			continue;
+
+		unique_lock<mutex> lock(m_idleMtx);
+
+		while (m_running && m_queued == 0)
+			m_idleCond.wait(lock);
+
+		if (!m_running)
+			break;
+	}
+}
+
+void WorkStealingPool::wait(TaskGroup& group)
+{
+	auto self = ownQueue();
+	assert(self < m_queues.size());
+
+	while (group.m_pending != 0)
+	{
+		// the remaining tasks of the group are running on other threads
+		if (!runOne(self))
+			this_thread::yield();
+	}
+}
@@ -0,0 +1,108 @@
+/* Copyright 2015 Jonas Platte
+ *
+ * This file is part of Cyvasse Online.
+ *
+ * Cyvasse Online is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Affero General Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later version.
+ *
+ * Cyvasse Online is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE. See the GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License along with this program.
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _WORK_STEALING_POOL_HPP_
+#define _WORK_STEALING_POOL_HPP_
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <cstdint>
+
+// Thread pool for CPU-bound tasks (the bot's search) that would otherwise
+// compete with the workers. Every thread has its own deque: tasks posted from
+// a pool thread go to the back of its deque and are taken from there again,
+// idle threads steal from the front of the others. A task can split its work
+// into a TaskGroup and wait() for it, the waiting thread keeps running tasks
+// in the meantime, so nested waits can't exhaust the pool.
+class WorkStealingPool
+{
+	public:
+		typedef std::function<void()> Task;
+
+		class TaskGroup
+		{
+			friend class WorkStealingPool;
+
+			private:
+				std::atomic<size_t> m_pending = {0};
+
+			public:
+				TaskGroup() = default;
+				TaskGroup(const TaskGroup&) = delete;
+				TaskGroup& operator=(const TaskGroup&) = delete;
+		};
+
+	private:
+		struct Queue
+		{
+			std::mutex mtx;
+			std::deque<Task> tasks;
+		};
+
+		std::vector<std::unique_ptr<Queue>> m_queues;
+
+		std::mutex m_idleMtx;
+		std::condition_variable m_idleCond;
+		std::atomic<size_t> m_queued = {0};
+		bool m_running = true;
+
+		std::atomic<size_t> m_nextQueue = {0};
+
+		std::atomic<uint64_t> m_executed = {0};
+		std::atomic<uint64_t> m_stolen   = {0};
+
+		// last, so the threads don't start before the other members are initialized
+		std::vector<std::thread> m_threads;
+
+		// index of the current thread's queue if it belongs to this pool
+		size_t ownQueue() const;
+
+		void push(size_t queue, Task);
+		bool runOne(size_t self);
+		void run(size_t index);
+
+	public:
+		explicit WorkStealingPool(unsigned nThreads);
+		// tasks that didn't start yet are dropped
+		~WorkStealingPool();
+
+		void post(Task);
+		void post(TaskGroup&, Task);
+
+		// Runs tasks until all of group's tasks are finished.
+		// Only call this from a task of the pool.
+		void wait(TaskGroup&);
+
+		size_t size() const
+		{ return m_threads.size(); }
+
+		size_t queued() const
+		{ return m_queued; }
+
+		uint64_t getExecuted() const
+		{ return m_executed; }
+
+		uint64_t getStolen() const
+		{ return m_stolen; }
+};
+
+#endif // _WORK_STEALING_POOL_HPP_
@@ -16,6 +16,7 @@
 
 #include "worker.hpp"
 
+#include <algorithm>
 #include <chrono>
 #include <map>
 #include <random>
@@ -41,13 +42,23 @@
 #include <cyvws/json_notification.hpp>
 #include <cyvws/json_server_reply.hpp>
 #include <cyvws/msg.hpp>
+#include <cyvws/notification.hpp>
 #include <cyvws/server_reply.hpp>
 #include <cyvws/server_request.hpp>
 
 #include "cyvasse_server.hpp"
 #include "b64.hpp"
 #include "client_data.hpp"
+#include "game_clock.hpp"
+#include "logger.hpp"
 #include "match_data.hpp"
+#include "memory_pool.hpp"
+#include "position.hpp"
+#include "protocol_ext.hpp"
+#include "raw_json.hpp"
+#include "search.hpp"
+#include "send_batch.hpp"
+#include "trace.hpp"
 
 using namespace cyvasse;
 using namespace cyvws;
@@ -56,11 +67,28 @@ using namespace std;
 using namespace std::chrono;
 using namespace websocketpp;
 
+// sent to both players when winner captured the king, like ClockJson::flagFall
+static Json::Value kingCaptured(PlayersColor winner, const GameClock* clock)
+{
+	Json::Value msg;
+	msg[MSG_TYPE] = MsgType::NOTIFICATION;
+
+	auto& data = msg[NOTIFICATION_DATA];
+	data[NotificationExt::TYPE]   = NotificationExt::GAME_ENDED;
+	data[NotificationExt::REASON] = NotificationExt::KING_CAPTURED;
+	data[NotificationExt::WINNER] = PlayersColorToStr(winner);
+
+	if (clock)
+		data[NotificationExt::CLOCKS] = ClockJson::clockStatus(*clock);
+
+	return msg;
+}
+
 Worker::Worker(CyvasseServer& server, SharedServerData& data)
 	: m_server(server)
 	, m_data(data)
-	, m_thread(bind(&Worker::processMessages, this))
 	, m_curMsgID{0}
+	, m_thread(bind(&Worker::processMessages, this))
 { }
 
 Worker::~Worker()
@@ -68,25 +96,28 @@ Worker::~Worker()
 	m_thread.join();
 }
 
-string Worker::newMatchID()
+uint32_t Worker::newMatchID()
 {
 	static ranlux24 int24Generator(system_clock::now().time_since_epoch().count());
 
-	string res;
+	uint32_t res;
 	lock_guard<mutex> lock(m_data.matchDataMtx);
 
 	do
 	{
-		res = int24ToB64ID(int24Generator());
+		res = m_server.getConfig().cluster.makeMatchID(int24Generator());
 	}
-	while(m_data.matchData.find(res) != m_data.matchData.end());
+	while(m_data.matchData.contains(res));
 
 	return res;
 }
 
 string Worker::newPlayerID()
 {
-	static ranlux48 int48Generator(system_clock::now().time_since_epoch().count());
+	// one per worker, seeded differently in case they start within the same clock tick
+	thread_local ranlux48 int48Generator(
+		system_clock::now().time_since_epoch().count() ^ hash<thread::id>()(this_thread::get_id())
+	);
 
 	// TODO
 	return int48ToB64ID(int48Generator());
@@ -106,61 +137,156 @@ void Worker::processMessages()
 		if (!m_data.running)
 			break;
 
-		auto job = m_data.jobQueue.front();
+		auto job = move(m_data.jobQueue.front());
 		m_data.jobQueue.pop();
 
 		jobLock.unlock();
 
-		try
-		{
-			// Process job
-			const Json::Value recvdJson = [&] {
-				Json::Value ret;
-
-				if (!reader.parse(job.msg_ptr->get_payload(), ret, false))
-					m_server.send(job.conn_hdl, json::commErr("Received message is no valid JSON"));
-
-				return ret;
-			}();
-
-			if (recvdJson.isNull())
-				continue;
-
-			if (!recvdJson[MSG_ID].isNull())
-				m_curMsgID = recvdJson[MSG_ID].asUInt();
-
-			const auto& msgType = recvdJson[MSG_TYPE].asString();
-
-			if (msgType == MsgType::CHAT_MSG)
-				processChatMsg(job.conn_hdl, recvdJson);
-			else if (msgType == MsgType::GAME_MSG)
-				processGameMsg(job.conn_hdl, recvdJson);
-			else if (msgType == MsgType::CHAT_MSG_ACK ||
-					msgType == MsgType::GAME_MSG_ACK ||
-					msgType == MsgType::GAME_MSG_ERR)
-				distributeMessage(job.conn_hdl, recvdJson);
-			else if (msgType == MsgType::SERVER_REQUEST)
-				processServerRequest(job.conn_hdl, recvdJson);
-			else if (msgType ==  MsgType::NOTIFICATION || msgType == MsgType::SERVER_REPLY)
-				m_server.send(job.conn_hdl, json::commErr("This msgType is not intended for client-to-server messages"));
-			else
-				m_server.send(job.conn_hdl, json::commErr("msgType \"" + msgType + "\" is invalid"));
-		}
-		catch(std::error_code& e)
-		{
-			cerr << "Caught a std::error_code\n-----\n" << e << '\n' << e.message() << endl;
-		}
-		catch(std::exception& e)
-		{
-			cerr << "Caught a std::exception: " << e.what() << endl;
-		}
-		catch(...)
 		{
-			cerr << "Caught an unrecognized error (not derived from either exception or error_code)" << endl;
+			TraceScope traceScope(job.trace_id);
+
+			// tag everything logged while handling this job
+			uint64_t connID = 0;
+			uint32_t matchID = 0;
+			if (auto con = m_data.getConnection(job.conn_hdl))
+			{
+				connID = con->connID;
+				if (auto clientData = atomic_load(&con->clientData))
+					matchID = clientData->getMatchData().getID();
+			}
+
+			LogContext logContext(connID, matchID);
+
+			// everything the handler sends goes out when the job is done,
+			// before the next job of the connection can start
+			SendBatch sendBatch(m_data);
+
+			try
+			{
+				processJob(job, reader);
+			}
+			catch(std::error_code& e)
+			{
+				LOG_ERROR("caught a std::error_code", e.category().name() + (": " + e.message()));
+			}
+			catch(std::exception& e)
+			{
+				LOG_ERROR("caught a std::exception", e.what());
+			}
+			catch(...)
+			{
+				LOG_ERROR("caught an unrecognized error (not derived from either exception or error_code)");
+			}
 		}
+
+		m_data.jobDone(job.conn_hdl);
 	}
 }
 
+void Worker::processJob(const Job& job, Json::Reader& reader)
+{
+	if (job.continuation)
+	{
+		m_curMsgID = job.msg_id;
+		job.continuation(*this);
+		return;
+	}
+
+	if (relayRaw(job.conn_hdl, job.msg_ptr->get_payload()))
+		return;
+
+	const Json::Value recvdJson = [&] {
+		Json::Value ret;
+
+		if (!reader.parse(job.msg_ptr->get_payload(), ret, false))
+			m_server.send(job.conn_hdl, json::commErr("Received message is no valid JSON"));
+
+		return ret;
+	}();
+
+	if (recvdJson.isNull())
+		return;
+
+	if (!recvdJson[MSG_ID].isNull())
+		m_curMsgID = recvdJson[MSG_ID].asUInt();
+
+	const auto& msgType = recvdJson[MSG_TYPE].asString();
+
+	if (msgType == MsgType::CHAT_MSG)
+		processChatMsg(job.conn_hdl, recvdJson);
+	else if (msgType == MsgType::GAME_MSG)
+		processGameMsg(job.conn_hdl, recvdJson);
+	else if (msgType == MsgType::CHAT_MSG_ACK ||
+			msgType == MsgType::GAME_MSG_ACK ||
+			msgType == MsgType::GAME_MSG_ERR)
+	{
+		if (auto clientData = m_data.getClientData(job.conn_hdl))
+			distributeMessage(*clientData, recvdJson);
+		else
+			LOG_WARNING("received an acknowledgement from a client without a match");
+	}
+	else if (msgType == MsgType::SERVER_REQUEST)
+		processServerRequest(job.conn_hdl, recvdJson);
+	else if (msgType ==  MsgType::NOTIFICATION || msgType == MsgType::SERVER_REPLY)
+		m_server.send(job.conn_hdl, json::commErr("This msgType is not intended for client-to-server messages"));
+	else
+		m_server.send(job.conn_hdl, json::commErr("msgType \"" + msgType + "\" is invalid"));
+}
+
+bool Worker::relayRaw(connection_hdl clientConnHdl, const string& payload)
+{
+	RawJsonObject msg(payload);
+
+	string msgType;
+	if (!msg.valid() || !msg.getString(MSG_TYPE, msgType))
+		return false;
+
+	if (msgType == MsgType::CHAT_MSG_ACK ||
+		msgType == MsgType::GAME_MSG_ACK ||
+		msgType == MsgType::GAME_MSG_ERR)
+	{
+		if (auto clientData = m_data.getClientData(clientConnHdl))
+			distributeMessage(*clientData, payload);
+		else
+			LOG_WARNING("received an acknowledgement from a client without a match");
+
+		return true;
+	}
+
+	if (msgType != MsgType::CHAT_MSG)
+		return false;
+
+	// the only change to a chat message is adding the username to msgData
+	auto msgDataMember = msg.find(MSG_DATA);
+	if (!msgDataMember)
+		return false;
+
+	RawJsonObject msgData(payload, msgDataMember->valueBegin, msgDataMember->valueEnd);
+	if (!msgData.valid() || msgData.find(USER))
+		return false;
+
+	auto clientData = m_data.getClientData(clientConnHdl);
+	if (!clientData)
+	{
+		LOG_WARNING("received a chat message from a client without a match");
+		return true;
+	}
+
+	auto user = Json::valueToQuotedString(clientData->getUsername().c_str());
+	auto insertPos = msgData.getBegin() + 1;
+
+	string newMsg;
+	newMsg.reserve(payload.size() + user.size() + 16);
+	newMsg.append(payload, 0, insertPos);
+	newMsg.append("\"").append(USER).append("\":").append(user);
+	if (!msgData.empty())
+		newMsg += ',';
+	newMsg.append(payload, insertPos, string::npos);
+
+	distributeMessage(*clientData, newMsg);
+	return true;
+}
+
 void Worker::processServerRequest(connection_hdl clientConnHdl, const Json::Value& msg)
 {
 	const auto& requestData = msg[REQUEST_DATA];
@@ -174,6 +300,8 @@ void Worker::processServerRequest(connection_hdl clientConnHdl, const Json::Valu
 	else if (action == ServerRequestAction::SET_USERNAME)               processSetUsernameRequest(clientConnHdl, param);
 	else if (action == ServerRequestAction::SUBSCR_GAME_LIST_UPDATES)   processSubscrGameListRequest(clientConnHdl, param);
 	else if (action == ServerRequestAction::UNSUBSCR_GAME_LIST_UPDATES) processUnsubscrGameListRequest(clientConnHdl, param);
+	else if (action == ServerRequestActionExt::FIND_MATCH)              processFindMatchRequest(clientConnHdl, param);
+	else if (action == ServerRequestActionExt::CANCEL_FIND_MATCH)       processCancelFindMatchRequest(clientConnHdl, param);
 	else
 		m_server.send(clientConnHdl, json::commErr("Unrecognized server request action"));
 }
@@ -207,6 +335,13 @@ void Worker::processCreateGameRequest(connection_hdl clientConnHdl, const Json::
 		return;
 	}
 
+	if (m_data.memory.exhausted())
+	{
+		m_data.counters.memoryRefusals++;
+		m_server.send(clientConnHdl, json::requestErr(m_curMsgID, ServerReplyErrMsgExt::MEMORY_BUDGET_EXHAUSTED));
+		return;
+	}
+
 	if (m_data.getClientData(clientConnHdl))
 	{
 		m_server.send(clientConnHdl, json::requestErr(m_curMsgID, ServerReplyErrMsg::CONN_IN_USE));
@@ -218,71 +353,125 @@ void Worker::processCreateGameRequest(connection_hdl clientConnHdl, const Json::
 	auto random  = param[RANDOM].asBool();
 	//auto _public = param[PUBLIC].asBool(); // TODO
 
+	// only used to filter the games lists so far
+	auto ruleSetStr = param[RULE_SET].asString();
+
+	bool withBot = param[CreateGameExt::BOT].asBool();
+	if (withBot && !m_server.getBots())
+	{
+		m_server.send(clientConnHdl, json::requestErr(m_curMsgID, ServerReplyErrMsgExt::BOTS_DISABLED));
+		return;
+	}
+
+	TimeControl timeControl;
+	bool timed = !param[CreateGameExt::TIME_CONTROL].isNull();
+
+	if (timed && !ClockJson::parseTimeControl(param[CreateGameExt::TIME_CONTROL], timeControl))
+	{
+		m_server.send(clientConnHdl, json::commErr("timeControl is invalid"));
+		return;
+	}
+
 	auto matchID  = newMatchID();
 	auto playerID = newPlayerID();
 
 	// TODO: Check whether all necessary parameters are set and valid
 
-	auto matchData = make_shared<MatchData>(matchID);
-	auto clientData = make_shared<ClientData>(
+	auto matchData = allocate_shared<MatchData>(PoolAllocator<MatchData>(), matchID);
+
+	if (timed)
+	{
+		// not shared yet, no need to lock
+		auto& server = m_server;
+		matchData->setClock(make_unique<GameClock>(server.getTimers(), timeControl,
+			[&server, matchID](uint64_t turn) { server.onFlagFall(matchID, turn); }
+		));
+	}
+
+	auto clientData = allocate_shared<ClientData>(PoolAllocator<ClientData>(),
 		matchData->getMatch(), color, playerID, clientConnHdl, *matchData
 	);
 
-	matchData->getClientDataSets().insert(clientData);
+	// only the base64 form is used in the protocol
+	auto matchIDStr = matchData->getMatch().getID();
 
 	{
-		lock_guard<mutex> lock(m_data.clientDataMtx);
-		auto tmp = m_data.clientData.emplace(clientConnHdl, clientData);
-		assert(tmp.second);
+		lock_guard<mutex> lock(matchData->getClientDataSetsMtx());
+		matchData->getClientDataSets().insert(clientData);
 	}
 
+	if (!m_data.setClientData(clientConnHdl, clientData))
+		return; // connection closed in the meantime
+
 	{
 		lock_guard<mutex> lock(m_data.matchDataMtx);
-		auto tmp = m_data.matchData.emplace(matchID, matchData);
-		assert(tmp.second);
+		auto tmp = m_data.matchData.insert(matchID, matchData);
+		assert(tmp);
 
 		m_server.updateMatchCount();
 	}
 
-	m_server.send(clientConnHdl, json::createGameSuccess(m_curMsgID, matchID, playerID));
+	m_server.send(clientConnHdl, json::createGameSuccess(m_curMsgID, matchIDStr, playerID));
 
-	if (random)
+	if (withBot)
+		addBot(matchID);
+	else if (random)
 	{
 		{
 			lock_guard<mutex> lock(m_data.gameListsMtx[RANDOM_GAMES]);
 
 			// TODO: send a meaningful title instead of "A game"
-			m_data.gameLists[RANDOM_GAMES].emplace(matchID, GamesListMappedType { "Match with a random user", !color });
+			m_data.gameLists[RANDOM_GAMES].insert(matchIDStr, GamesListMappedType { "Match with a random user", !color }, ruleSetStr);
 		}
 
 		m_server.listUpdated(RANDOM_GAMES);
-	}
-
-	// TODO
-	/*thread([=] {
-		this_thread::sleep_for(milliseconds(50));
-
-		auto match = createMatch(ruleSet, matchID, random, _public);
-		auto player = createPlayer(*match, color, playerID);
+		m_server.lobbyEntryUpdated(matchIDStr, "Match with a random user", !color, ruleSetStr);
 
-		cyvdb::MatchManager().addMatch(move(match));
-		cyvdb::PlayerManager().addPlayer(move(player));
-	}).detach();*/
+		auto joinTimeout = m_server.getConfig().bot.joinTimeout;
+		if (m_server.getBots() && joinTimeout.count() != 0)
+		{
+			// addBot doesn't do anything if somebody joined in the meantime
+			auto& data = m_data;
+			m_server.getTimers().add(joinTimeout, [&data, matchID] {
+				data.queueContinuation(Job(connection_hdl(), [matchID](Worker& worker) { worker.addBot(matchID); }, 0, 0));
+			});
+		}
+	}
 }
 
 void Worker::processJoinGameRequest(connection_hdl clientConnHdl, const Json::Value& param)
 {
 	unique_lock<mutex> matchDataLock(m_data.matchDataMtx);
 
-	auto matchIt = m_data.matchData.find(param[MATCH_ID].asString());
+	shared_ptr<MatchData> matchData;
+
+	uint32_t numMatchID;
+	if (b64IDToInt24(param[MATCH_ID].asString(), numMatchID))
+	{
+		const auto& cluster = m_server.getConfig().cluster;
+		auto node = cluster.nodeOf(numMatchID);
+
+		if (node != cluster.nodeID)
+		{
+			if (auto nodeConfig = cluster.findNode(node))
+			{
+				m_server.send(clientConnHdl, json::requestErr(m_curMsgID, ServerReplyErrMsgExt::GAME_ON_OTHER_SERVER, nodeConfig->publicUrl));
+				return;
+			}
+		}
+		else
+			matchData = m_data.matchData.find(numMatchID);
+	}
 
 	if (m_data.getClientData(clientConnHdl))
 		m_server.send(clientConnHdl, json::requestErr(m_curMsgID, ServerReplyErrMsg::CONN_IN_USE));
-	else if (matchIt == m_data.matchData.end())
+	else if (!matchData)
 		m_server.send(clientConnHdl, json::requestErr(m_curMsgID, ServerReplyErrMsg::GAME_NOT_FOUND));
 	else
 	{
-		auto matchData = matchIt->second;
+		unique_lock<mutex> clientDataSetsLock(matchData->getClientDataSetsMtx());
+		unique_lock<mutex> matchLock(matchData->getMatchMtx());
+
 		auto matchClients = matchData->getClientDataSets();
 
 		if (matchClients.size() == 0)
@@ -300,18 +489,23 @@ void Worker::processJoinGameRequest(connection_hdl clientConnHdl, const Json::Va
 			auto matchID  = param[MATCH_ID].asString();
 			auto playerID = newPlayerID();
 
-			auto clientData = make_shared<ClientData>(
+			auto clientData = allocate_shared<ClientData>(PoolAllocator<ClientData>(),
 				matchData->getMatch(), color, playerID,
 				clientConnHdl, *matchData
 			);
 
 			matchData->getClientDataSets().insert(clientData);
+
+			matchLock.unlock();
+			clientDataSetsLock.unlock();
 			matchDataLock.unlock();
 
+			if (!m_data.setClientData(clientConnHdl, clientData))
 			{
-				lock_guard<mutex> lock(m_data.clientDataMtx);
-				auto tmp = m_data.clientData.emplace(clientConnHdl, clientData);
-				assert(tmp.second);
+				// connection closed in the meantime, free the seat again
+				lock_guard<mutex> lock(matchData->getClientDataSetsMtx());
+				matchData->getClientDataSets().erase(clientData);
+				return;
 			}
 
 			{ // TODO: moving this to cyvws seems like a good idea
@@ -322,16 +516,29 @@ void Worker::processJoinGameRequest(connection_hdl clientConnHdl, const Json::Va
 				//replyData[RULE_SET]  = RuleSetToStr(ruleSet);
 
 				auto& opponent = replyData[OPPONENT];
-				opponent[USERNAME]   = opponentData->username;
+				opponent[USERNAME]   = opponentData->getUsername();
 
+				lock_guard<mutex> lock(matchData->getMatchMtx());
 				auto& match = matchData->getMatch();
 
 				auto& gameStatus = replyData[GAME_STATUS];
 				gameStatus[SETUP] = match.inSetup();
 
-				auto& pieces = match.getActivePieces();
-				if (!pieces.empty())
-					gameStatus[PIECE_POSITIONS] = json::pieceMap(pieces);
+				// one of the two encodings, the packed one if the client can decode it
+				auto& board = matchData->getBoard();
+				if (!board.empty())
+				{
+					if (param[JoinGameExt::BOARD].asBool())
+						gameStatus[GameStatusExt::BOARD] = *board.getEncoded();
+					else
+						gameStatus[PIECE_POSITIONS] = json::pieceMap(match.getActivePieces());
+				}
+
+				if (auto clock = matchData->getClock())
+				{
+					replyData[CreateGameExt::TIME_CONTROL] = ClockJson::timeControl(clock->getTimeControl());
+					gameStatus[GameStatusExt::CLOCKS] = ClockJson::clockStatus(*clock);
+				}
 
 				m_server.send(clientConnHdl, json::serverReply(m_curMsgID, replyData));
 			}
@@ -342,25 +549,24 @@ void Worker::processJoinGameRequest(connection_hdl clientConnHdl, const Json::Va
 			for (auto& clientIt : matchClients)
 				m_server.send(clientIt->getConnHdl(), msg);
 
-			auto it = m_data.gameLists[RANDOM_GAMES].find(matchID);
-			if (it != m_data.gameLists[RANDOM_GAMES].end())
-			{
-				{
-					lock_guard<mutex> lock(m_data.gameListsMtx[RANDOM_GAMES]);
-					m_data.gameLists[RANDOM_GAMES].erase(it);
-				}
+			removeRandomGame(matchID);
+		}
+	}
+}
 
-				m_server.listUpdated(RANDOM_GAMES);
-			}
+void Worker::removeRandomGame(const string& matchID)
+{
+	bool removed;
 
-			/*thread([=] {
-				this_thread::sleep_for(milliseconds(50));
+	{
+		lock_guard<mutex> lock(m_data.gameListsMtx[RANDOM_GAMES]);
+		removed = m_data.gameLists[RANDOM_GAMES].erase(matchID);
+	}
 
-				// TODO
-				auto match = createMatch(ruleSet, matchID);
-				cyvdb::PlayerManager().addPlayer(createPlayer(*match, color, playerID));
-			}).detach();*/
-		}
+	if (removed)
+	{
+		m_server.listUpdated(RANDOM_GAMES);
+		m_server.lobbyEntryRemoved(matchID);
 	}
 }
 
@@ -382,11 +588,12 @@ void Worker::processSetUsernameRequest(connection_hdl clientConnHdl, const Json:
 		return;
 	}
 
-	auto oldUsername = clientData->username;
-	clientData->username = newUsername;
+	auto oldUsername = clientData->setUsername(newUsername);
 
 	auto& matchData = clientData->getMatchData();
 
+	unique_lock<mutex> clientDataSetsLock(matchData.getClientDataSetsMtx());
+
 	if (matchData.getClientDataSets().size() > 1)
 	{
 		auto notificationStr = Json::FastWriter().write(json::usernameUpdate(oldUsername, newUsername));
@@ -399,11 +606,25 @@ void Worker::processSetUsernameRequest(connection_hdl clientConnHdl, const Json:
 	}
 	else
 	{
-		auto it = m_data.gameLists[RANDOM_GAMES].find(matchData.getMatch().getID());
-		if (it != m_data.gameLists[RANDOM_GAMES].end())
+		clientDataSetsLock.unlock();
+
+		const auto& matchID = matchData.getMatch().getID();
+		auto title = "Match with " + newUsername;
+		bool inLobby;
+		string ruleSet;
+
+		{
+			lock_guard<mutex> lock(m_data.gameListsMtx[RANDOM_GAMES]);
+
+			auto& randomGames = m_data.gameLists[RANDOM_GAMES];
+			inLobby = randomGames.setTitle(matchID, title);
+			ruleSet = randomGames.getRuleSet(matchID);
+		}
+
+		if (inLobby)
 		{
-			it->second.title = "Match with " + newUsername;
 			m_server.listUpdated(RANDOM_GAMES);
+			m_server.lobbyEntryUpdated(matchID, title, !clientData->getPlayer().getColor(), ruleSet);
 		}
 	}
 
@@ -412,9 +633,32 @@ void Worker::processSetUsernameRequest(connection_hdl clientConnHdl, const Json:
 
 void Worker::processSubscrGameListRequest(connection_hdl clientConnHdl, const Json::Value& param)
 {
-	vector<Json::Value> listUpdates;
+	vector<shared_ptr<const string>> listUpdates;
+
+	// the same view is used for all lists
+	GamesListView view;
+	view.ruleSet     = param[RULE_SET].asString();
+	view.titlePrefix = param[SubscrGameListExt::TITLE_PREFIX].asString();
+
+	const auto& color  = param[COLOR];
+	const auto& offset = param[SubscrGameListExt::OFFSET];
+	const auto& count  = param[SubscrGameListExt::COUNT];
+
+	if (!color.isNull())
+		view.color = StrToPlayersColor(color.asString());
+	if (offset.isUInt())
+		view.offset = offset.asUInt();
+	if (count.isUInt())
+		view.count = count.asUInt();
+
+	if ((!color.isNull() && view.color == PlayersColor::UNDEFINED) ||
+		(!offset.isNull() && !offset.isUInt()) ||
+		(!count.isNull() && (!count.isUInt() || view.count == 0 || view.count > GamesListView::maxCount)))
+	{
+		m_server.send(clientConnHdl, json::requestErr(m_curMsgID, ServerReplyErrMsgExt::INVALID_LIST_VIEW));
+		return;
+	}
 
-	// ignore param["ruleSet"] for now
 	for (const auto& listVal : param[LISTS])
 	{
 		const auto& listName = listVal.asString();
@@ -438,23 +682,27 @@ void Worker::processSubscrGameListRequest(connection_hdl clientConnHdl, const Js
 		{
 			auto list = *optList;
 
-			if (!m_data.gameLists[list].empty())
-				listUpdates.push_back(json::listUpdate(listName, m_data.gameLists[list]));
+			// same lock order as in CyvasseServer::listUpdated, so no update
+			// can happen between taking the snapshot and subscribing
+			lock_guard<mutex> subscribersLock(m_data.listSubscribersMtx[list]);
+			lock_guard<mutex> gameListLock(m_data.gameListsMtx[list]);
 
-			lock_guard<mutex> lock(m_data.listSubscribersMtx[list]);
-			m_data.listSubscribers[list].insert(clientConnHdl);
+			// replaces the view if the client was subscribed already (turning pages)
+			auto listUpdate = m_data.listSubscribers[list].subscribe(clientConnHdl, view, m_data.gameLists[list]);
+			if (listUpdate)
+				listUpdates.push_back(move(listUpdate));
 		}
 	}
 
 	m_server.send(clientConnHdl, json::requestSuccess(m_curMsgID));
 
-	for (auto&& jsonVal : listUpdates)
-		m_server.send(clientConnHdl, jsonVal);
+	for (auto&& listUpdate : listUpdates)
+		m_server.send(clientConnHdl, *listUpdate);
 }
 
 void Worker::processUnsubscrGameListRequest(connection_hdl clientConnHdl, const Json::Value& param)
 {
-	// ignore param["ruleSet"] for now
+	// a connection has one view per list, no need to look at it
 	for (const auto& listVal : param[LISTS])
 	{
 		const auto& listName = listVal.asString();
@@ -481,38 +729,302 @@ void Worker::processUnsubscrGameListRequest(connection_hdl clientConnHdl, const
 	m_server.send(clientConnHdl, json::requestSuccess(m_curMsgID));
 }
 
+void Worker::processFindMatchRequest(connection_hdl clientConnHdl, const Json::Value& param)
+{
+	if (m_data.maintenance)
+	{
+		m_server.send(clientConnHdl, json::requestErr(m_curMsgID, ServerReplyErrMsg::MAINTENANCE_MODE));
+		return;
+	}
+
+	if (m_data.memory.exhausted())
+	{
+		m_data.counters.memoryRefusals++;
+		m_server.send(clientConnHdl, json::requestErr(m_curMsgID, ServerReplyErrMsgExt::MEMORY_BUDGET_EXHAUSTED));
+		return;
+	}
+
+	auto con = m_data.getConnection(clientConnHdl);
+	if (!con)
+		return;
+
+	if (atomic_load(&con->clientData) || con->matchmakingTicket)
+	{
+		m_server.send(clientConnHdl, json::requestErr(m_curMsgID, ServerReplyErrMsg::CONN_IN_USE));
+		return;
+	}
+
+	// the only rule set so far, clients may leave it out
+	auto ruleSet = param[RULE_SET].asString();
+	if (ruleSet.empty())
+		ruleSet = RuleSetExt::DEFAULT;
+
+	if (ruleSet != RuleSetExt::DEFAULT)
+	{
+		m_server.send(clientConnHdl, json::requestErr(m_curMsgID, ServerReplyErrMsgExt::INVALID_RULE_SET));
+		return;
+	}
+
+	// the preferred color of the client, none means any
+	const auto& colorStr = param[COLOR].asString();
+
+	MatchmakingQueue::Preference preference = MatchmakingQueue::ANY_COLOR;
+	if (!colorStr.empty())
+		preference = (StrToPlayersColor(colorStr) == PlayersColor::WHITE) ? MatchmakingQueue::WHITE : MatchmakingQueue::BLACK;
+
+	MatchmakingQueue::Entry self { clientConnHdl, m_data.nextMatchmakingTicket++, m_curMsgID, preference };
+	con->matchmakingTicket = self.ticket;
+
+	MatchmakingQueue::Entry opponent;
+	bool paired = m_data.matchmaking.pairOrEnqueue(ruleSet, self,
+		[this](const MatchmakingQueue::Entry& entry) {
+			auto opponentCon = m_data.getConnection(entry.connHdl);
+			if (!opponentCon || opponentCon->get_state() != session::state::open)
+				return false;
+
+			// fails if the client cancelled (or was queued again) in the meantime
+			auto ticket = entry.ticket;
+			return opponentCon->matchmakingTicket.compare_exchange_strong(ticket, 0);
+		},
+		opponent
+	);
+
+	// if not paired, the client gets its reply when an opponent comes in
+	if (paired)
+	{
+		con->matchmakingTicket = 0;
+		startMatchmadeGame(self, opponent);
+	}
+}
+
+void Worker::processCancelFindMatchRequest(connection_hdl clientConnHdl, const Json::Value&)
+{
+	auto con = m_data.getConnection(clientConnHdl);
+	if (!con)
+		return;
+
+	auto ticket = con->matchmakingTicket.exchange(0);
+	if (ticket == 0)
+		m_server.send(clientConnHdl, json::requestErr(m_curMsgID, ServerReplyErrMsg::NOT_IN_GAME));
+	else
+	{
+		m_data.matchmaking.remove(ticket);
+		m_server.send(clientConnHdl, json::requestSuccess(m_curMsgID));
+	}
+}
+
+void Worker::startMatchmadeGame(const MatchmakingQueue::Entry& newcomer, const MatchmakingQueue::Entry& waiting)
+{
+	// if both have a preference they are compatible, if neither
+	// has one the client that waited longer gets to be white
+	PlayersColor waitingColor;
+
+	if (waiting.preference != MatchmakingQueue::ANY_COLOR)
+		waitingColor = (waiting.preference == MatchmakingQueue::WHITE) ? PlayersColor::WHITE : PlayersColor::BLACK;
+	else if (newcomer.preference != MatchmakingQueue::ANY_COLOR)
+		waitingColor = (newcomer.preference == MatchmakingQueue::WHITE) ? PlayersColor::BLACK : PlayersColor::WHITE;
+	else
+		waitingColor = PlayersColor::WHITE;
+
+	auto matchID = newMatchID();
+	auto matchData = allocate_shared<MatchData>(PoolAllocator<MatchData>(), matchID);
+
+	vector<pair<const MatchmakingQueue::Entry*, shared_ptr<ClientData>>> players;
+
+	for (auto entry : { &waiting, &newcomer })
+	{
+		auto color = (entry == &waiting) ? waitingColor : !waitingColor;
+
+		players.emplace_back(entry, allocate_shared<ClientData>(PoolAllocator<ClientData>(),
+			matchData->getMatch(), color, newPlayerID(), entry->connHdl, *matchData
+		));
+	}
+
+	for (auto&& player : players)
+	{
+		if (!m_data.setClientData(player.first->connHdl, player.second))
+		{
+			// one of them disconnected just now, the other one has to try again
+			for (auto&& other : players)
+			{
+				if (other.first != player.first)
+				{
+					m_data.takeClientData(other.first->connHdl);
+					m_server.send(other.first->connHdl, json::requestErr(other.first->msgID, ServerReplyErrMsg::GAME_EMPTY));
+				}
+			}
+
+			return;
+		}
+
+		lock_guard<mutex> lock(matchData->getClientDataSetsMtx());
+		matchData->getClientDataSets().insert(player.second);
+	}
+
+	{
+		lock_guard<mutex> lock(m_data.matchDataMtx);
+		auto tmp = m_data.matchData.insert(matchID, matchData);
+		assert(tmp);
+
+		m_server.updateMatchCount();
+	}
+
+	m_data.counters.matchmakingPairs++;
+
+	for (size_t i = 0; i < players.size(); i++)
+	{
+		const auto& player   = players[i];
+		const auto& opponent = players[1 - i];
+
+		Json::Value replyData;
+		replyData[SUCCESS]   = true;
+		replyData[MATCH_ID]  = matchData->getMatch().getID();
+		replyData[COLOR]     = PlayersColorToStr(player.second->getPlayer().getColor());
+		replyData[PLAYER_ID] = player.second->getPlayer().getID();
+		replyData[OPPONENT][USERNAME] = opponent.second->getUsername();
+
+		m_server.send(player.first->connHdl, json::serverReply(player.first->msgID, replyData));
+	}
+}
+
 void Worker::processChatMsg(connection_hdl clientConnHdl, const Json::Value& msg)
 {
 	auto clientData = m_data.getClientData(clientConnHdl);
 	if (!clientData)
-		return; // TODO: log an error
+	{
+		LOG_WARNING("received a chat message from a client without a match");
+		return;
+	}
 
 	Json::Value newMsg = msg;
-	newMsg[MSG_DATA][USER] = clientData->username;
+	newMsg[MSG_DATA][USER] = clientData->getUsername();
 
-	distributeMessage(clientConnHdl, newMsg);
+	distributeMessage(*clientData, newMsg);
 }
 
 void Worker::processGameMsg(connection_hdl clientConnHdl, const Json::Value& msg)
 {
 	auto clientData = m_data.getClientData(clientConnHdl);
 	if (!clientData)
-		return; // TODO: log an error
+	{
+		LOG_WARNING("received a game message from a client without a match");
+		return;
+	}
+
+	processGameMsg(clientData, msg);
+}
+
+void Worker::processGameMsg(const shared_ptr<ClientData>& clientData, const Json::Value& msg)
+{
+	// empty for bots, sending to it doesn't do anything
+	auto clientConnHdl = clientData->getConnHdl();
 
 	const auto& msgData = msg[MSG_DATA];
 	const auto& action = msgData[ACTION].asString();
 	const auto& param = msgData[PARAM];
 
-	if (action == GameMsgAction::MOVE)
-		processMoveMsg(*clientData, param);
-	else if (action == GameMsgAction::MOVE_CAPTURE)
-		processMoveCaptureMsg(*clientData, param);
-	else if (action == GameMsgAction::PROMOTE)
-		processPromoteMsg(*clientData, param);
-	else if (action == GameMsgAction::SET_OPENING_ARRAY)
-		processSetOpeningArrayMsg(*clientData, param);
+	auto& matchData = clientData->getMatchData();
+	Json::Value clocks;
+	string gameEnded;
+	bool botToMove = false;
+
+	{
+		// both players' messages can be handled at the same time
+		lock_guard<mutex> lock(matchData.getMatchMtx());
 
-	distributeMessage(clientConnHdl, msg);
+		if (matchData.isFinished())
+		{
+			m_server.send(clientConnHdl, json::commErr("The match is over"));
+			return;
+		}
+
+		auto clock = matchData.getClock();
+		auto color = clientData->getPlayer().getColor();
+		bool isMove = action == GameMsgAction::MOVE || action == GameMsgAction::MOVE_CAPTURE;
+
+		if (isMove)
+		{
+			if (matchData.getToMove() != color)
+			{
+				m_server.send(clientConnHdl, json::commErr("It's not your turn"));
+				return;
+			}
+
+			auto now = GameClock::Clock::now();
+			if (clock && clock->isRunning() && clock->getRemaining(color, now) <= GameClock::Clock::duration::zero())
+			{
+				// too late, the flag fall timer ends the match
+				m_server.send(clientConnHdl, json::commErr("Your time is up"));
+				return;
+			}
+
+			bool valid = (action == GameMsgAction::MOVE)
+				? processMoveMsg(*clientData, param)
+				: processMoveCaptureMsg(*clientData, param);
+
+			if (!valid)
+			{
+				m_server.send(clientConnHdl, json::commErr("Invalid move"));
+				return;
+			}
+
+			if (matchData.isFinished())
+				gameEnded = Json::FastWriter().write(kingCaptured(color, clock));
+			else if (clock && clock->isRunning())
+			{
+				// can't fail anymore, with the same now as the check above
+				clock->moved(color, now);
+				clocks = ClockJson::clockStatus(*clock);
+			}
+		}
+		else if (action == GameMsgAction::PROMOTE)
+		{
+			// not relayed either, the boards of the clients would differ from the server's
+			if (!processPromoteMsg(*clientData, param))
+			{
+				m_server.send(clientConnHdl, json::commErr("Invalid promotion"));
+				return;
+			}
+		}
+		else if (action == GameMsgAction::SET_OPENING_ARRAY)
+		{
+			// a second one would add pieces and hand the move to white again
+			if (clientData->getPlayer().isSetupDone() || !matchData.getMatch().inSetup())
+			{
+				m_server.send(clientConnHdl, json::commErr("The setup is done already"));
+				return;
+			}
+
+			processSetOpeningArrayMsg(*clientData, param);
+		}
+
+		const auto& bot = matchData.getBot();
+		botToMove = bot && bot != clientData && (isMove || action == GameMsgAction::SET_OPENING_ARRAY) &&
+			matchData.getToMove() == bot->getPlayer().getColor();
+	}
+
+	if (clocks.isNull())
+		distributeMessage(*clientData, msg);
+	else
+	{
+		// the opponent's clock starts now, tell them how much time is left
+		Json::Value newMsg = msg;
+		newMsg[MSG_DATA][GameStatusExt::CLOCKS] = clocks;
+
+		distributeMessage(*clientData, newMsg);
+	}
+
+	if (!gameEnded.empty())
+	{
+		lock_guard<mutex> lock(matchData.getClientDataSetsMtx());
+
+		for (auto& it : matchData.getClientDataSets())
+			if (!it->getConnHdl().expired())
+				m_server.send(it->getConnHdl(), gameEnded);
+	}
+
+	if (botToMove)
+		startBotSearch(matchData.getID());
 }
 
 void Worker::processSetOpeningArrayMsg(ClientData& clientData, const Json::Value& param)
@@ -522,6 +1034,9 @@ void Worker::processSetOpeningArrayMsg(ClientData& clientData, const Json::Value
 
 	auto& player = clientData.getPlayer();
 	auto& match  = clientData.getMatchData().getMatch();
+	auto& board  = clientData.getMatchData().getBoard();
+
+	ArenaAllocator<Piece> pieceAlloc(clientData.getMatchData().getArena());
 
 	for (const auto& pmIt : pieces)
 	{
@@ -530,9 +1045,12 @@ void Worker::processSetOpeningArrayMsg(ClientData& clientData, const Json::Value
 			if (pmIt.first == PieceType::KING)
 				player.getFortress().setCoord(coord);
 
-			match.getActivePieces().emplace(coord, make_shared<Piece>(
+			bool inserted = match.getActivePieces().emplace(coord, allocate_shared<Piece>(pieceAlloc,
 				player.getColor(), pmIt.first, coord, match
-			));
+			)).second;
+
+			if (inserted)
+				board.set(coord, player.getColor(), pmIt.first);
 		}
 	}
 
@@ -540,40 +1058,283 @@ void Worker::processSetOpeningArrayMsg(ClientData& clientData, const Json::Value
 
 	auto opColor = !player.getColor();
 	if (match.hasPlayer(opColor) && match.getPlayer(opColor).isSetupDone())
+	{
 		match.setupDone();
+
+		auto& history = clientData.getMatchData().getHistory();
+		history.started = true;
+		history.opening = board.getTiles();
+
+		for (auto color : { PlayersColor::WHITE, PlayersColor::BLACK })
+			history.playerIDs[MatchHistory::colorIndex(color)] = match.getPlayer(color).getID();
+
+		clientData.getMatchData().setToMove(PlayersColor::WHITE);
+
+		if (auto clock = clientData.getMatchData().getClock())
+			clock->start(PlayersColor::WHITE);
+	}
 }
 
-void Worker::processMoveMsg(ClientData& clientData, const Json::Value& param)
+bool Worker::processMoveMsg(ClientData& clientData, const Json::Value& param, bool capture)
 {
-	// TODO
+	BoardSnapshot::Coordinate from(5, 5), to(5, 5);
+	if (!CoordJson::parseCoordinate(param[GameMsgExt::OLD_POS], from) ||
+		!CoordJson::parseCoordinate(param[GameMsgExt::NEW_POS], to))
+		return false;
+
+	auto color      = clientData.getPlayer().getColor();
+	auto& matchData = clientData.getMatchData();
+	auto& pieces    = matchData.getMatch().getActivePieces();
+
+	auto pieceIt = pieces.find(from);
+	if (pieceIt == pieces.end() || pieceIt->second->getColor() != color)
+		return false;
+
+	auto piece = pieceIt->second;
+	auto targets = piece->getPossibleTargetTiles();
+	if (find(targets.begin(), targets.end(), to) == targets.end())
+		return false;
+
+	// moveCapture has to take a piece of the opponent, move mustn't
+	auto capturedIt = pieces.find(to);
+	if (capture != (capturedIt != pieces.end()) || (capture && capturedIt->second->getColor() == color))
+		return false;
+
+	auto& board   = matchData.getBoard();
+	auto& history = matchData.getHistory();
+
+	if (capture)
+	{
+		// the game is over, the flag fall timer mustn't end it a second time
+		if (capturedIt->second->getType() == PieceType::KING)
+		{
+			history.result = MatchResult::KING_CAPTURED;
+			history.winner = MatchHistory::colorIndex(color);
+
+			matchData.setFinished();
+			if (auto clock = matchData.getClock())
+				clock->stop();
+		}
+
+		pieces.erase(capturedIt);
+	}
+
+	// already validated above
+	piece->moveTo(to, false);
+
+	history.moves.push_back(uint16_t(BoardSnapshot::index(from) << 8 | BoardSnapshot::index(to)));
+	board.move(from, to);
+
+	matchData.setToMove(!color);
+	matchData.setPromotable(to);
+	return true;
 }
 
-void Worker::processMoveCaptureMsg(ClientData& clientData, const Json::Value& param)
+bool Worker::processMoveCaptureMsg(ClientData& clientData, const Json::Value& param)
 {
-	// TODO
+	return processMoveMsg(clientData, param, true);
 }
 
-void Worker::processPromoteMsg(ClientData& clientData, const Json::Value& param)
+// cyvasse::Piece doesn't know about promotions yet, so the rules are checked
+// here: only the piece that was just moved can be promoted, once, by the
+// player who moved it (before the opponent's move), and only to a stronger
+// type (a later one in cyvasse::PieceType). Mountains, kings and dragons stay.
+bool Worker::processPromoteMsg(ClientData& clientData, const Json::Value& param)
 {
-	// TODO
+	BoardSnapshot::Coordinate pos(5, 5);
+	if (!CoordJson::parseCoordinate(param[GameMsgExt::POS], pos))
+		return false;
+
+	auto newType = StrToPieceType(param[GameMsgExt::NEW_TYPE].asString());
+	if (newType == PieceType::UNDEFINED || newType == PieceType::KING)
+		return false;
+
+	auto& player    = clientData.getPlayer();
+	auto& matchData = clientData.getMatchData();
+	auto& pieces    = matchData.getMatch().getActivePieces();
+
+	// the opponent's turn is the one after the promoting player's move
+	if (matchData.getToMove() != !player.getColor() || !matchData.isPromotable(pos))
+		return false;
+
+	auto it = pieces.find(pos);
+	if (it == pieces.end() || it->second->getColor() != player.getColor())
+		return false;
+
+	auto oldType = it->second->getType();
+	if (oldType == PieceType::MOUNTAINS || oldType == PieceType::KING || int(newType) <= int(oldType))
+		return false;
+
+	// pieces can't change their type, replace it
+	it->second = allocate_shared<Piece>(ArenaAllocator<Piece>(matchData.getArena()),
+		player.getColor(), newType, pos, matchData.getMatch()
+	);
+
+	matchData.getBoard().set(pos, player.getColor(), newType);
+	matchData.getHistory().moves.push_back(MatchHistory::promotion(pos, newType));
+
+	matchData.clearPromotable();
+	return true;
 }
 
-void Worker::distributeMessage(connection_hdl clientConnHdl, const Json::Value& msg)
+void Worker::addBot(uint32_t matchID)
 {
-	auto clientData = m_data.getClientData(clientConnHdl);
+	unique_lock<mutex> matchDataLock(m_data.matchDataMtx);
+
+	auto matchData = m_data.matchData.find(matchID);
+	if (!matchData)
+		return; // the creator left already
+
+	unique_lock<mutex> clientDataSetsLock(matchData->getClientDataSetsMtx());
+	unique_lock<mutex> matchLock(matchData->getMatchMtx());
+	matchDataLock.unlock();
+
+	auto& clients = matchData->getClientDataSets();
+	auto& match = matchData->getMatch();
+
+	// somebody joined in the meantime
+	if (clients.size() != 1 || !match.inSetup() || matchData->getBot())
+		return;
+
+	auto opponent = *clients.begin();
+	auto color = !opponent->getPlayer().getColor();
+
+	auto bot = allocate_shared<ClientData>(PoolAllocator<ClientData>(),
+		match, color, newPlayerID(), connection_hdl(), *matchData
+	);
+
+	bot->setUsername(GameMsgExt::BOT_USERNAME);
+
+	clients.insert(bot);
+	matchData->setBot(bot);
+
+	// the bot's opening array takes the same path as the ones of the clients
+	Json::Value msg;
+	msg[MSG_TYPE] = MsgType::GAME_MSG;
+
+	auto& msgData = msg[MSG_DATA];
+	msgData[ACTION] = GameMsgAction::SET_OPENING_ARRAY;
+
+	for (const auto& it : Position::standardOpening(color))
+		msgData[PARAM][PieceTypeToStr(it.first)].append(CoordJson::coordinate(it.second));
+
+	processSetOpeningArrayMsg(*bot, msgData[PARAM]);
+
+	bool botToMove = matchData->getToMove() == color;
+	matchLock.unlock();
+
+	m_server.send(opponent->getConnHdl(), json::userJoined(GameMsgExt::BOT_USERNAME, false, ""));
+	m_server.send(opponent->getConnHdl(), msg);
+
+	clientDataSetsLock.unlock();
+
+	removeRandomGame(match.getID());
+
+	if (botToMove)
+		startBotSearch(matchID);
+}
+
+void Worker::startBotSearch(uint32_t matchID)
+{
+	auto bots = m_server.getBots();
+	if (!bots)
+		return;
+
+	shared_ptr<MatchData> matchData;
 
-	if (clientData)
 	{
-		const auto& clientDataSets = clientData->getMatchData().getClientDataSets();
+		lock_guard<mutex> lock(m_data.matchDataMtx);
+		matchData = m_data.matchData.find(matchID);
+	}
 
-		if (clientDataSets.size() > 1)
-		{
-			string json = Json::FastWriter().write(msg);
+	if (!matchData)
+		return;
 
-			for (auto it : clientDataSets)
-				if (*it != *clientData)
-					m_server.send(it->getConnHdl(), json);
-		}
+	lock_guard<mutex> lock(matchData->getMatchMtx());
+
+	const auto& bot = matchData->getBot();
+	if (!bot || matchData->isFinished())
+		return;
+
+	auto color = bot->getPlayer().getColor();
+	if (matchData->getToMove() != color)
+		return;
+
+	Position pos(matchData->getBoard(), color);
+	if (pos.isLost())
+		return;
+
+	Position::MoveList legalMoves;
+	Position::legalMoves(matchData->getMatch(), color, legalMoves);
+
+	// leave time for the rest of the game
+	TimerWheel::Clock::duration budget = bots->getConfig().moveTime;
+	if (auto clock = matchData->getClock())
+		budget = min(budget, clock->getRemaining(color) / 20);
+
+	auto& data = m_data;
+	bots->search(pos, legalMoves, budget, [&data, matchID](bool found, Position::Move move) {
+		if (!found)
+			return;
+
+		data.queueContinuation(Job(connection_hdl(), [matchID, move](Worker& worker) {
+			worker.playBotMove(matchID, move);
+		}, 0, 0));
+	});
+}
+
+void Worker::playBotMove(uint32_t matchID, Position::Move move)
+{
+	shared_ptr<MatchData> matchData;
+
+	{
+		lock_guard<mutex> lock(m_data.matchDataMtx);
+		matchData = m_data.matchData.find(matchID);
+	}
+
+	if (!matchData)
+		return;
+
+	shared_ptr<ClientData> bot;
+	bool capture;
+
+	{
+		lock_guard<mutex> lock(matchData->getMatchMtx());
+
+		bot = matchData->getBot();
+		if (!bot || matchData->isFinished() || matchData->getToMove() != bot->getPlayer().getColor())
+			return;
+
+		capture = matchData->getBoard().getTile(Position::toCoordinate(move.to)) != BoardSnapshot::emptyTile;
 	}
-	//else?
+
+	// processGameMsg validates the move again like the ones of the
+	// clients, the match can have changed while the search ran
+
+	Json::Value msg;
+	msg[MSG_TYPE] = MsgType::GAME_MSG;
+
+	auto& msgData = msg[MSG_DATA];
+	msgData[ACTION] = capture ? GameMsgAction::MOVE_CAPTURE : GameMsgAction::MOVE;
+	msgData[PARAM][GameMsgExt::OLD_POS] = CoordJson::coordinate(Position::toCoordinate(move.from));
+	msgData[PARAM][GameMsgExt::NEW_POS] = CoordJson::coordinate(Position::toCoordinate(move.to));
+
+	processGameMsg(bot, msg);
+}
+
+void Worker::distributeMessage(const ClientData& clientData, const Json::Value& msg)
+{
+	distributeMessage(clientData, Json::FastWriter().write(msg));
+}
+
+void Worker::distributeMessage(const ClientData& clientData, const string& json)
+{
+	const auto& matchData = clientData.getMatchData();
+
+	lock_guard<mutex> lock(matchData.getClientDataSetsMtx());
+
+	// bots don't have a connection, they look at the board instead
+	for (auto it : matchData.getClientDataSets())
+		if (*it != clientData && !it->getConnHdl().expired())
+			m_server.send(it->getConnHdl(), json);
 }
@@ -18,10 +18,12 @@
 #define _WORKER_HPP_
 
 #include <string>
+#include <cstdint>
 #include <thread>
+#include "position.hpp"
 #include "shared_server_data.hpp"
 
-namespace Json { class Value; }
+namespace Json { class Value; class Reader; }
 class CyvasseServer;
 class ClientData;
 
@@ -33,13 +35,21 @@ class Worker
 		CyvasseServer& m_server;
 		SharedServerData& m_data;
 
-		std::thread m_thread;
-
 		unsigned m_curMsgID;
 
-		std::string newMatchID();
+		// last, so the thread doesn't start before the other members are initialized
+		std::thread m_thread;
+
+		uint32_t newMatchID();
 		std::string newPlayerID();
 
+		void processJob(const Job&, Json::Reader&);
+		// forwards acknowledgements and chat messages without parsing them,
+		// returns false if the message has to go through the normal path
+		bool relayRaw(connection_hdl, const std::string& payload);
+
+		void removeRandomGame(const std::string& matchID);
+
 	public:
 		Worker(CyvasseServer&, SharedServerData& data);
 		~Worker();
@@ -54,16 +64,32 @@ class Worker
 		void processSetUsernameRequest(connection_hdl, const Json::Value& param);
 		void processSubscrGameListRequest(connection_hdl, const Json::Value& param);
 		void processUnsubscrGameListRequest(connection_hdl, const Json::Value& param);
+		void processFindMatchRequest(connection_hdl, const Json::Value& param);
+		void processCancelFindMatchRequest(connection_hdl, const Json::Value& param);
+
+		void startMatchmadeGame(const MatchmakingQueue::Entry&, const MatchmakingQueue::Entry&);
 
 		void processChatMsg(connection_hdl, const Json::Value& msg);
 
 		void processGameMsg(connection_hdl, const Json::Value& msg);
+		void processGameMsg(const std::shared_ptr<ClientData>&, const Json::Value& msg);
 		void processSetOpeningArrayMsg(ClientData&, const Json::Value& param);
-		void processMoveMsg(ClientData&, const Json::Value& param);
-		void processMoveCaptureMsg(ClientData&, const Json::Value& param);
-		void processPromoteMsg(ClientData&, const Json::Value& param);
+		// validate the move with cyvasse-common and return false if it isn't legal
+		bool processMoveMsg(ClientData&, const Json::Value& param, bool capture = false);
+		bool processMoveCaptureMsg(ClientData&, const Json::Value& param);
+		// returns false if the promotion isn't allowed, see the definition
+		bool processPromoteMsg(ClientData&, const Json::Value& param);
+
+		// Lets a bot take the open seat of the match, it plays through its own
+		// ClientData without a connection. Doesn't do anything if the match
+		// is full or over already.
+		void addBot(uint32_t matchID);
+		// if it's the bot's turn, playBotMove runs when the search is done
+		void startBotSearch(uint32_t matchID);
+		void playBotMove(uint32_t matchID, Position::Move);
 
-		void distributeMessage(connection_hdl, const Json::Value& msg);
+		void distributeMessage(const ClientData&, const Json::Value& msg);
+		void distributeMessage(const ClientData&, const std::string& json);
 };
 
 #endif // _WORKER_HPP_
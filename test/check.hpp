@@ -0,0 +1,52 @@
+/* Copyright 2015 Jonas Platte
+ *
+ * This file is part of Cyvasse Online.
+ *
+ * Cyvasse Online is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Affero General Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later version.
+ *
+ * Cyvasse Online is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE. See the GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License along with this program.
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _CHECK_HPP_
+#define _CHECK_HPP_
+
+#include <iostream>
+
+// Minimal assertions for the tests under test/, which are plain programs run
+// by `make check`. A failed check is reported and makes main() return 1.
+
+namespace check
+{
+	inline int& failures()
+	{
+		static int count = 0;
+		return count;
+	}
+
+	inline int result()
+	{
+		if (failures())
+			std::cerr << failures() << " check(s) failed" << std::endl;
+
+		return failures() ? 1 : 0;
+	}
+}
+
+#define CHECK(expr) \
+	do \
+	{ \
+		if (!(expr)) \
+		{ \
+			std::cerr << __FILE__ << ':' << __LINE__ << ": CHECK(" #expr ") failed" << std::endl; \
+			check::failures()++; \
+		} \
+	} while (false)
+
+#endif // _CHECK_HPP_
@@ -0,0 +1,129 @@
+/* Copyright 2015 Jonas Platte
+ *
+ * This file is part of Cyvasse Online.
+ *
+ * Cyvasse Online is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Affero General Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later version.
+ *
+ * Cyvasse Online is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE. See the GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License along with this program.
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../src/game_clock.hpp"
+#include "../src/timer_wheel.hpp"
+
+#include <vector>
+#include "check.hpp"
+
+using namespace cyvasse;
+using namespace std;
+using namespace std::chrono;
+
+typedef TimerWheel::Clock Clock;
+
+static void testTimerWheel()
+{
+	TimerWheel timers(milliseconds(10));
+	auto start = Clock::now();
+
+	vector<int> fired;
+	timers.add(milliseconds(25), [&] { fired.push_back(1); });
+	auto second = timers.add(milliseconds(50), [&] { fired.push_back(2); });
+	// beyond the first level, has to be cascaded
+	timers.add(seconds(5), [&] { fired.push_back(3); });
+	CHECK(timers.size() == 3);
+
+	timers.advance(start);
+	CHECK(fired.empty());
+
+	// rounded up, never early
+	timers.advance(start + milliseconds(15));
+	CHECK(fired.empty());
+
+	timers.advance(start + milliseconds(40));
+	CHECK(fired == vector<int>{1});
+
+	CHECK(timers.cancel(second));
+	CHECK(!timers.cancel(second));
+
+	timers.advance(start + seconds(1));
+	CHECK(fired == vector<int>{1});
+
+	timers.advance(start + seconds(6));
+	CHECK((fired == vector<int>{1, 3}));
+	CHECK(timers.size() == 0);
+
+	// a cancelled id isn't reused for a new timer
+	auto third = timers.add(milliseconds(10), [&] { fired.push_back(4); });
+	CHECK(third != second);
+
+	timers.add(milliseconds(10), [&] { fired.push_back(5); });
+	timers.clear();
+	CHECK(timers.size() == 0);
+	CHECK(!timers.cancel(third));
+
+	timers.advance(start + seconds(10));
+	CHECK(fired.size() == 2);
+}
+
+static void testGameClock()
+{
+	TimerWheel timers(milliseconds(10));
+	auto start = Clock::now();
+
+	vector<uint64_t> flagFalls;
+	GameClock clock(timers, TimeControl { seconds(10), seconds(2) }, [&](uint64_t turn) {
+		flagFalls.push_back(turn);
+	});
+
+	CHECK(!clock.isRunning());
+	CHECK(!clock.moved(PlayersColor::WHITE, start));
+
+	clock.start(PlayersColor::WHITE, start);
+	CHECK(clock.isRunning());
+	CHECK(clock.getToMove() == PlayersColor::WHITE);
+
+	// out of turn, nothing changes
+	CHECK(!clock.moved(PlayersColor::BLACK, start + seconds(1)));
+	CHECK(clock.getToMove() == PlayersColor::WHITE);
+	CHECK(clock.getRemaining(PlayersColor::BLACK, start + seconds(1)) == seconds(10));
+
+	// 3 seconds used, 2 added
+	CHECK(clock.moved(PlayersColor::WHITE, start + seconds(3)));
+	CHECK(clock.getToMove() == PlayersColor::BLACK);
+	CHECK(clock.getRemaining(PlayersColor::WHITE, start + seconds(3)) == seconds(9));
+	CHECK(clock.getRemaining(PlayersColor::BLACK, start + seconds(4)) == seconds(9));
+
+	auto turn = clock.getTurn();
+	CHECK(!clock.hasFlagFallen(turn, start + seconds(12)));
+	CHECK(clock.hasFlagFallen(turn, start + seconds(13)));
+
+	// too late, black's flag fell
+	CHECK(!clock.moved(PlayersColor::BLACK, start + seconds(14)));
+	CHECK(clock.getToMove() == PlayersColor::BLACK);
+
+	// the wheel adds the timer relative to the real time, which is just
+	// after start here, so black's 9 seconds end a bit after start + 9s
+	timers.advance(start + seconds(8));
+	CHECK(flagFalls.empty());
+
+	timers.advance(start + seconds(14));
+	CHECK(flagFalls == vector<uint64_t>{turn});
+
+	clock.stop(start + seconds(14));
+	CHECK(!clock.isRunning());
+	CHECK(!clock.hasFlagFallen(turn, start + seconds(14)));
+}
+
+int main()
+{
+	testTimerWheel();
+	testGameClock();
+
+	return check::result();
+}
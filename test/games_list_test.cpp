@@ -0,0 +1,219 @@
+/* Copyright 2015 Jonas Platte
+ *
+ * This file is part of Cyvasse Online.
+ *
+ * Cyvasse Online is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Affero General Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later version.
+ *
+ * Cyvasse Online is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE. See the GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License along with this program.
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../src/games_list.hpp"
+
+#include <memory>
+#include <string>
+#include <vector>
+#include "check.hpp"
+
+using namespace cyvasse;
+using namespace cyvws;
+using namespace std;
+
+// AAAA .. EEEE: alternately black and white, the first three in the default rule set
+static void fill(CachedGamesList& list)
+{
+	const char* ids[] = {"AAAA", "BBBB", "CCCC", "DDDD", "EEEE"};
+
+	for (int i = 0; i < 5; i++)
+	{
+		list.insert(ids[i], GamesListMappedType {"Match with a" + to_string(i), i % 2 ? PlayersColor::WHITE : PlayersColor::BLACK},
+			i < 3 ? "default" : "other");
+	}
+}
+
+static vector<string> sliceIDs(const CachedGamesList& list, const GamesListView& view)
+{
+	vector<string> ret;
+	for (auto it : list.getSlice(view))
+		ret.push_back(it->first);
+
+	return ret;
+}
+
+static void testChanges()
+{
+	CachedGamesList list("randomGames");
+	CHECK(list.getVersion() == 0);
+
+	fill(list);
+	CHECK(list.getVersion() == 5);
+	CHECK(list.getRuleSet("DDDD") == "other");
+	CHECK(list.getRuleSet("XXXX").empty());
+
+	auto changes = list.takeChanges();
+	CHECK(changes.size() == 5);
+	CHECK(changes.size() == 5 && changes[0].matchID == "AAAA" && !changes[0].existed);
+	CHECK(list.takeChanges().empty());
+
+	CHECK(list.setTitle("BBBB", "renamed"));
+	CHECK(!list.setTitle("XXXX", "renamed"));
+	CHECK(list.erase("CCCC"));
+	CHECK(!list.erase("CCCC"));
+
+	// the entries as they were before
+	changes = list.takeChanges();
+	CHECK(changes.size() == 2);
+	CHECK(changes.size() == 2 && changes[0].existed && changes[0].entry.title == "Match with a1");
+	CHECK(changes.size() == 2 && changes[1].matchID == "CCCC" && changes[1].ruleSet == "default");
+
+	CHECK(list.getEntries().size() == 4);
+	CHECK(list.getEntries().at("BBBB").title == "renamed");
+
+	// replacing an entry moves it between the indexes
+	list.insert("AAAA", GamesListMappedType {"Match with z", PlayersColor::WHITE}, "other");
+
+	GamesListView black;
+	black.color = PlayersColor::BLACK;
+	CHECK((sliceIDs(list, black) == vector<string>{"EEEE"}));
+
+	GamesListView prefix;
+	prefix.titlePrefix = "Match with a";
+	CHECK((sliceIDs(list, prefix) == vector<string>{"DDDD", "EEEE"}));
+
+	GamesListView defaultRuleSet;
+	defaultRuleSet.ruleSet = "default";
+	CHECK((sliceIDs(list, defaultRuleSet) == vector<string>{"BBBB"}));
+}
+
+static void testSlices()
+{
+	CachedGamesList list("randomGames");
+	fill(list);
+
+	GamesListView all;
+	CHECK(all.isWholeList());
+	CHECK(sliceIDs(list, all).size() == 5);
+
+	// one more than count, to tell whether there is another page
+	GamesListView page;
+	page.offset = 1;
+	page.count  = 2;
+	CHECK((sliceIDs(list, page) == vector<string>{"BBBB", "CCCC", "DDDD"}));
+
+	GamesListView white;
+	white.color = PlayersColor::WHITE;
+	CHECK((sliceIDs(list, white) == vector<string>{"BBBB", "DDDD"}));
+
+	GamesListView combined;
+	combined.ruleSet = "default";
+	combined.color   = PlayersColor::BLACK;
+	CHECK((sliceIDs(list, combined) == vector<string>{"AAAA", "CCCC"}));
+
+	GamesListView prefix;
+	prefix.titlePrefix = "Match with a3";
+	CHECK((sliceIDs(list, prefix) == vector<string>{"DDDD"}));
+
+	GamesListView unknownRuleSet;
+	unknownRuleSet.ruleSet = "unknown";
+	CHECK(sliceIDs(list, unknownRuleSet).empty());
+
+	string boundary;
+	list.getListUpdate(page, boundary);
+	CHECK(boundary == "DDDD");
+
+	page.offset = 3;
+	list.getListUpdate(page, boundary);
+	CHECK(boundary.empty());
+
+	// serialized once per version
+	auto update = list.getListUpdate();
+	CHECK(list.getListUpdate() == update);
+	CHECK(list.getListUpdate(all, boundary) == update);
+
+	list.setTitle("AAAA", "renamed");
+	CHECK(list.getListUpdate() != update);
+}
+
+static void testSubscribers()
+{
+	CachedGamesList list("randomGames");
+	GamesListSubscribers subscribers;
+
+	vector<shared_ptr<int>> conns;
+	for (int i = 0; i < 4; i++)
+		conns.push_back(make_shared<int>(i));
+
+	GamesListView all;
+
+	// nothing to send for an empty list
+	CHECK(!subscribers.subscribe(conns[0], all, list));
+
+	fill(list);
+	list.takeChanges();
+
+	GamesListView white;
+	white.color = PlayersColor::WHITE;
+	white.count = 1;
+
+	GamesListView other;
+	other.ruleSet = "other";
+
+	CHECK(subscribers.subscribe(conns[1], white, list));
+	CHECK(subscribers.subscribe(conns[2], white, list));
+	CHECK(subscribers.subscribe(conns[3], other, list));
+	CHECK(subscribers.size() == 4);
+	CHECK(subscribers.getViewCount() == 3);
+
+	// the whole list view still has the update of the empty list
+	auto updates = subscribers.update(list, list.takeChanges());
+	CHECK(updates.empty());
+
+	// in the white page and the whole list, not in the other rule set
+	list.setTitle("BBBB", "renamed");
+	updates = subscribers.update(list, list.takeChanges());
+	CHECK(updates.size() == 2);
+
+	for (const auto& update : updates)
+		CHECK(update.subscribers->size() == (update.subscribers->count(conns[0]) ? 1u : 2u));
+
+	// white, but behind the first entry after the page (DDDD)
+	list.insert("FFFF", GamesListMappedType {"Match with f", PlayersColor::WHITE}, "default");
+	updates = subscribers.update(list, list.takeChanges());
+	CHECK(updates.size() == 1);
+	CHECK(updates.size() == 1 && updates[0].subscribers->count(conns[0]));
+
+	// matched the filter of the other rule set before the change
+	list.erase("EEEE");
+	updates = subscribers.update(list, list.takeChanges());
+	CHECK(updates.size() == 2);
+
+	// a new subscription replaces the old one, empty views are removed
+	CHECK(subscribers.subscribe(conns[3], white, list));
+	CHECK(subscribers.size() == 4);
+	CHECK(subscribers.getViewCount() == 2);
+
+	CHECK(subscribers.unsubscribe(conns[0]));
+	CHECK(!subscribers.unsubscribe(conns[0]));
+	CHECK(subscribers.getViewCount() == 1);
+
+	CHECK(subscribers.unsubscribe(conns[1]));
+	CHECK(subscribers.unsubscribe(conns[2]));
+	CHECK(subscribers.unsubscribe(conns[3]));
+	CHECK(subscribers.empty());
+	CHECK(subscribers.getViewCount() == 0);
+}
+
+int main()
+{
+	testChanges();
+	testSlices();
+	testSubscribers();
+
+	return check::result();
+}
@@ -0,0 +1,203 @@
+/* Copyright 2015 Jonas Platte
+ *
+ * This file is part of Cyvasse Online.
+ *
+ * Cyvasse Online is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Affero General Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later version.
+ *
+ * Cyvasse Online is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE. See the GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License along with this program.
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../src/match_archive.hpp"
+
+#include <stdexcept>
+#include <string>
+#include <cstddef>
+#include <fcntl.h>
+#include <unistd.h>
+#include <json/value.h>
+#include "../src/b64.hpp"
+#include "../src/protocol_ext.hpp"
+#include "check.hpp"
+
+using namespace cyvasse;
+using namespace std;
+
+static const char* fileName = "match_archive_test.arch";
+
+static MatchHistory history(const string& white, const string& black, MatchResult result, int winner)
+{
+	MatchHistory ret;
+	ret.started   = true;
+	ret.playerIDs = {{white, black}};
+	ret.usernames = {{"alice", "bob"}};
+	ret.result    = result;
+	ret.winner    = winner;
+
+	ret.opening[BoardSnapshot::index(BoardSnapshot::Coordinate(5, 1))] = uint8_t(int(PieceType::KING) + 1);
+	ret.moves.push_back(uint16_t(BoardSnapshot::index(BoardSnapshot::Coordinate(5, 1)) << 8 |
+		BoardSnapshot::index(BoardSnapshot::Coordinate(5, 2))));
+	ret.moves.push_back(MatchHistory::promotion(BoardSnapshot::Coordinate(3, 4), PieceType::DRAGON));
+
+	return ret;
+}
+
+static void testAppendAndQuery()
+{
+	MatchArchive archive(fileName, 1 << 20);
+	CHECK(archive.size() == 0);
+
+	CHECK(archive.append(1, 1000, history("AAAAAAAA", "BBBBBBBB", MatchResult::KING_CAPTURED, 0)));
+	CHECK(archive.append(2, 1001, history("CCCCCCCC", "AAAAAAAA", MatchResult::TIMEOUT, 1)));
+	CHECK(archive.append(3, 1002, history("CCCCCCCC", "BBBBBBBB", MatchResult::ABANDONED, -1)));
+	CHECK(archive.size() == 3);
+
+	auto recent = archive.getRecent(2);
+	CHECK(recent.size() == 2);
+	CHECK(recent.size() == 2 && recent[0].getMatchID() == 3 && recent[1].getMatchID() == 2);
+
+	auto byPlayer = archive.getByPlayer("AAAAAAAA", 10);
+	CHECK(byPlayer.size() == 2);
+	CHECK(byPlayer.size() == 2 && byPlayer[0].getMatchID() == 2 && byPlayer[1].getMatchID() == 1);
+	CHECK(archive.getByPlayer("DDDDDDDD", 10).empty());
+
+	MatchArchive::ArchivedMatch match;
+	CHECK(!archive.find(4, match));
+	CHECK(archive.find(1, match));
+
+	CHECK(match.getFinishTime() == 1000);
+	CHECK(match.getResult() == MatchResult::KING_CAPTURED);
+	CHECK(match.getWinner() == 0);
+	CHECK(match.getPlayerID(0) == "AAAAAAAA");
+	CHECK(match.getPlayerID(1) == "BBBBBBBB");
+	CHECK(match.getUsername(0) == "alice");
+	CHECK(match.getUsername(1) == "bob");
+	CHECK(match.getMoveCount() == 2);
+}
+
+static void testReopen()
+{
+	// the indexes are rebuilt from the file
+	MatchArchive archive(fileName, 1 << 20);
+	CHECK(archive.size() == 3);
+	CHECK(archive.getByPlayer("CCCCCCCC", 10).size() == 2);
+
+	MatchArchive::ArchivedMatch match;
+	CHECK(archive.find(3, match) && match.getResult() == MatchResult::ABANDONED && match.getWinner() == -1);
+
+	CHECK(archive.append(4, 1003, history("DDDDDDDD", "AAAAAAAA", MatchResult::TIMEOUT, 0)));
+	CHECK(archive.getRecent(10).size() == 4);
+}
+
+static void testTwoProcesses()
+{
+	unlink(fileName);
+
+	// like an old process draining after a handoff and its successor
+	MatchArchive old(fileName, 1 << 20);
+	MatchArchive successor(fileName, 1 << 20);
+
+	CHECK(old.append(1, 1000, history("AAAAAAAA", "BBBBBBBB", MatchResult::TIMEOUT, 0)));
+	CHECK(successor.append(2, 1001, history("CCCCCCCC", "AAAAAAAA", MatchResult::TIMEOUT, 1)));
+	CHECK(old.append(3, 1002, history("CCCCCCCC", "BBBBBBBB", MatchResult::ABANDONED, -1)));
+
+	CHECK(old.size() == 3);
+	CHECK(successor.size() == 3);
+	CHECK(successor.getByPlayer("AAAAAAAA", 10).size() == 2);
+
+	MatchArchive::ArchivedMatch match;
+	CHECK(successor.find(3, match) && match.getPlayerID(0) == "CCCCCCCC");
+	CHECK(old.find(2, match) && match.getUsername(1) == "bob");
+}
+
+static void testCorrupt()
+{
+	unlink(fileName);
+
+	{
+		MatchArchive archive(fileName, 1 << 20);
+		CHECK(archive.append(1, 1000, history("AAAAAAAA", "BBBBBBBB", MatchResult::TIMEOUT, 0)));
+	}
+
+	// more moves than fit into the record, the first one starts after the 16 byte file header
+	int fd = open(fileName, O_RDWR);
+	uint16_t moveCount = 1000;
+	CHECK(pwrite(fd, &moveCount, sizeof(moveCount), 16 + offsetof(MatchArchive::RecordHeader, moveCount)) == sizeof(moveCount));
+	close(fd);
+
+	bool thrown = false;
+	try
+	{
+		MatchArchive archive(fileName, 1 << 20);
+	}
+	catch (runtime_error&)
+	{
+		thrown = true;
+	}
+
+	CHECK(thrown);
+}
+
+static void testFull()
+{
+	unlink(fileName);
+
+	// the maximum size is rounded up to a megabyte, a record takes a bit over 200 bytes
+	MatchArchive archive(fileName, 1);
+
+	uint32_t matchID = 0;
+	while (archive.append(++matchID, 0, history("AAAAAAAA", "BBBBBBBB", MatchResult::ABANDONED, -1)))
+		;
+
+	CHECK(archive.size() == matchID - 1);
+	CHECK(archive.getBytes() <= archive.getMaxSize());
+}
+
+static void testJson()
+{
+	MatchArchive archive(fileName, 1 << 20);
+
+	MatchArchive::ArchivedMatch match;
+	CHECK(archive.find(2, match));
+
+	auto summary = ArchiveJson::summary(match);
+	CHECK(summary[ArchiveExt::MATCH_ID].asString() == int24ToB64ID(2));
+	CHECK(summary[ArchiveExt::RESULT].asString() == ArchiveExt::TIMEOUT);
+	CHECK(summary[ArchiveExt::WINNER].asString() == "black");
+	CHECK(summary[ArchiveExt::PLAYERS]["white"][ArchiveExt::PLAYER_ID].asString() == "CCCCCCCC");
+	CHECK(summary[ArchiveExt::PLAYERS]["black"][ArchiveExt::USERNAME].asString() == "bob");
+
+	auto replay = ArchiveJson::replay(match);
+	const auto& moves = replay[ArchiveExt::MOVES];
+	CHECK(moves.size() == 2);
+
+	CHECK(moves[0][0][0].asInt() == 5 && moves[0][0][1].asInt() == 1);
+	CHECK(moves[0][1][0].asInt() == 5 && moves[0][1][1].asInt() == 2);
+
+	CHECK(moves[1][0][0].asInt() == 3 && moves[1][0][1].asInt() == 4);
+	CHECK(moves[1][1].asString() == PieceTypeToStr(PieceType::DRAGON));
+
+	CHECK(archive.find(3, match));
+	CHECK(!ArchiveJson::summary(match).isMember(ArchiveExt::WINNER));
+}
+
+int main()
+{
+	unlink(fileName);
+
+	testAppendAndQuery();
+	testReopen();
+	testJson();
+	testTwoProcesses();
+	testCorrupt();
+	testFull();
+
+	unlink(fileName);
+	return check::result();
+}
@@ -0,0 +1,111 @@
+/* Copyright 2015 Jonas Platte
+ *
+ * This file is part of Cyvasse Online.
+ *
+ * Cyvasse Online is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Affero General Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later version.
+ *
+ * Cyvasse Online is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE. See the GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License along with this program.
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../src/raw_json.hpp"
+
+#include <string>
+#include "check.hpp"
+
+using namespace std;
+
+static bool valid(const string& json)
+{
+	return RawJsonObject(json).valid();
+}
+
+int main()
+{
+	// well-formed objects
+	CHECK(valid("{}"));
+	CHECK(valid(" { } \n"));
+	CHECK(valid(R"({"a":1,"b":"x","c":[1,2,{"d":null}],"e":true,"f":false})"));
+	CHECK(valid(R"({"a":-0.5e+10,"b":0,"c":12.25,"d":1E3})"));
+	CHECK(valid(R"({"a":"\"\\\/\b\f\n\r\té"})"));
+	CHECK(valid(R"({"a":[],"b":{},"c":[[]]})"));
+
+	// structure
+	CHECK(!valid(""));
+	CHECK(!valid("[]"));
+	CHECK(!valid("{"));
+	CHECK(!valid(R"({"a":[})"));
+	CHECK(!valid(R"({"a":{]})"));
+	CHECK(!valid(R"({"a":[1,]})"));
+	CHECK(!valid(R"({"a":[,1]})"));
+	CHECK(!valid(R"({"a":{"b"}})"));
+	CHECK(!valid(R"({"a":{1:2}})"));
+	CHECK(!valid(R"({"a":1,})"));
+	CHECK(!valid(R"({"a":1} x)"));
+	CHECK(!valid(R"({"a":1 "b":2})"));
+
+	// literals
+	CHECK(!valid(R"({"a":tru})"));
+	CHECK(!valid(R"({"a":truex})"));
+	CHECK(!valid(R"({"a":nul})"));
+	CHECK(!valid(R"({"a":False})"));
+	CHECK(!valid(R"({"a":undefined})"));
+
+	// numbers
+	CHECK(!valid(R"({"a":01})"));
+	CHECK(!valid(R"({"a":-})"));
+	CHECK(!valid(R"({"a":1.})"));
+	CHECK(!valid(R"({"a":.5})"));
+	CHECK(!valid(R"({"a":1e})"));
+	CHECK(!valid(R"({"a":+1})"));
+	CHECK(!valid(R"({"a":0x10})"));
+
+	// strings
+	CHECK(!valid(R"({"a":"x})"));
+	CHECK(!valid(R"({"a":"\x"})"));
+	CHECK(!valid(R"({"a":"\u12"})"));
+	CHECK(!valid(R"({"a":"\u12g4"})"));
+	CHECK(!valid("{\"a\":\"x\ny\"}"));
+	CHECK(!valid(string("{\"a\":\"\\\0\"}", 8)));
+
+	// nesting limit, a member's value is at depth 1
+	string deep = "{\"a\":" + string(RawJsonObject::maxDepth, '[');
+	CHECK(valid(deep + string(RawJsonObject::maxDepth, ']') + "}"));
+	CHECK(!valid(deep + "[]" + string(RawJsonObject::maxDepth, ']') + "}"));
+
+	// member limit
+	string members = "{";
+	for (size_t i = 0; i < RawJsonObject::maxMembers; i++)
+		members += "\"m" + to_string(i) + "\":" + to_string(i) + ",";
+	members.back() = '}';
+	CHECK(valid(members));
+	members.back() = ',';
+	CHECK(!valid(members + "\"x\":0}"));
+
+	// lookups
+	string json = R"({"type": "relay", "data": {"x": [1, 2]}, "esc": "a\"b"})";
+	RawJsonObject object(json);
+	CHECK(object.valid());
+
+	string value;
+	CHECK(object.getString("type", value) && value == "relay");
+	CHECK(!object.getString("data", value));
+	CHECK(!object.getString("esc", value));
+	CHECK(!object.find("missing"));
+
+	auto data = object.find("data");
+	CHECK(data && json.substr(data->valueBegin, data->valueEnd - data->valueBegin) == R"({"x": [1, 2]})");
+
+	// a sub range of a larger buffer
+	string framed = "xx{\"a\":1}yy";
+	CHECK(RawJsonObject(framed, 2, 9).valid());
+	CHECK(!RawJsonObject(framed, 2).valid());
+
+	return check::result();
+}
@@ -0,0 +1,209 @@
+/* Copyright 2015 Jonas Platte
+ *
+ * This file is part of Cyvasse Online.
+ *
+ * Cyvasse Online is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Affero General Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later version.
+ *
+ * Cyvasse Online is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE. See the GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License along with this program.
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+// Compares the accept paths of the server (ioUringAccept: true / false in
+// config.yml): opens idle websocket connections as fast as possible, keeping
+// a fixed number of handshakes in flight, and keeps them open for a while
+// like lobby clients that wait for an opponent. Reports the connections per
+// second and, if the server's pid is given, the CPU time the server used
+// while they were opened and while they were idle.
+
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <cstdlib>
+
+#include <unistd.h>
+#include <websocketpp/config/asio_no_tls_client.hpp>
+#include <websocketpp/client.hpp>
+
+using namespace std;
+using namespace std::chrono;
+using namespace websocketpp;
+
+typedef client<config::asio_client> WSClient;
+typedef steady_clock Clock;
+
+struct Options
+{
+	string uri = "ws://localhost:2516/";
+
+	unsigned connections = 5000;
+	unsigned inFlight = 64;   // handshakes at the same time
+	unsigned idleSeconds = 10;
+	pid_t serverPid = 0;
+};
+
+// user + system time of a process in clock ticks, 0 if it can't be read
+static uint64_t cpuTicks(pid_t pid)
+{
+	ifstream stat("/proc/" + to_string(pid) + "/stat");
+	string line;
+	if (!getline(stat, line))
+		return 0;
+
+	// the command name can contain spaces, the fields after it can't
+	istringstream fields(line.substr(line.rfind(')') + 2));
+
+	string field;
+	uint64_t utime = 0, stime = 0;
+	for (int i = 3; i <= 15 && fields >> field; i++)
+	{
+		if (i == 14)
+			utime = stoull(field);
+		else if (i == 15)
+			stime = stoull(field);
+	}
+
+	return utime + stime;
+}
+
+static double ticksToMs(uint64_t ticks)
+{
+	return ticks * 1000.0 / sysconf(_SC_CLK_TCK);
+}
+
+static void usage(const char* name)
+{
+	cerr << "usage: " << name << " [-n connections] [-f in-flight] [-t idle-seconds] [-P server-pid] [uri]\n"
+	     << "  -n  connections to open (default 5000)\n"
+	     << "  -f  handshakes in flight at the same time (default 64)\n"
+	     << "  -t  seconds to keep the connections open afterwards (default 10)\n"
+	     << "  -P  pid of the server, to report the CPU time it used\n"
+	     << "  uri defaults to ws://localhost:2516/\n";
+}
+
+int main(int argc, char** argv)
+{
+	Options opts;
+
+	int opt;
+	while ((opt = getopt(argc, argv, "n:f:t:P:h")) != -1)
+	{
+		switch (opt)
+		{
+			case 'n': opts.connections = strtoul(optarg, nullptr, 10); break;
+			case 'f': opts.inFlight = strtoul(optarg, nullptr, 10); break;
+			case 't': opts.idleSeconds = strtoul(optarg, nullptr, 10); break;
+			case 'P': opts.serverPid = strtoul(optarg, nullptr, 10); break;
+			default:
+				usage(argv[0]);
+				return 2;
+		}
+	}
+
+	if (argc - optind > 1 || opts.connections == 0 || opts.inFlight == 0)
+	{
+		usage(argv[0]);
+		return 2;
+	}
+
+	if (optind < argc)
+		opts.uri = argv[optind];
+
+	try
+	{
+		WSClient client;
+		client.clear_access_channels(log::alevel::all);
+		client.clear_error_channels(log::elevel::all);
+		client.init_asio();
+
+		vector<connection_hdl> open;
+		open.reserve(opts.connections);
+
+		unsigned started = 0, failed = 0;
+		Clock::time_point connectedAt;
+		uint64_t ticksAtStart = 0, ticksConnected = 0, ticksIdle = 0;
+
+		auto connectNext = [&] {
+			if (started == opts.connections)
+				return;
+
+			started++;
+
+			lib::error_code ec;
+			auto con = client.get_connection(opts.uri, ec);
+			if (ec)
+				throw runtime_error("couldn't connect to " + opts.uri + ": " + ec.message());
+
+			client.connect(con);
+		};
+
+		auto finished = [&] {
+			if (open.size() + failed < opts.connections)
+				return;
+
+			connectedAt = Clock::now();
+			if (opts.serverPid)
+				ticksConnected = cpuTicks(opts.serverPid);
+
+			// stay idle, the server pings the connections as usual
+			client.set_timer(opts.idleSeconds * 1000, [&](const lib::error_code&) {
+				if (opts.serverPid)
+					ticksIdle = cpuTicks(opts.serverPid);
+
+				for (auto&& hdl : open)
+				{
+					lib::error_code ec;
+					client.close(hdl, close::status::normal, "", ec);
+				}
+			});
+		};
+
+		client.set_open_handler([&](connection_hdl hdl) {
+			open.push_back(hdl);
+			connectNext();
+			finished();
+		});
+
+		client.set_fail_handler([&](connection_hdl) {
+			failed++;
+			connectNext();
+			finished();
+		});
+
+		if (opts.serverPid)
+			ticksAtStart = cpuTicks(opts.serverPid);
+
+		auto start = Clock::now();
+
+		for (unsigned i = 0; i < opts.inFlight; i++)
+			connectNext();
+
+		client.run();
+
+		auto elapsed = duration_cast<duration<double>>(connectedAt - start).count();
+
+		cout << "connected:        " << open.size() << " of " << opts.connections << " (" << failed << " failed)\n"
+		     << "connect rate:     " << static_cast<uint64_t>(open.size() / elapsed) << " conn/s\n";
+
+		if (opts.serverPid)
+		{
+			cout << "server cpu:       " << ticksToMs(ticksConnected - ticksAtStart) << " ms connecting, "
+			     << ticksToMs(ticksIdle - ticksConnected) << " ms idle\n";
+		}
+
+		return failed == 0 ? 0 : 1;
+	}
+	catch (std::exception& e)
+	{
+		cerr << "error: " << e.what() << endl;
+		return 2;
+	}
+}
@@ -0,0 +1,352 @@
+/* Copyright 2015 Jonas Platte
+ *
+ * This file is part of Cyvasse Online.
+ *
+ * Cyvasse Online is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Affero General Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later version.
+ *
+ * Cyvasse Online is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE. See the GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License along with this program.
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+// Counts the leaves of the move tree to a given depth (perft) from a few
+// canned setups. The count is done with the move generation of
+// cyvasse::Piece, which the server validates moves with and the bots pick
+// their moves from (Position::legalMoves), and then with the approximation
+// of Position that the bots search with, which is also split across the
+// root moves on a WorkStealingPool. Depths where the two counts differ are
+// marked. The opening arrays are loaded like the ones of clients:
+// serialized to a setOpeningArray param, then json::pieceMap and
+// evalOpeningArray.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <iostream>
+#include <iomanip>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cstdlib>
+
+#include <unistd.h>
+#include <json/value.h>
+#include <json/reader.h>
+#include <json/writer.h>
+#include <cyvasse/match.hpp>
+#include <cyvasse/piece.hpp>
+#include <cyvws/json_game_msg.hpp>
+
+#include "../src/board_snapshot.hpp"
+#include "../src/position.hpp"
+#include "../src/work_stealing_pool.hpp"
+
+using namespace std;
+using namespace std::chrono;
+using namespace cyvasse;
+using namespace cyvws;
+
+typedef steady_clock Clock;
+
+struct Options
+{
+	unsigned depth   = 4;
+	unsigned threads = max(1u, thread::hardware_concurrency());
+	string opening; // empty = all
+};
+
+struct Opening
+{
+	const char* name;
+	Position::OpeningArray black; // white's is mirrored
+};
+
+static BoardSnapshot::Coordinate at(int x, int y)
+{ return BoardSnapshot::Coordinate(x, y); }
+
+static vector<Opening> openings()
+{
+	return {
+		{"standard", Position::standardOpening(PlayersColor::BLACK)},
+		{"wide", {
+			{PieceType::DRAGON,      at(5, 0)}, {PieceType::TREBUCHET,   at(6, 0)}, {PieceType::KING,        at(7, 0)},
+			{PieceType::TREBUCHET,   at(8, 0)}, {PieceType::ELEPHANT,    at(9, 0)}, {PieceType::ELEPHANT,    at(10, 0)},
+			{PieceType::CROSSBOWS,   at(4, 1)}, {PieceType::HEAVY_HORSE, at(5, 1)}, {PieceType::MOUNTAINS,   at(6, 1)},
+			{PieceType::MOUNTAINS,   at(7, 1)}, {PieceType::HEAVY_HORSE, at(8, 1)}, {PieceType::CROSSBOWS,   at(9, 1)},
+			{PieceType::SPEARS,      at(3, 2)}, {PieceType::LIGHT_HORSE, at(4, 2)}, {PieceType::MOUNTAINS,   at(7, 2)},
+			{PieceType::LIGHT_HORSE, at(9, 2)}, {PieceType::SPEARS,      at(10, 2)},
+			{PieceType::RABBLE,      at(2, 3)}, {PieceType::RABBLE,      at(4, 3)}, {PieceType::MOUNTAINS,   at(5, 3)},
+			{PieceType::RABBLE,      at(7, 3)}, {PieceType::MOUNTAINS,   at(9, 3)},
+			{PieceType::MOUNTAINS,   at(1, 4)}, {PieceType::RABBLE,      at(3, 4)}, {PieceType::RABBLE,      at(6, 4)},
+			{PieceType::RABBLE,      at(8, 4)}
+		}},
+		{"forward", {
+			{PieceType::MOUNTAINS,   at(5, 0)}, {PieceType::MOUNTAINS,   at(6, 0)}, {PieceType::KING,        at(7, 0)},
+			{PieceType::MOUNTAINS,   at(8, 0)}, {PieceType::MOUNTAINS,   at(9, 0)},
+			{PieceType::ELEPHANT,    at(4, 1)}, {PieceType::TREBUCHET,   at(5, 1)}, {PieceType::DRAGON,      at(6, 1)},
+			{PieceType::TREBUCHET,   at(7, 1)}, {PieceType::ELEPHANT,    at(8, 1)},
+			{PieceType::MOUNTAINS,   at(3, 2)}, {PieceType::HEAVY_HORSE, at(5, 2)}, {PieceType::CROSSBOWS,   at(6, 2)},
+			{PieceType::CROSSBOWS,   at(7, 2)}, {PieceType::HEAVY_HORSE, at(8, 2)}, {PieceType::MOUNTAINS,   at(10, 2)},
+			{PieceType::LIGHT_HORSE, at(2, 3)}, {PieceType::SPEARS,      at(4, 3)}, {PieceType::SPEARS,      at(8, 3)},
+			{PieceType::LIGHT_HORSE, at(10, 3)},
+			{PieceType::RABBLE,      at(1, 4)}, {PieceType::RABBLE,      at(3, 4)}, {PieceType::RABBLE,      at(5, 4)},
+			{PieceType::RABBLE,      at(6, 4)}, {PieceType::RABBLE,      at(8, 4)}, {PieceType::RABBLE,      at(10, 4)}
+		}}
+	};
+}
+
+// the setOpeningArray message a client would send for these pieces
+static string openingArrayParam(const Position::OpeningArray& pieces, PlayersColor color)
+{
+	int last = BoardSnapshot::gridSize - 1;
+
+	Json::Value param;
+	for (const auto& it : pieces)
+	{
+		auto coord = it.second;
+		if (color == PlayersColor::WHITE)
+			coord = at(last - coord.x(), last - coord.y());
+
+		param[PieceTypeToStr(it.first)].append(CoordJson::coordinate(coord));
+	}
+
+	return Json::FastWriter().write(param);
+}
+
+// puts the pieces on both the match and the board
+static void loadOpening(const Opening& opening, Match& match, BoardSnapshot& board)
+{
+	for (auto color : {PlayersColor::WHITE, PlayersColor::BLACK})
+	{
+		Json::Value param;
+		if (!Json::Reader().parse(openingArrayParam(opening.black, color), param, false))
+			throw runtime_error("can't parse the opening array");
+
+		// the same as Worker::processSetOpeningArrayMsg
+		const auto& pieces = json::pieceMap(param);
+		evalOpeningArray(pieces);
+
+		for (const auto& pmIt : pieces)
+		{
+			for (const auto& coord : pmIt.second)
+			{
+				match.getActivePieces().emplace(coord, make_shared<Piece>(color, pmIt.first, coord, match));
+				board.set(coord, color, pmIt.first);
+			}
+		}
+	}
+}
+
+static bool hasKing(Match& match, PlayersColor color)
+{
+	for (const auto& it : match.getActivePieces())
+		if (it.second->getColor() == color && it.second->getType() == PieceType::KING)
+			return true;
+
+	return false;
+}
+
+// moves are applied like Worker::processMoveMsg does and taken back the same way
+static uint64_t perft(Match& match, PlayersColor toMove, unsigned depth)
+{
+	if (!hasKing(match, toMove))
+		return 1;
+
+	Position::MoveList moves;
+	Position::legalMoves(match, toMove, moves);
+
+	if (depth == 1)
+		return moves.size;
+
+	auto& pieces = match.getActivePieces();
+
+	uint64_t nodes = 0;
+	for (auto move : moves)
+	{
+		auto from = Position::toCoordinate(move.from);
+		auto to   = Position::toCoordinate(move.to);
+
+		auto piece = pieces.at(from);
+		shared_ptr<Piece> captured;
+
+		auto capturedIt = pieces.find(to);
+		if (capturedIt != pieces.end())
+		{
+			captured = capturedIt->second;
+			pieces.erase(capturedIt);
+		}
+
+		piece->moveTo(to, false);
+		nodes += perft(match, !toMove, depth - 1);
+		piece->moveTo(from, false);
+
+		if (captured)
+			pieces.emplace(to, captured);
+	}
+
+	return nodes;
+}
+
+static uint64_t perft(Position& pos, unsigned depth)
+{
+	if (pos.isLost())
+		return 1;
+
+	Position::MoveList moves;
+	pos.generateMoves(moves);
+
+	if (depth == 1)
+		return moves.size;
+
+	uint64_t nodes = 0;
+	for (auto move : moves)
+	{
+		auto captured = pos.make(move);
+		nodes += perft(pos, depth - 1);
+		pos.unmake(move, captured);
+	}
+
+	return nodes;
+}
+
+static uint64_t parallelPerft(WorkStealingPool& pool, const Position& root, unsigned depth)
+{
+	if (depth < 2)
+	{
+		Position pos = root;
+		return perft(pos, depth);
+	}
+
+	promise<uint64_t> result;
+
+	pool.post([&] {
+		Position::MoveList moves;
+		root.generateMoves(moves);
+
+		atomic<uint64_t> nodes = {0};
+		WorkStealingPool::TaskGroup group;
+
+		for (auto move : moves)
+		{
+			pool.post(group, [&, move] {
+				Position pos = root;
+				pos.make(move);
+				nodes += perft(pos, depth - 1);
+			});
+		}
+
+		pool.wait(group);
+		result.set_value(nodes);
+	});
+
+	return result.get_future().get();
+}
+
+static void usage(const char* name)
+{
+	cerr << "usage: " << name << " [-d depth] [-t threads] [opening]\n"
+	     << "  -d  plies to count (default 4)\n"
+	     << "  -t  threads of the parallel count (default: number of cores)\n"
+	     << "  opening is one of standard, wide, forward (default: all)\n";
+}
+
+int main(int argc, char** argv)
+{
+	Options opts;
+
+	int opt;
+	while ((opt = getopt(argc, argv, "d:t:h")) != -1)
+	{
+		switch (opt)
+		{
+			case 'd': opts.depth = strtoul(optarg, nullptr, 10); break;
+			case 't': opts.threads = strtoul(optarg, nullptr, 10); break;
+			default:
+				usage(argv[0]);
+				return 2;
+		}
+	}
+
+	if (argc - optind > 1 || opts.depth == 0 || opts.threads == 0)
+	{
+		usage(argv[0]);
+		return 2;
+	}
+
+	if (optind < argc)
+		opts.opening = argv[optind];
+
+	try
+	{
+		WorkStealingPool pool(opts.threads);
+		bool found = false;
+
+		cout << "opening    depth          nodes   cyvasse (Mn/s)   position nodes   1 thread (Mn/s)   "
+		     << opts.threads << " threads (Mn/s)   speedup\n";
+
+		for (const auto& opening : openings())
+		{
+			if (!opts.opening.empty() && opts.opening != opening.name)
+				continue;
+
+			found = true;
+
+			Match match(opening.name);
+			BoardSnapshot board;
+			loadOpening(opening, match, board);
+
+			Position root(board, PlayersColor::WHITE);
+
+			for (unsigned depth = 1; depth <= opts.depth; depth++)
+			{
+				auto start = Clock::now();
+				auto matchNodes = perft(match, PlayersColor::WHITE, depth);
+				auto matchTime = duration_cast<duration<double>>(Clock::now() - start).count();
+
+				start = Clock::now();
+				Position pos = root;
+				auto nodes = perft(pos, depth);
+				auto single = duration_cast<duration<double>>(Clock::now() - start).count();
+
+				start = Clock::now();
+				auto parallelNodes = parallelPerft(pool, root, depth);
+				auto parallel = duration_cast<duration<double>>(Clock::now() - start).count();
+
+				if (parallelNodes != nodes)
+					throw logic_error("the parallel count differs: " + to_string(parallelNodes));
+
+				cout << left << setw(10) << opening.name << right
+				     << setw(6) << depth
+				     << setw(15) << matchNodes
+				     << fixed << setprecision(1)
+				     << setw(17) << matchNodes / matchTime / 1e6
+				     << setw(17) << nodes
+				     << setw(18) << nodes / single / 1e6
+				     << setw(21) << nodes / parallel / 1e6
+				     << setprecision(2)
+				     << setw(10) << single / parallel
+				     << (nodes != matchNodes ? "   differs" : "") << "\n";
+			}
+		}
+
+		if (!found)
+		{
+			usage(argv[0]);
+			return 2;
+		}
+
+		return 0;
+	}
+	catch (std::exception& e)
+	{
+		cerr << "error: " << e.what() << endl;
+		return 1;
+	}
+}
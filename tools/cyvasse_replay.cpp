@@ -0,0 +1,558 @@
+/* Copyright 2015 Jonas Platte
+ *
+ * This file is part of Cyvasse Online.
+ *
+ * Cyvasse Online is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Affero General Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later version.
+ *
+ * Cyvasse Online is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE. See the GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License along with this program.
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+// Feeds a traffic capture (see src/capture.hpp) back into a server. Every
+// captured connection gets its own client connection, and its messages are
+// sent in their original order, each one only after the replies the original
+// client had received before sending it. Match and player IDs the original
+// server handed out are replaced by the ones the replayed server hands out.
+// The server replies are checked against the captured ones (same order, same
+// outcome), and the reply latencies are reported.
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <cstdlib>
+
+#include <unistd.h>
+#include <json/reader.h>
+#include <json/value.h>
+#include <json/writer.h>
+#include <websocketpp/config/asio_no_tls_client.hpp>
+#include <websocketpp/client.hpp>
+#include <cyvws/common.hpp>
+#include <cyvws/msg.hpp>
+#include <cyvws/server_reply.hpp>
+
+#include "../src/capture.hpp"
+
+using namespace std;
+using namespace std::chrono;
+using namespace cyvws;
+using namespace websocketpp;
+
+typedef client<config::asio_client> WSClient;
+typedef steady_clock Clock;
+
+struct ScriptMsg
+{
+	uint64_t time;
+	string payload;
+	int64_t msgID; // -1 = none
+
+	// replies the original client had received before sending this
+	size_t repliesBefore;
+
+	// match / player IDs from earlier replies that have to be replaced
+	vector<string> referencedIDs;
+};
+
+struct ExpectedReply
+{
+	unsigned msgID;
+	bool success;
+
+	// captured value -> field name, for IDs this reply handed out
+	map<string, string> handedOut;
+};
+
+struct ReplayConn
+{
+	uint64_t capturedID;
+	uint64_t openTime  = 0;
+	uint64_t closeTime = UINT64_MAX;
+
+	vector<ScriptMsg> msgs;
+	vector<ExpectedReply> replies;
+
+	connection_hdl hdl;
+	bool opened  = false;
+	bool closing = false;
+	bool closed  = false;
+
+	size_t nextMsg = 0;
+	size_t repliesReceived = 0;
+
+	map<unsigned, Clock::time_point> pending;
+
+	bool done() const
+	{ return nextMsg == msgs.size() && repliesReceived >= replies.size(); }
+};
+
+struct Options
+{
+	string captureFile;
+	string uri = "ws://localhost:2516/";
+
+	double speed = 0; // 0 = as fast as possible
+	size_t maxConnections = 1000;
+	unsigned idleTimeout = 10; // seconds
+};
+
+static bool isServerReply(const Json::Value& msg)
+{ return msg[MSG_TYPE].asString() == MsgType::SERVER_REPLY; }
+
+static void collectStrings(const Json::Value& val, const set<string>& ids, vector<string>& out)
+{
+	if (val.isString())
+	{
+		if (ids.count(val.asString()))
+			out.push_back(val.asString());
+	}
+	else if (val.isObject() || val.isArray())
+	{
+		for (const auto& elem : val)
+			collectStrings(elem, ids, out);
+	}
+}
+
+static void replaceStrings(Json::Value& val, const map<string, string>& idMap)
+{
+	if (val.isString())
+	{
+		auto it = idMap.find(val.asString());
+		if (it != idMap.end())
+			val = it->second;
+	}
+	else if (val.isObject() || val.isArray())
+	{
+		for (auto& elem : val)
+			replaceStrings(elem, idMap);
+	}
+}
+
+class Replay
+{
+	private:
+		const Options& m_opts;
+
+		WSClient m_client;
+		unique_ptr<lib::asio::steady_timer> m_timer;
+
+		vector<unique_ptr<ReplayConn>> m_conns; // in order of their OPEN records
+		map<connection_hdl, ReplayConn*, owner_less<connection_hdl>> m_byHdl;
+		set<ReplayConn*> m_active;
+
+		size_t m_nextOpen = 0;
+		size_t m_open = 0;
+		size_t m_finished = 0;
+
+		// captured ID -> ID handed out by the replayed server
+		map<string, string> m_idMap;
+
+		Clock::time_point m_start;
+		Clock::time_point m_lastProgress;
+
+		uint64_t m_sent = 0;
+		uint64_t m_received = 0;
+		uint64_t m_mismatches = 0;
+		uint64_t m_failedConns = 0;
+
+		vector<uint64_t> m_latencies; // µs
+
+		Clock::time_point releaseTime(uint64_t captureTime) const
+		{
+			return m_start + microseconds(static_cast<uint64_t>(captureTime / m_opts.speed));
+		}
+
+		bool due(uint64_t captureTime) const
+		{ return m_opts.speed == 0 || Clock::now() >= releaseTime(captureTime); }
+
+		void load()
+		{
+			CaptureReader reader(m_opts.captureFile);
+			CaptureRecord record;
+
+			map<uint64_t, ReplayConn*> conns;
+			vector<pair<ReplayConn*, CaptureRecord>> records;
+
+			while (reader.next(record))
+			{
+				if (record.type == CaptureRecordType::OPEN)
+				{
+					m_conns.emplace_back(new ReplayConn);
+					m_conns.back()->capturedID = record.connID;
+					m_conns.back()->openTime   = record.time;
+
+					conns[record.connID] = m_conns.back().get();
+					continue;
+				}
+
+				// connection was opened before the capture started
+				auto it = conns.find(record.connID);
+				if (it == conns.end())
+					continue;
+
+				if (record.type == CaptureRecordType::CLOSE)
+				{
+					it->second->closeTime = record.time;
+					conns.erase(it);
+				}
+				else
+					records.emplace_back(it->second, move(record));
+			}
+
+			Json::Reader jsonReader;
+			set<string> handedOut;
+
+			for (auto&& entry : records)
+			{
+				auto conn = entry.first;
+				auto& rec = entry.second;
+
+				Json::Value msg;
+				if (!jsonReader.parse(rec.payload, msg, false))
+					msg = Json::Value();
+
+				if (rec.type == CaptureRecordType::SENT)
+				{
+					if (!isServerReply(msg))
+						continue;
+
+					ExpectedReply reply;
+					reply.msgID   = msg[MSG_ID].asUInt();
+					reply.success = msg[REPLY_DATA][SUCCESS].asBool();
+
+					for (auto field : {MATCH_ID, PLAYER_ID})
+					{
+						const auto& val = msg[REPLY_DATA][field];
+						if (val.isString())
+						{
+							reply.handedOut[val.asString()] = field;
+							handedOut.insert(val.asString());
+						}
+					}
+
+					conn->replies.push_back(move(reply));
+				}
+				else
+				{
+					ScriptMsg scriptMsg;
+					scriptMsg.time          = rec.time;
+					scriptMsg.msgID         = msg[MSG_ID].isNull() ? -1 : msg[MSG_ID].asUInt();
+					scriptMsg.repliesBefore = conn->replies.size();
+					scriptMsg.payload       = move(rec.payload);
+
+					collectStrings(msg, handedOut, scriptMsg.referencedIDs);
+
+					conn->msgs.push_back(move(scriptMsg));
+				}
+			}
+		}
+
+		void openConnections()
+		{
+			while (m_nextOpen < m_conns.size() && m_open < m_opts.maxConnections &&
+			       due(m_conns[m_nextOpen]->openTime))
+			{
+				auto conn = m_conns[m_nextOpen++].get();
+
+				lib::error_code ec;
+				auto con = m_client.get_connection(m_opts.uri, ec);
+				if (ec)
+					throw runtime_error("couldn't connect to " + m_opts.uri + ": " + ec.message());
+
+				conn->hdl = con->get_handle();
+				m_byHdl[conn->hdl] = conn;
+				m_open++;
+
+				m_client.connect(con);
+			}
+		}
+
+		// returns false if the connection waits for the capture clock
+		bool pump(ReplayConn& conn)
+		{
+			if (!conn.opened || conn.closing)
+				return true;
+
+			while (conn.nextMsg < conn.msgs.size())
+			{
+				auto& msg = conn.msgs[conn.nextMsg];
+
+				if (conn.repliesReceived < msg.repliesBefore)
+					return true;
+				if (!due(msg.time))
+					return false;
+
+				for (const auto& id : msg.referencedIDs)
+					if (!m_idMap.count(id))
+						return true;
+
+				string payload = msg.payload;
+				if (!msg.referencedIDs.empty())
+				{
+					Json::Value json;
+					Json::Reader().parse(msg.payload, json, false);
+					replaceStrings(json, m_idMap);
+					payload = Json::FastWriter().write(json);
+				}
+
+				lib::error_code ec;
+				m_client.send(conn.hdl, payload, frame::opcode::text, ec);
+				if (ec)
+					return true;
+
+				if (msg.msgID != -1)
+					conn.pending[msg.msgID] = Clock::now();
+
+				conn.nextMsg++;
+				m_sent++;
+				m_lastProgress = Clock::now();
+			}
+
+			if (!conn.done())
+				return true;
+
+			// the capture might end before the connection was closed
+			if (conn.closeTime != UINT64_MAX && !due(conn.closeTime))
+				return false;
+
+			lib::error_code ec;
+			m_client.close(conn.hdl, close::status::normal, "", ec);
+			conn.closing = true;
+
+			return true;
+		}
+
+		void pumpAll()
+		{
+			openConnections();
+
+			bool waiting = m_nextOpen < m_conns.size() && !due(m_conns[m_nextOpen]->openTime);
+			for (auto conn : m_active)
+				waiting |= !pump(*conn);
+
+			// waiting for the capture clock doesn't count as being stuck
+			if (waiting)
+				m_lastProgress = Clock::now();
+		}
+
+		void onMessage(connection_hdl hdl, WSClient::message_ptr wsMsg)
+		{
+			auto& conn = *m_byHdl.at(hdl);
+
+			m_received++;
+			m_lastProgress = Clock::now();
+
+			Json::Value msg;
+			if (!Json::Reader().parse(wsMsg->get_payload(), msg, false) || !isServerReply(msg))
+				return;
+
+			unsigned msgID = msg[MSG_ID].asUInt();
+
+			auto it = conn.pending.find(msgID);
+			if (it != conn.pending.end())
+			{
+				m_latencies.push_back(duration_cast<microseconds>(Clock::now() - it->second).count());
+				conn.pending.erase(it);
+			}
+
+			if (conn.repliesReceived >= conn.replies.size())
+			{
+				m_mismatches++;
+				return;
+			}
+
+			auto& expected = conn.replies[conn.repliesReceived++];
+			const auto& replyData = msg[REPLY_DATA];
+
+			if (expected.msgID != msgID || expected.success != replyData[SUCCESS].asBool())
+			{
+				m_mismatches++;
+				cerr << "connection " << conn.capturedID << ": reply " << conn.repliesReceived
+				     << " differs from the capture (msgID " << msgID << ", expected " << expected.msgID << ")\n";
+			}
+
+			bool newIDs = false;
+			for (auto&& id : expected.handedOut)
+			{
+				const auto& val = replyData[id.second];
+				if (val.isString())
+				{
+					m_idMap[id.first] = val.asString();
+					newIDs = true;
+				}
+			}
+
+			// other connections might have been waiting for these IDs
+			if (newIDs)
+				pumpAll();
+			else
+				pump(conn);
+		}
+
+		void onClosed(connection_hdl hdl, bool failed)
+		{
+			auto& conn = *m_byHdl.at(hdl);
+
+			if (failed || !conn.done())
+				m_failedConns++;
+
+			conn.closed = true;
+			m_active.erase(&conn);
+			m_open--;
+			m_finished++;
+			m_lastProgress = Clock::now();
+
+			if (m_finished == m_conns.size())
+				m_client.stop();
+			else
+				openConnections();
+		}
+
+		void tick()
+		{
+			m_timer->expires_from_now(milliseconds(1));
+			m_timer->async_wait([this](const lib::asio::error_code& ec) {
+				if (ec)
+					return;
+
+				if (Clock::now() - m_lastProgress > seconds(m_opts.idleTimeout))
+				{
+					cerr << "no progress for " << m_opts.idleTimeout << " seconds, giving up\n";
+					m_client.stop();
+					return;
+				}
+
+				// with speed 0 everything is driven by the replies
+				if (m_opts.speed != 0)
+					pumpAll();
+
+				tick();
+			});
+		}
+
+	public:
+		explicit Replay(const Options& opts)
+			: m_opts(opts)
+		{
+			using placeholders::_1;
+			using placeholders::_2;
+
+			m_client.init_asio();
+			m_timer = make_unique<lib::asio::steady_timer>(m_client.get_io_service());
+
+			m_client.clear_access_channels(log::alevel::all);
+			m_client.clear_error_channels(log::elevel::all);
+
+			m_client.set_open_handler([this](connection_hdl hdl) {
+				auto& conn = *m_byHdl.at(hdl);
+				conn.opened = true;
+				m_active.insert(&conn);
+				pump(conn);
+			});
+			m_client.set_message_handler(bind(&Replay::onMessage, this, _1, _2));
+			m_client.set_close_handler([this](connection_hdl hdl) { onClosed(hdl, false); });
+			m_client.set_fail_handler([this](connection_hdl hdl) { onClosed(hdl, true); });
+
+			load();
+		}
+
+		// returns false if the replay didn't match the capture
+		bool run()
+		{
+			if (m_conns.empty())
+				return true;
+
+			m_start = m_lastProgress = Clock::now();
+
+			openConnections();
+			tick();
+
+			m_client.run();
+
+			auto elapsed = duration_cast<duration<double>>(Clock::now() - m_start).count();
+
+			size_t stalled = m_conns.size() - m_finished;
+
+			cout << "connections:       " << m_conns.size() << " (" << m_failedConns << " failed, "
+			     << stalled << " stalled)\n"
+			     << "messages sent:     " << m_sent << '\n'
+			     << "messages received: " << m_received << '\n'
+			     << "reply mismatches:  " << m_mismatches << '\n'
+			     << "elapsed:           " << elapsed << " s (" << m_sent / elapsed << " msg/s)\n";
+
+			if (!m_latencies.empty())
+			{
+				sort(m_latencies.begin(), m_latencies.end());
+
+				auto percentile = [&](double p) {
+					return m_latencies[static_cast<size_t>(p * (m_latencies.size() - 1))];
+				};
+
+				cout << "reply latency:     p50 " << percentile(0.5) << " µs, p90 " << percentile(0.9)
+				     << " µs, p99 " << percentile(0.99) << " µs, max " << m_latencies.back() << " µs\n";
+			}
+
+			return m_mismatches == 0 && m_failedConns == 0 && stalled == 0;
+		}
+};
+
+static void usage(const char* name)
+{
+	cerr << "usage: " << name << " [-s speed] [-c max-connections] [-t idle-timeout] capture-file [uri]\n"
+	     << "  -s  1 replays at the original speed, 2 twice as fast, ...\n"
+	     << "      0 (default) sends every message as soon as the replies it depends on arrived\n"
+	     << "  -c  connections open at the same time (default 1000)\n"
+	     << "  -t  seconds without progress after which the replay is aborted (default 10)\n"
+	     << "  uri defaults to ws://localhost:2516/\n";
+}
+
+int main(int argc, char** argv)
+{
+	Options opts;
+
+	int opt;
+	while ((opt = getopt(argc, argv, "s:c:t:h")) != -1)
+	{
+		switch (opt)
+		{
+			case 's': opts.speed = atof(optarg); break;
+			case 'c': opts.maxConnections = strtoul(optarg, nullptr, 10); break;
+			case 't': opts.idleTimeout = strtoul(optarg, nullptr, 10); break;
+			default:
+				usage(argv[0]);
+				return 2;
+		}
+	}
+
+	if (optind == argc || argc - optind > 2 || opts.speed < 0 || opts.maxConnections == 0)
+	{
+		usage(argv[0]);
+		return 2;
+	}
+
+	opts.captureFile = argv[optind];
+	if (optind + 1 < argc)
+		opts.uri = argv[optind + 1];
+
+	try
+	{
+		Replay replay(opts);
+		return replay.run() ? 0 : 1;
+	}
+	catch (std::exception& e)
+	{
+		cerr << "error: " << e.what() << endl;
+		return 2;
+	}
+}
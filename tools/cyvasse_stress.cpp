@@ -0,0 +1,463 @@
+/* Copyright 2015 Jonas Platte
+ *
+ * This file is part of Cyvasse Online.
+ *
+ * Cyvasse Online is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Affero General Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later version.
+ *
+ * Cyvasse Online is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE. See the GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License along with this program.
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+// Load generator for checking how the server scales with its worker count
+// (see tools/scaling.sh). Every simulated match consists of two connections:
+// one creates a game, the other joins it, both set a username and then
+// exchange chat messages, each one acknowledged by the opponent, keeping a
+// fixed number of them in flight. Reports the relayed messages per second,
+// the chat message -> acknowledgement latency and messages that arrived out
+// of the order they were sent in.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cstdlib>
+
+#include <unistd.h>
+#include <json/reader.h>
+#include <json/value.h>
+#include <json/writer.h>
+#include <websocketpp/config/asio_no_tls_client.hpp>
+#include <websocketpp/client.hpp>
+#include <cyvws/common.hpp>
+#include <cyvws/msg.hpp>
+#include <cyvws/notification.hpp>
+#include <cyvws/server_reply.hpp>
+#include <cyvws/server_request.hpp>
+
+using namespace std;
+using namespace std::chrono;
+using namespace cyvws;
+using namespace websocketpp;
+
+typedef client<config::asio_client> WSClient;
+typedef steady_clock Clock;
+
+struct Options
+{
+	string uri = "ws://localhost:2516/";
+
+	unsigned matches = 200;
+	unsigned messages = 500; // chat messages per player
+	unsigned window = 8;     // unacknowledged chat messages per player
+	unsigned threads = 1;    // client threads
+	unsigned subscribers = 10;
+};
+
+struct Results
+{
+	mutex mtx;
+
+	uint64_t relayed = 0;
+	uint64_t reordered = 0;
+	uint64_t errors = 0;
+	unsigned finished = 0;
+
+	vector<uint64_t> latencies; // µs
+};
+
+class Player;
+
+// all connections of one client thread
+class StressClient
+{
+	private:
+		const Options& m_opts;
+		Results& m_results;
+
+		WSClient m_client;
+		map<connection_hdl, Player*, owner_less<connection_hdl>> m_players;
+
+		size_t m_open = 0;
+
+	public:
+		StressClient(const Options& opts, Results& results);
+
+		Results& results()
+		{ return m_results; }
+
+		const Options& opts() const
+		{ return m_opts; }
+
+		void connect(Player&);
+		void send(Player&, const Json::Value&);
+		void close(Player&);
+
+		void run()
+		{ m_client.run(); }
+};
+
+class Player
+{
+	private:
+		StressClient& m_client;
+
+		unsigned m_nextMsgID = 1;
+
+		uint64_t m_nextChat = 0;    // seq of the next chat message to send
+		uint64_t m_acked = 0;       // chat messages the opponent acknowledged
+		uint64_t m_lastRecvd = 0;   // last chat seq received from the opponent
+		uint64_t m_ackedRecvd = 0;  // acks sent for the opponent's messages
+
+		map<uint64_t, Clock::time_point> m_inFlight;
+
+		bool m_inMatch = false;
+		bool m_closed = false;
+
+	public:
+		connection_hdl hdl;
+		Player* opponent = nullptr;
+
+		// set by the creator when the createGame reply arrives
+		string matchID;
+
+		const bool creator;
+		const bool subscriber;
+		const string username;
+
+		Player(StressClient& client, bool creator_, bool subscriber_, string username_)
+			: m_client(client)
+			, creator(creator_)
+			, subscriber(subscriber_)
+			, username(move(username_))
+		{ }
+
+		bool finished() const
+		{
+			auto n = m_client.opts().messages;
+			return m_acked == n && m_ackedRecvd == n;
+		}
+
+		void request(const char* action, const Json::Value& param)
+		{
+			Json::Value msg;
+			msg[MSG_TYPE] = MsgType::SERVER_REQUEST;
+			msg[MSG_ID]   = m_nextMsgID++;
+			msg[REQUEST_DATA][ACTION] = action;
+			msg[REQUEST_DATA][PARAM]  = param;
+
+			m_client.send(*this, msg);
+		}
+
+		void onOpen()
+		{
+			if (subscriber)
+			{
+				Json::Value param;
+				param[LISTS].append(GamesList::OPEN_RANDOM_GAMES);
+				request(ServerRequestAction::SUBSCR_GAME_LIST_UPDATES, param);
+			}
+
+			if (creator)
+			{
+				// random, so the game lists change all the time
+				Json::Value param;
+				param[COLOR]  = "white";
+				param[RANDOM] = true;
+				request(ServerRequestAction::CREATE_GAME, param);
+			}
+			else
+			{
+				Json::Value param;
+				param[MATCH_ID] = opponent->matchID;
+				request(ServerRequestAction::JOIN_GAME, param);
+			}
+		}
+
+		void sendChats()
+		{
+			while (m_inMatch && m_nextChat < m_client.opts().messages &&
+			       m_nextChat - m_acked < m_client.opts().window)
+			{
+				Json::Value msg;
+				msg[MSG_TYPE] = MsgType::CHAT_MSG;
+				msg[MSG_ID]   = Json::Value::UInt64(++m_nextChat);
+				msg[MSG_DATA]["text"] = "stress test";
+
+				m_inFlight[m_nextChat] = Clock::now();
+				m_client.send(*this, msg);
+			}
+		}
+
+		void onMessage(const Json::Value& msg)
+		{
+			const auto& msgType = msg[MSG_TYPE].asString();
+			auto& results = m_client.results();
+
+			if (msgType == MsgType::SERVER_REPLY)
+			{
+				const auto& replyData = msg[REPLY_DATA];
+				if (!replyData[SUCCESS].asBool())
+				{
+					lock_guard<mutex> lock(results.mtx);
+					results.errors++;
+					return;
+				}
+
+				if (creator && !replyData[MATCH_ID].isNull() && matchID.empty())
+				{
+					// the opponent connects only after the game exists
+					matchID = replyData[MATCH_ID].asString();
+					m_client.connect(*opponent);
+				}
+				else if (!creator && !replyData[COLOR].isNull())
+				{
+					m_inMatch = opponent->m_inMatch = true;
+
+					Json::Value param = username;
+					request(ServerRequestAction::SET_USERNAME, param);
+					opponent->request(ServerRequestAction::SET_USERNAME, Json::Value(opponent->username));
+
+					sendChats();
+					opponent->sendChats();
+				}
+			}
+			else if (msgType == MsgType::CHAT_MSG)
+			{
+				auto seq = msg[MSG_ID].asUInt64();
+				if (seq != m_lastRecvd + 1)
+				{
+					lock_guard<mutex> lock(results.mtx);
+					results.reordered++;
+				}
+
+				m_lastRecvd = max(m_lastRecvd, seq);
+
+				Json::Value ack;
+				ack[MSG_TYPE] = MsgType::CHAT_MSG_ACK;
+				ack[MSG_ID]   = Json::Value::UInt64(seq);
+				m_client.send(*this, ack);
+
+				m_ackedRecvd++;
+			}
+			else if (msgType == MsgType::CHAT_MSG_ACK)
+			{
+				auto it = m_inFlight.find(msg[MSG_ID].asUInt64());
+				if (it == m_inFlight.end())
+					return;
+
+				{
+					lock_guard<mutex> lock(results.mtx);
+					results.latencies.push_back(duration_cast<microseconds>(Clock::now() - it->second).count());
+					results.relayed += 2;
+				}
+
+				m_inFlight.erase(it);
+				m_acked++;
+
+				sendChats();
+			}
+
+			if (finished() && opponent->finished())
+			{
+				m_client.close(*this);
+				m_client.close(*opponent);
+			}
+		}
+
+		void onClosed()
+		{
+			if (m_closed)
+				return;
+
+			m_closed = true;
+
+			auto& results = m_client.results();
+			lock_guard<mutex> lock(results.mtx);
+
+			if (!finished())
+				results.errors++;
+			if (creator)
+				results.finished++;
+		}
+
+		bool closed() const
+		{ return m_closed; }
+};
+
+StressClient::StressClient(const Options& opts, Results& results)
+	: m_opts(opts)
+	, m_results(results)
+{
+	m_client.clear_access_channels(log::alevel::all);
+	m_client.clear_error_channels(log::elevel::all);
+
+	m_client.init_asio();
+
+	m_client.set_open_handler([this](connection_hdl hdl) {
+		m_players.at(hdl)->onOpen();
+	});
+
+	m_client.set_message_handler([this](connection_hdl hdl, WSClient::message_ptr msg) {
+		Json::Value json;
+		if (Json::Reader().parse(msg->get_payload(), json, false))
+			m_players.at(hdl)->onMessage(json);
+	});
+
+	auto onClosed = [this](connection_hdl hdl) {
+		auto player = m_players.at(hdl);
+
+		if (!player->closed())
+		{
+			player->onClosed();
+
+			// the server closes the other connection of the match on its own
+			if (--m_open == 0)
+				m_client.stop();
+		}
+	};
+
+	m_client.set_close_handler(onClosed);
+	m_client.set_fail_handler(onClosed);
+}
+
+void StressClient::connect(Player& player)
+{
+	lib::error_code ec;
+	auto con = m_client.get_connection(m_opts.uri, ec);
+	if (ec)
+		throw runtime_error("couldn't connect to " + m_opts.uri + ": " + ec.message());
+
+	player.hdl = con->get_handle();
+	m_players[player.hdl] = &player;
+	m_open++;
+
+	m_client.connect(con);
+}
+
+void StressClient::send(Player& player, const Json::Value& msg)
+{
+	lib::error_code ec;
+	m_client.send(player.hdl, Json::FastWriter().write(msg), frame::opcode::text, ec);
+}
+
+void StressClient::close(Player& player)
+{
+	lib::error_code ec;
+	m_client.close(player.hdl, close::status::normal, "", ec);
+}
+
+static void usage(const char* name)
+{
+	cerr << "usage: " << name << " [-m matches] [-n messages] [-w window] [-j threads] [-s subscribers] [uri]\n"
+	     << "  -m  simultaneous matches (default 200)\n"
+	     << "  -n  chat messages sent by every player (default 500)\n"
+	     << "  -w  unacknowledged chat messages per player (default 8)\n"
+	     << "  -j  client threads (default 1)\n"
+	     << "  -s  matches whose creator subscribes to the random games list (default 10)\n"
+	     << "  uri defaults to ws://localhost:2516/\n";
+}
+
+int main(int argc, char** argv)
+{
+	Options opts;
+
+	int opt;
+	while ((opt = getopt(argc, argv, "m:n:w:j:s:h")) != -1)
+	{
+		switch (opt)
+		{
+			case 'm': opts.matches = strtoul(optarg, nullptr, 10); break;
+			case 'n': opts.messages = strtoul(optarg, nullptr, 10); break;
+			case 'w': opts.window = strtoul(optarg, nullptr, 10); break;
+			case 'j': opts.threads = strtoul(optarg, nullptr, 10); break;
+			case 's': opts.subscribers = strtoul(optarg, nullptr, 10); break;
+			default:
+				usage(argv[0]);
+				return 2;
+		}
+	}
+
+	if (argc - optind > 1 || opts.matches == 0 || opts.window == 0 || opts.threads == 0)
+	{
+		usage(argv[0]);
+		return 2;
+	}
+
+	if (optind < argc)
+		opts.uri = argv[optind];
+
+	Results results;
+
+	try
+	{
+		vector<unique_ptr<StressClient>> clients;
+		vector<unique_ptr<Player>> players;
+
+		for (unsigned i = 0; i < opts.threads; i++)
+			clients.emplace_back(new StressClient(opts, results));
+
+		auto start = Clock::now();
+
+		for (unsigned i = 0; i < opts.matches; i++)
+		{
+			auto& client = *clients[i % opts.threads];
+
+			players.emplace_back(new Player(client, true, i < opts.subscribers, "creator" + to_string(i)));
+			auto& creator = *players.back();
+			players.emplace_back(new Player(client, false, false, "joiner" + to_string(i)));
+			auto& joiner = *players.back();
+
+			creator.opponent = &joiner;
+			joiner.opponent  = &creator;
+
+			client.connect(creator);
+		}
+
+		vector<thread> threads;
+		for (auto&& client : clients)
+			threads.emplace_back(&StressClient::run, client.get());
+
+		for (auto&& t : threads)
+			t.join();
+
+		auto elapsed = duration_cast<duration<double>>(Clock::now() - start).count();
+
+		cout << "matches:         " << results.finished << " of " << opts.matches << '\n'
+		     << "relayed:         " << results.relayed << " messages\n"
+		     << "throughput:      " << static_cast<uint64_t>(results.relayed / elapsed) << " msg/s\n"
+		     << "reordered:       " << results.reordered << '\n'
+		     << "errors:          " << results.errors << '\n';
+
+		auto& lat = results.latencies;
+		if (!lat.empty())
+		{
+			sort(lat.begin(), lat.end());
+
+			auto percentile = [&](double p) {
+				return lat[static_cast<size_t>(p * (lat.size() - 1))];
+			};
+
+			cout << "latency:         p50 " << percentile(0.5) << " µs, p99 " << percentile(0.99)
+			     << " µs, max " << lat.back() << " µs\n";
+		}
+
+		return results.errors == 0 && results.finished == opts.matches ? 0 : 1;
+	}
+	catch (std::exception& e)
+	{
+		cerr << "error: " << e.what() << endl;
+		return 2;
+	}
+}
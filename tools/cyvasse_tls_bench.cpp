@@ -0,0 +1,280 @@
+/* Copyright 2015 Jonas Platte
+ *
+ * This file is part of Cyvasse Online.
+ *
+ * Cyvasse Online is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Affero General Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later version.
+ *
+ * Cyvasse Online is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE. See the GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License along with this program.
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+// Measures what native TLS costs compared to plaintext. Needs a server built
+// with --enable-tls (a self-signed certificate is fine, it isn't verified):
+//
+//   openssl req -x509 -newkey rsa:2048 -nodes -keyout key.pem -out cert.pem -subj /CN=localhost
+//
+// Reports the connections per second with a full handshake each and with
+// resumed sessions, and the round trip time of websocket ping frames, which
+// the server answers without involving a worker. If the uri of a plaintext
+// server is given with -p, its round trip time is reported for comparison.
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <cstdlib>
+
+#include <unistd.h>
+#include <websocketpp/config/asio_client.hpp>
+#include <websocketpp/client.hpp>
+
+using namespace std;
+using namespace std::chrono;
+using namespace websocketpp;
+
+typedef client<config::asio_tls_client> TLSClient;
+typedef client<config::asio_client> PlainClient;
+typedef lib::shared_ptr<lib::asio::ssl::context> ContextPtr;
+typedef steady_clock Clock;
+
+struct Options
+{
+	string uri = "wss://localhost:2516/";
+	string plainUri;
+
+	unsigned connections = 500;
+	unsigned frames = 10000;
+	size_t payload = 64;
+};
+
+struct HandshakeResults
+{
+	unsigned connected = 0;
+	unsigned resumed = 0;
+	unsigned failed = 0;
+	double perSecond = 0;
+};
+
+template <typename Client>
+static void initClient(Client& client)
+{
+	client.clear_access_channels(log::alevel::all);
+	client.clear_error_channels(log::elevel::all);
+
+	client.init_asio();
+}
+
+static void initTLS(TLSClient& client)
+{
+	auto ctx = lib::make_shared<lib::asio::ssl::context>(lib::asio::ssl::context::sslv23_client);
+	ctx->set_verify_mode(lib::asio::ssl::verify_none);
+
+	client.set_tls_init_handler([ctx](connection_hdl) { return ctx; });
+}
+
+// opens and closes opts.connections connections one after another
+static HandshakeResults benchHandshakes(const Options& opts, bool resume)
+{
+	TLSClient client;
+	initClient(client);
+	initTLS(client);
+
+	HandshakeResults results;
+	SSL_SESSION* session = nullptr;
+
+	client.set_socket_init_handler([&](connection_hdl, lib::asio::ssl::stream<lib::asio::ip::tcp::socket>& stream) {
+		if (resume && session)
+			SSL_set_session(stream.native_handle(), session);
+	});
+
+	function<void()> connectNext = [&] {
+		lib::error_code ec;
+		auto con = client.get_connection(opts.uri, ec);
+		if (ec)
+			throw runtime_error("couldn't connect to " + opts.uri + ": " + ec.message());
+
+		client.connect(con);
+	};
+
+	auto next = [&] {
+		if (results.connected + results.failed < opts.connections)
+			connectNext();
+	};
+
+	client.set_open_handler([&](connection_hdl hdl) {
+		auto ssl = client.get_con_from_hdl(hdl)->get_socket().native_handle();
+
+		results.connected++;
+		if (SSL_session_reused(ssl))
+			results.resumed++;
+
+		// with TLS 1.3 the ticket arrives after the handshake, so take the newest one
+		if (resume)
+		{
+			if (session)
+				SSL_SESSION_free(session);
+
+			session = SSL_get1_session(ssl);
+		}
+
+		lib::error_code ec;
+		client.close(hdl, close::status::normal, "", ec);
+	});
+
+	client.set_close_handler([&](connection_hdl) { next(); });
+	client.set_fail_handler([&](connection_hdl) {
+		results.failed++;
+		next();
+	});
+
+	auto start = Clock::now();
+
+	connectNext();
+	client.run();
+
+	auto elapsed = duration_cast<duration<double>>(Clock::now() - start).count();
+	results.perSecond = results.connected / elapsed;
+
+	if (session)
+		SSL_SESSION_free(session);
+
+	return results;
+}
+
+// round trip times of opts.frames ping frames over one connection, in µs
+template <typename Client>
+static vector<uint64_t> benchFrames(Client& client, const string& uri, const Options& opts)
+{
+	vector<uint64_t> rtts;
+	rtts.reserve(opts.frames);
+
+	const string payload(opts.payload, 'x');
+	Clock::time_point sentAt;
+
+	auto ping = [&](connection_hdl hdl) {
+		sentAt = Clock::now();
+		client.ping(hdl, payload);
+	};
+
+	client.set_open_handler(ping);
+
+	client.set_pong_handler([&](connection_hdl hdl, string) {
+		rtts.push_back(duration_cast<microseconds>(Clock::now() - sentAt).count());
+
+		if (rtts.size() < opts.frames)
+			ping(hdl);
+		else
+		{
+			lib::error_code ec;
+			client.close(hdl, close::status::normal, "", ec);
+		}
+	});
+
+	client.set_fail_handler([&](connection_hdl) {
+		throw runtime_error("couldn't connect to " + uri);
+	});
+
+	lib::error_code ec;
+	auto con = client.get_connection(uri, ec);
+	if (ec)
+		throw runtime_error("couldn't connect to " + uri + ": " + ec.message());
+
+	client.connect(con);
+	client.run();
+
+	sort(rtts.begin(), rtts.end());
+	return rtts;
+}
+
+static void printRTTs(const char* name, const vector<uint64_t>& rtts)
+{
+	if (rtts.empty())
+		return;
+
+	uint64_t sum = 0;
+	for (auto rtt : rtts)
+		sum += rtt;
+
+	cout << name << "mean " << sum / rtts.size() << " µs, p50 " << rtts[rtts.size() / 2]
+	     << " µs, p99 " << rtts[static_cast<size_t>(0.99 * (rtts.size() - 1))] << " µs\n";
+}
+
+static void usage(const char* name)
+{
+	cerr << "usage: " << name << " [-c connections] [-n frames] [-b bytes] [-p plain-uri] [uri]\n"
+	     << "  -c  connections opened for each handshake test (default 500)\n"
+	     << "  -n  ping frames sent for the round trip test (default 10000)\n"
+	     << "  -b  payload bytes of every ping frame (default 64)\n"
+	     << "  -p  plaintext server to compare the round trip time with, e.g. ws://localhost:2517/\n"
+	     << "  uri defaults to wss://localhost:2516/\n";
+}
+
+int main(int argc, char** argv)
+{
+	Options opts;
+
+	int opt;
+	while ((opt = getopt(argc, argv, "c:n:b:p:h")) != -1)
+	{
+		switch (opt)
+		{
+			case 'c': opts.connections = strtoul(optarg, nullptr, 10); break;
+			case 'n': opts.frames = strtoul(optarg, nullptr, 10); break;
+			case 'b': opts.payload = strtoul(optarg, nullptr, 10); break;
+			case 'p': opts.plainUri = optarg; break;
+			default:
+				usage(argv[0]);
+				return 2;
+		}
+	}
+
+	// websocketpp limits ping payloads to 125 bytes
+	if (argc - optind > 1 || opts.connections == 0 || opts.frames == 0 || opts.payload > 125)
+	{
+		usage(argv[0]);
+		return 2;
+	}
+
+	if (optind < argc)
+		opts.uri = argv[optind];
+
+	try
+	{
+		auto full = benchHandshakes(opts, false);
+		auto resumed = benchHandshakes(opts, true);
+
+		cout << "full handshakes:    " << static_cast<uint64_t>(full.perSecond) << " conn/s ("
+		     << full.failed << " failed)\n"
+		     << "resumed sessions:   " << static_cast<uint64_t>(resumed.perSecond) << " conn/s ("
+		     << resumed.resumed << " of " << resumed.connected << " resumed, " << resumed.failed << " failed)\n";
+
+		{
+			TLSClient client;
+			initClient(client);
+			initTLS(client);
+			printRTTs("tls round trip:     ", benchFrames(client, opts.uri, opts));
+		}
+
+		if (!opts.plainUri.empty())
+		{
+			PlainClient client;
+			initClient(client);
+			printRTTs("plain round trip:   ", benchFrames(client, opts.plainUri, opts));
+		}
+
+		return full.failed == 0 && resumed.failed == 0 ? 0 : 1;
+	}
+	catch (std::exception& e)
+	{
+		cerr << "error: " << e.what() << endl;
+		return 2;
+	}
+}
@@ -0,0 +1,395 @@
+/* Copyright 2015 Jonas Platte
+ *
+ * This file is part of Cyvasse Online.
+ *
+ * Cyvasse Online is free software: you can redistribute it and/or modify it under the
+ * terms of the GNU Affero General Public License as published by the Free Software Foundation,
+ * either version 3 of the License, or (at your option) any later version.
+ *
+ * Cyvasse Online is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE. See the GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License along with this program.
+ * If not, see <http://www.gnu.org/licenses/>.
+ */
+// Compares the accept paths of the server (ioUringAccept: true / false in
+// Compares a unix domain socket listener of the server with TCP loopback
+// (a listen section in config.yml with both a port and a unix socket):
+// sends websocket ping frames over one connection to each and waits for
+// every pong before sending the next, so it measures the round trip through
+// the kernel and the server's I/O thread. Reports the round trip times and
+// the CPU time used per round trip by this process and, if the server's
+// pid is given, by the server.
+//
+// The client is written against plain sockets since websocketpp's client
+// can only connect over TCP.
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <vector>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using namespace std;
+using namespace std::chrono;
+
+typedef steady_clock Clock;
+
+struct Options
+{
+	string unixPath;
+	string host = "localhost";
+	string port = "2516";
+
+	unsigned frames = 10000;
+	size_t payload = 64;
+	pid_t serverPid = 0;
+};
+
+struct Results
+{
+	vector<double> rtts; // µs, sorted
+	double clientCpu = 0; // µs per round trip
+	double serverCpu = 0;
+};
+
+// user + system time of a process in clock ticks, 0 if it can't be read
+static uint64_t cpuTicks(pid_t pid)
+{
+	ifstream stat("/proc/" + to_string(pid) + "/stat");
+	string line;
+	if (!getline(stat, line))
+		return 0;
+
+	// the command name can contain spaces, the fields after it can't
+	istringstream fields(line.substr(line.rfind(')') + 2));
+
+	string field;
+	uint64_t utime = 0, stime = 0;
+	for (int i = 3; i <= 15 && fields >> field; i++)
+	{
+		if (i == 14)
+			utime = stoull(field);
+		else if (i == 15)
+			stime = stoull(field);
+	}
+
+	return utime + stime;
+}
+
+static double ticksToUs(uint64_t ticks)
+{
+	return ticks * 1e6 / sysconf(_SC_CLK_TCK);
+}
+
+static double ownCpuUs()
+{
+	rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+
+	auto us = [](const timeval& tv) { return tv.tv_sec * 1e6 + tv.tv_usec; };
+	return us(usage.ru_utime) + us(usage.ru_stime);
+}
+
+static system_error lastError(const string& what)
+{
+	return system_error(errno, system_category(), what);
+}
+
+static int connectUnix(const string& path)
+{
+	sockaddr_un addr {};
+	addr.sun_family = AF_UNIX;
+
+	if (path.size() >= sizeof(addr.sun_path))
+		throw runtime_error("unix socket path is too long");
+
+	memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+
+	int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd == -1)
+		throw lastError("socket");
+
+	if (connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == -1)
+	{
+		auto err = lastError("connect to " + path);
+		close(fd);
+		throw err;
+	}
+
+	return fd;
+}
+
+static int connectTCP(const string& host, const string& port)
+{
+	addrinfo hints {};
+	hints.ai_socktype = SOCK_STREAM;
+
+	addrinfo* res;
+	if (int err = getaddrinfo(host.c_str(), port.c_str(), &hints, &res))
+		throw runtime_error("couldn't resolve " + host + ": " + gai_strerror(err));
+
+	int fd = -1;
+	for (auto ai = res; ai && fd == -1; ai = ai->ai_next)
+	{
+		fd = socket(ai->ai_family, ai->ai_socktype | SOCK_CLOEXEC, ai->ai_protocol);
+		if (fd != -1 && connect(fd, ai->ai_addr, ai->ai_addrlen) == -1)
+		{
+			close(fd);
+			fd = -1;
+		}
+	}
+
+	freeaddrinfo(res);
+
+	if (fd == -1)
+		throw lastError("connect to " + host + ":" + port);
+
+	// the pings are tiny, don't let Nagle hold them back
+	int on = 1;
+	setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+
+	return fd;
+}
+
+static void writeAll(int fd, const string& data)
+{
+	for (size_t done = 0; done < data.size(); )
+	{
+		auto n = write(fd, data.data() + done, data.size() - done);
+		if (n <= 0)
+			throw lastError("write");
+
+		done += n;
+	}
+}
+
+static void readAll(int fd, char* buf, size_t size)
+{
+	for (size_t done = 0; done < size; )
+	{
+		auto n = read(fd, buf + done, size - done);
+		if (n <= 0)
+			throw n == 0 ? runtime_error("the server closed the connection") : lastError("read");
+
+		done += n;
+	}
+}
+
+static void handshake(int fd)
+{
+	writeAll(fd,
+		"GET / HTTP/1.1\r\n"
+		"Host: localhost\r\n"
+		"Upgrade: websocket\r\n"
+		"Connection: Upgrade\r\n"
+		"Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n"
+		"Sec-WebSocket-Version: 13\r\n"
+		"\r\n"
+	);
+
+	// the server doesn't send anything after the response before we do
+	string response;
+	char c;
+	while (response.size() < 4 || response.compare(response.size() - 4, 4, "\r\n\r\n") != 0)
+	{
+		readAll(fd, &c, 1);
+		response += c;
+	}
+
+	if (response.compare(0, 12, "HTTP/1.1 101") != 0)
+		throw runtime_error("websocket handshake failed: " + response.substr(0, response.find('\r')));
+}
+
+// a masked ping frame (RFC 6455 5.2, 5.5.2), payloads are at most 125 bytes
+static string pingFrame(const string& payload, mt19937& rng)
+{
+	string frame;
+	frame += char(0x89);
+	frame += char(0x80 | payload.size());
+
+	char mask[4];
+	for (auto& byte : mask)
+		byte = char(rng());
+
+	frame.append(mask, 4);
+	for (size_t i = 0; i < payload.size(); i++)
+		frame += char(payload[i] ^ mask[i % 4]);
+
+	return frame;
+}
+
+// skips other frames until the pong
+static void readPong(int fd, size_t payloadSize)
+{
+	for (;;)
+	{
+		unsigned char header[2];
+		readAll(fd, reinterpret_cast<char*>(header), 2);
+
+		uint64_t size = header[1] & 0x7F;
+		if (size >= 126)
+		{
+			unsigned char ext[8];
+			size_t extSize = size == 126 ? 2 : 8;
+			readAll(fd, reinterpret_cast<char*>(ext), extSize);
+
+			size = 0;
+			for (size_t i = 0; i < extSize; i++)
+				size = size << 8 | ext[i];
+		}
+
+		vector<char> payload(size);
+		readAll(fd, payload.data(), size);
+
+		if ((header[0] & 0x0F) == 0x8)
+			throw runtime_error("the server closed the connection");
+		if ((header[0] & 0x0F) == 0xA && size == payloadSize)
+			return;
+	}
+}
+
+static Results measure(int fd, const Options& opts)
+{
+	handshake(fd);
+
+	mt19937 rng(42);
+	string payload(opts.payload, 'x');
+
+	// warm up the connection and the server
+	for (unsigned i = 0; i < 100; i++)
+	{
+		writeAll(fd, pingFrame(payload, rng));
+		readPong(fd, payload.size());
+	}
+
+	Results results;
+	results.rtts.reserve(opts.frames);
+
+	uint64_t serverTicks = opts.serverPid ? cpuTicks(opts.serverPid) : 0;
+	double clientCpu = ownCpuUs();
+
+	for (unsigned i = 0; i < opts.frames; i++)
+	{
+		auto frame = pingFrame(payload, rng);
+
+		auto start = Clock::now();
+		writeAll(fd, frame);
+		readPong(fd, payload.size());
+		results.rtts.push_back(duration_cast<duration<double, micro>>(Clock::now() - start).count());
+	}
+
+	results.clientCpu = (ownCpuUs() - clientCpu) / opts.frames;
+	if (opts.serverPid)
+		results.serverCpu = ticksToUs(cpuTicks(opts.serverPid) - serverTicks) / opts.frames;
+
+	sort(results.rtts.begin(), results.rtts.end());
+	close(fd);
+
+	return results;
+}
+
+static void report(const string& name, const Results& results, bool withServer)
+{
+	const auto& rtts = results.rtts;
+	auto percentile = [&](double p) { return rtts[min(rtts.size() - 1, size_t(p * rtts.size()))]; };
+
+	double sum = 0;
+	for (double rtt : rtts)
+		sum += rtt;
+
+	cout.setf(ios::fixed);
+	cout.precision(1);
+
+	cout << name << "  avg " << sum / rtts.size() << " µs, p50 " << percentile(0.5)
+	     << " µs, p99 " << percentile(0.99) << " µs, client cpu " << results.clientCpu << " µs";
+
+	if (withServer)
+		cout << ", server cpu " << results.serverCpu << " µs";
+
+	cout << " per round trip\n";
+}
+
+static void usage(const char* name)
+{
+	cerr << "usage: " << name << " -u unix-socket [-t host:port] [-n frames] [-s payload] [-P server-pid]\n"
+	     << "  -u  path of the server's unix domain socket\n"
+	     << "  -t  TCP endpoint of the same server (default localhost:2516)\n"
+	     << "  -n  round trips per endpoint (default 10000)\n"
+	     << "  -s  ping payload in bytes, at most 125 (default 64)\n"
+	     << "  -P  pid of the server, to report the CPU time it used\n";
+}
+
+int main(int argc, char** argv)
+{
+	Options opts;
+
+	int opt;
+	while ((opt = getopt(argc, argv, "u:t:n:s:P:h")) != -1)
+	{
+		switch (opt)
+		{
+			case 'u': opts.unixPath = optarg; break;
+			case 't':
+			{
+				string endpoint = optarg;
+				auto colon = endpoint.rfind(':');
+				if (colon == string::npos)
+				{
+					usage(argv[0]);
+					return 2;
+				}
+
+				opts.host = endpoint.substr(0, colon);
+				opts.port = endpoint.substr(colon + 1);
+				break;
+			}
+			case 'n': opts.frames = strtoul(optarg, nullptr, 10); break;
+			case 's': opts.payload = strtoul(optarg, nullptr, 10); break;
+			case 'P': opts.serverPid = strtoul(optarg, nullptr, 10); break;
+			default:
+				usage(argv[0]);
+				return 2;
+		}
+	}
+
+	if (optind != argc || opts.unixPath.empty() || opts.frames == 0 || opts.payload > 125)
+	{
+		usage(argv[0]);
+		return 2;
+	}
+
+	try
+	{
+		// one after the other, so they don't compete for the server's I/O thread
+		auto tcp = measure(connectTCP(opts.host, opts.port), opts);
+		auto uds = measure(connectUnix(opts.unixPath), opts);
+
+		report("tcp loopback:", tcp, opts.serverPid != 0);
+		report("unix socket: ", uds, opts.serverPid != 0);
+
+		return 0;
+	}
+	catch (std::exception& e)
+	{
+		cerr << "error: " << e.what() << endl;
+		return 2;
+	}
+}
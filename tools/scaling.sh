@@ -0,0 +1,67 @@
+#!/bin/bash
+# Runs cyvasse-stress against the server at 1, 2, 4, ... max-workers workers and
+# prints the throughput relative to a single worker. Build the server with
+# ./configure --enable-tsan to check for data races at the same time, every
+# ThreadSanitizer report of the server is counted and kept in the run
+# directory.
+#
+# usage: tools/scaling.sh [-w max-workers] [-p port] [-- cyvasse-stress options]
+
+set -e
+
+maxWorkers=$(nproc)
+port=2599
+server=$(pwd)/cyvasse-server
+stress=$(pwd)/cyvasse-stress
+
+while getopts "w:p:" opt; do
+	case $opt in
+		w) maxWorkers=$OPTARG ;;
+		p) port=$OPTARG ;;
+		*) sed -n 's/^# usage: //p' "$0" >&2; exit 2 ;;
+	esac
+done
+shift $((OPTIND - 1))
+
+runDir=$(mktemp -d cyvasse-scaling.XXXXXX)
+echo "logs in $runDir"
+printf '%8s %12s %8s %10s %6s\n' workers msg/s speedup reordered races
+
+workers=1
+base=
+while [ "$workers" -le "$maxWorkers" ]; do
+	dir=$runDir/$workers
+	mkdir "$dir"
+
+	printf 'listenPort: %s\nworkers: %s\nlogLevel: warning\n' "$port" "$workers" > "$dir/config.yml"
+
+	(cd "$dir" && TSAN_OPTIONS="halt_on_error=0 $TSAN_OPTIONS" exec "$server" 2> server.log) &
+	serverPid=$!
+
+	# wait for the server to listen
+	i=0
+	until (exec 3<>/dev/tcp/127.0.0.1/$port) 2>/dev/null || [ $i -ge 50 ]; do
+		sleep 0.1
+		i=$((i + 1))
+	done
+
+	"$stress" "$@" "ws://localhost:$port/" > "$dir/stress.log" || true
+
+	kill -TERM $serverPid
+	wait $serverPid || true
+
+	rate=$(sed -n 's/^throughput: *\([0-9]*\).*/\1/p' "$dir/stress.log")
+	reordered=$(sed -n 's/^reordered: *\([0-9]*\).*/\1/p' "$dir/stress.log")
+	races=$(grep -c 'WARNING: ThreadSanitizer' "$dir/server.log" || true)
+
+	[ -z "$base" ] && base=${rate:-0}
+	speedup=$(awk -v r="${rate:-0}" -v b="$base" 'BEGIN { printf "%.2f", b ? r / b : 0 }')
+
+	printf '%8s %12s %8s %10s %6s\n' "$workers" "${rate:-failed}" "$speedup" "${reordered:--}" "$races"
+
+	if [ "$workers" -lt "$maxWorkers" ] && [ $((workers * 2)) -gt "$maxWorkers" ]; then
+		workers=$maxWorkers
+	else
+		workers=$((workers * 2))
+	fi
+done